@@ -0,0 +1,141 @@
+//! [Database]
+#include <thread>
+#include <queue>
+#include <condition_variable>
+#include <fastcgi++/coroutine.hpp>
+
+class Database
+{
+private:
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_kill;
+
+    struct Query
+    {
+        unsigned key;
+        std::function<void(Fastcgipp::Message)> callback;
+    };
+    std::queue<Query> m_queue;
+
+    void handler()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while(!m_kill)
+        {
+            if(m_queue.empty())
+                m_cv.wait(lock);
+            else
+            {
+                Query query = std::move(m_queue.front());
+                m_queue.pop();
+                lock.unlock();
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+                const std::string result = std::to_string(query.key*query.key);
+
+                Fastcgipp::Message message(1);
+                message.data.assign(result.cbegin(), result.cend());
+                query.callback(std::move(message));
+                lock.lock();
+            }
+        }
+    }
+
+public:
+    void query(
+            unsigned key,
+            const std::function<void(Fastcgipp::Message)>& callback)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push(Query{key, callback});
+        m_cv.notify_one();
+    }
+
+    void start()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_thread.joinable())
+        {
+            m_kill = false;
+            std::thread thread(std::bind(&Database::handler, this));
+            m_thread.swap(thread);
+        }
+    }
+
+    void stop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if(m_thread.joinable())
+        {
+            m_kill = true;
+            m_cv.notify_one();
+            lock.unlock();
+            m_thread.join();
+        }
+    }
+};
+
+Database database;
+//! [Database]
+
+//! [Request definition]
+class Squares: public Fastcgipp::CoRequest<char>
+{
+    //! [Request definition]
+    //! [Lookup]
+    Fastcgipp::Task<std::string> lookup(unsigned key)
+    {
+        database.query(key, callback());
+        const Fastcgipp::Message message = co_await receive();
+        co_return std::string(message.data.cbegin(), message.data.cend());
+    }
+    //! [Lookup]
+
+    //! [Response]
+    Fastcgipp::Task<> coResponse()
+    {
+        out <<
+"Content-Type: text/html; charset=iso-8859-1\r\n\r\n"
+"<!DOCTYPE html>\n"
+"<html lang='en'>"
+    "<head>"
+        "<meta charset='iso-8859-1' />"
+        "<title>fastcgi++: Coroutine</title>"
+    "</head>"
+    "<body>"
+        "<p>";
+
+        for(unsigned i=1; i<=5; ++i)
+        {
+            const std::string square = co_await lookup(i);
+            out << i << "&sup2; = " << square << "<br />";
+            out.flush();
+        }
+
+        out << "</p>"
+    "</body>"
+"</html>";
+    }
+};
+//! [Response]
+
+//! [Finish]
+#include <fastcgi++/manager.hpp>
+
+int main()
+{
+    database.start();
+
+    Fastcgipp::Manager<Squares> manager(1);
+    manager.setupSignals();
+    manager.listen();
+    manager.start();
+    manager.join();
+
+    database.stop();
+
+    return 0;
+}
+//! [Finish]
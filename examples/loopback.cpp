@@ -0,0 +1,202 @@
+//! [Request definition]
+#include <fastcgi++/request.hpp>
+#include <fastcgi++/manager.hpp>
+#include <fastcgi++/loopback.hpp>
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+class Hello: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        out << "Content-Type: text/plain\r\n\r\nHello World!";
+        return true;
+    }
+};
+//! [Request definition]
+
+//! [Records]
+void record(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::RecordType type,
+        Fastcgipp::Protocol::FcgiId id,
+        const char* content,
+        size_t size)
+{
+    Fastcgipp::Protocol::Header header;
+    header.version = Fastcgipp::Protocol::version;
+    header.type = type;
+    header.fcgiId = id;
+    header.contentLength = uint16_t(size);
+    header.paddingLength = 0;
+    header.reserved = 0;
+
+    const char* const start = (const char*)&header;
+    records.insert(records.end(), start, start+sizeof(header));
+    records.insert(records.end(), content, content+size);
+}
+
+// Frame a complete GET request ahead of time so the client costs next to
+// nothing
+std::vector<char> request(Fastcgipp::Protocol::FcgiId id)
+{
+    std::vector<char> records;
+
+    Fastcgipp::Protocol::BeginRequest begin;
+    std::fill(begin.reserved, begin.reserved+sizeof(begin.reserved), 0);
+    begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+    begin.flags = Fastcgipp::Protocol::BeginRequest::keepConnBit;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+            id,
+            (const char*)&begin,
+            sizeof(begin));
+
+    const std::string params = std::string(1, char(11)) + char(1)
+        + "REQUEST_URI/";
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            params.data(),
+            params.size());
+    record(records, Fastcgipp::Protocol::RecordType::PARAMS, id, nullptr, 0);
+    record(records, Fastcgipp::Protocol::RecordType::IN, id, nullptr, 0);
+
+    return records;
+}
+//! [Records]
+
+//! [Benchmark]
+void send(Fastcgipp::Loopback::Client& client, const std::vector<char>& data)
+{
+    size_t sent = 0;
+    while(sent < data.size())
+    {
+        const size_t count = client.write(data.data()+sent, data.size()-sent);
+        if(count == 0)
+            std::this_thread::yield();
+        sent += count;
+    }
+}
+
+// Cost of each request
+struct Cost
+{
+    double nanoseconds;
+    double cycles;
+};
+
+// Run requests with a number of them in flight at once on one connection
+Cost benchmark(
+        Fastcgipp::Loopback::Client& client,
+        unsigned requests,
+        unsigned depth)
+{
+    std::vector<std::vector<char>> framed;
+    for(unsigned id=1; id<=depth; ++id)
+        framed.push_back(request(id));
+
+    std::vector<char> buffer;
+    std::vector<char> chunk(65536);
+    unsigned sent = 0;
+    unsigned received = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+    const unsigned long long startCycles = __rdtsc();
+#endif
+    for(; sent < std::min(depth, requests); ++sent)
+        send(client, framed[sent]);
+
+    while(received < requests)
+    {
+        const size_t count = client.read(chunk.data(), chunk.size());
+        if(count == 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        buffer.insert(buffer.end(), chunk.data(), chunk.data()+count);
+
+        size_t position = 0;
+        while(buffer.size()-position >= sizeof(Fastcgipp::Protocol::Header))
+        {
+            const Fastcgipp::Protocol::Header& header =
+                *(const Fastcgipp::Protocol::Header*)(buffer.data()+position);
+            const size_t size = sizeof(header)
+                +header.contentLength
+                +header.paddingLength;
+            if(buffer.size()-position < size)
+                break;
+
+            // Reuse the FcgiId for the next request
+            if(header.type == Fastcgipp::Protocol::RecordType::END_REQUEST)
+            {
+                ++received;
+                if(sent < requests)
+                {
+                    send(client, framed[header.fcgiId-1]);
+                    ++sent;
+                }
+            }
+            position += size;
+        }
+        buffer.erase(buffer.begin(), buffer.begin()+position);
+    }
+
+    Cost cost;
+    const std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    cost.nanoseconds = elapsed.count()/requests;
+#if defined(__x86_64__) || defined(__i386__)
+    cost.cycles = double(__rdtsc()-startCycles)/requests;
+#else
+    cost.cycles = 0;
+#endif
+    return cost;
+}
+//! [Benchmark]
+
+//! [Main]
+int main(int argc, char** argv)
+{
+    const unsigned requests = argc>1 ? std::stoul(argv[1]) : 100000;
+
+    Fastcgipp::Loopback loopback;
+    Fastcgipp::Manager<Hello> manager;
+    manager.setTransport(loopback);
+    manager.start();
+
+    {
+        Fastcgipp::Loopback::Client client = loopback.connect();
+        for(unsigned depth: {1, 16, 256})
+        {
+            // Warm up first
+            benchmark(client, depth, depth);
+            const Cost cost = benchmark(client, requests, depth);
+
+            std::cout << depth << " in flight: " << cost.nanoseconds \
+                << " ns/request";
+            if(cost.cycles != 0)
+                std::cout << ", " << cost.cycles << " TSC cycles/request";
+            std::cout << '\n';
+        }
+    }
+
+    manager.stop();
+    manager.join();
+
+    return 0;
+}
+//! [Main]
@@ -0,0 +1,95 @@
+//! [Request definition]
+#include <fastcgi++/request.hpp>
+#include <fastcgi++/manager.hpp>
+#include <fastcgi++/client.hpp>
+
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <future>
+
+class Hello: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        out << "Content-Type: text/plain\r\n\r\nHello World!";
+        return true;
+    }
+};
+//! [Request definition]
+
+//! [Benchmark]
+// Send a batch of requests through the client and return requests/second
+double benchmark(Fastcgipp::Client& client, unsigned requests)
+{
+    std::atomic_uint remaining(requests);
+    std::atomic_uint failed(0);
+    std::promise<void> done;
+
+    const auto start = std::chrono::steady_clock::now();
+    for(unsigned i=0; i<requests; ++i)
+        client.request(
+                {{"REQUEST_URI", "/"}},
+                nullptr,
+                0,
+                [&] (Fastcgipp::Client::Response&& response)
+                {
+                    if(!response.complete)
+                        ++failed;
+                    if(--remaining == 0)
+                        done.set_value();
+                });
+    done.get_future().wait();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    if(failed != 0)
+        std::cerr << failed << " requests failed\n";
+    return requests/elapsed.count();
+}
+//! [Benchmark]
+
+//! [Main]
+int main(int argc, char** argv)
+{
+    const char* const port = argc>1 ? argv[1] : "23456";
+    const unsigned requests = argc>2 ? std::stoul(argv[2]) : 100000;
+    const unsigned concurrency = 256;
+
+    Fastcgipp::ListenOptions options;
+    options.noDelay = true;
+    options.backlog = concurrency;
+
+    Fastcgipp::Manager<Hello> manager;
+    if(!manager.listen("127.0.0.1", port, options))
+        return 1;
+    manager.start();
+
+    {
+        Fastcgipp::Client client(1, concurrency);
+        client.server("127.0.0.1", port);
+        client.start();
+        benchmark(client, concurrency);
+        std::cout << "1 connection x " << concurrency << " requests:   " \
+            << benchmark(client, requests) << " requests/second\n";
+        client.stop();
+        client.join();
+    }
+
+    {
+        Fastcgipp::Client client(concurrency, 1);
+        client.server("127.0.0.1", port);
+        client.start();
+        benchmark(client, concurrency);
+        std::cout << concurrency << " connections x 1 request:   " \
+            << benchmark(client, requests) << " requests/second\n";
+        client.stop();
+        client.join();
+    }
+
+    manager.stop();
+    manager.join();
+
+    return 0;
+}
+//! [Main]
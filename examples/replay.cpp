@@ -0,0 +1,83 @@
+//! [Request definition]
+#include <fastcgi++/request.hpp>
+#include <fastcgi++/manager.hpp>
+#include <fastcgi++/capture.hpp>
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cstring>
+
+class Echo: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        out << "Content-Type: text/plain\r\n\r\n" \
+            << environment().requestUri;
+        return true;
+    }
+};
+//! [Request definition]
+
+//! [Record]
+// Serve requests on a port writing everything received to a file. A SIGTERM
+// ends it.
+int record(const char* path, const char* port)
+{
+    Fastcgipp::Manager<Echo> manager;
+    manager.setupSignals();
+    if(!manager.capture(path) || !manager.listen("127.0.0.1", port))
+        return 1;
+    manager.start();
+    manager.join();
+    return 0;
+}
+//! [Record]
+
+//! [Play]
+// Feed a file back into an in process Manager and report how it went
+int play(const char* path, double speed)
+{
+    Fastcgipp::Replay replay;
+    if(!replay.load(path))
+        return 1;
+
+    Fastcgipp::Loopback loopback;
+    Fastcgipp::Manager<Echo> manager;
+    manager.setTransport(loopback);
+    manager.start();
+
+    const Fastcgipp::Replay::Statistics stats = replay.play(loopback, speed);
+
+    manager.stop();
+    manager.join();
+
+    const std::chrono::duration<double> elapsed = stats.elapsed;
+    const std::chrono::duration<double, std::milli> lag = stats.lag;
+    std::cout << "Connections:        " << stats.connections << '\n' \
+        << "Requests:           " << stats.requests << '\n' \
+        << "Completed:          " << stats.completed << '\n' \
+        << "Bytes sent:         " << stats.sent << '\n' \
+        << "Bytes received:     " << stats.received << '\n' \
+        << "Elapsed:            " << elapsed.count() << " s\n" \
+        << "Requests/second:    " << stats.completed/elapsed.count() << '\n' \
+        << "Worst lag:          " << lag.count() << " ms\n";
+
+    return stats.completed == stats.requests ? 0 : 1;
+}
+//! [Play]
+
+//! [Main]
+int main(int argc, char** argv)
+{
+    if(argc > 3 && std::strcmp(argv[1], "record") == 0)
+        return record(argv[2], argv[3]);
+    if(argc > 2 && std::strcmp(argv[1], "play") == 0)
+        return play(argv[2], argc>3 ? std::stod(argv[3]) : 1);
+
+    std::cerr << "Usage: " << argv[0] << " record FILE PORT\n" \
+        << "       " << argv[0] << " play FILE [SPEED]\n" \
+        << "A SPEED of 0 plays the file as fast as possible.\n";
+    return 1;
+}
+//! [Main]
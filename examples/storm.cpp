@@ -0,0 +1,177 @@
+//! [Request definition]
+#include <fastcgi++/request.hpp>
+#include <fastcgi++/manager.hpp>
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <thread>
+#include <future>
+#include <algorithm>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+class Hello: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        out << "Content-Type: text/plain\r\n\r\nHello World!";
+        return true;
+    }
+};
+//! [Request definition]
+
+//! [Records]
+void record(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::RecordType type,
+        const char* content,
+        size_t size)
+{
+    Fastcgipp::Protocol::Header header;
+    header.version = Fastcgipp::Protocol::version;
+    header.type = type;
+    header.fcgiId = 1;
+    header.contentLength = uint16_t(size);
+    header.paddingLength = 0;
+    header.reserved = 0;
+
+    const char* const start = (const char*)&header;
+    records.insert(records.end(), start, start+sizeof(header));
+    records.insert(records.end(), content, content+size);
+}
+
+// Frame a complete GET request that closes the connection
+std::vector<char> request()
+{
+    std::vector<char> records;
+
+    Fastcgipp::Protocol::BeginRequest begin;
+    std::fill(begin.reserved, begin.reserved+sizeof(begin.reserved), 0);
+    begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+    begin.flags = 0;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+            (const char*)&begin,
+            sizeof(begin));
+
+    const std::string params = std::string(1, char(11)) + char(1)
+        + "REQUEST_URI/";
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            params.data(),
+            params.size());
+    record(records, Fastcgipp::Protocol::RecordType::PARAMS, nullptr, 0);
+    record(records, Fastcgipp::Protocol::RecordType::IN, nullptr, 0);
+
+    return records;
+}
+//! [Records]
+
+//! [Benchmark]
+// Connect, send one request and wait for the server to close the connection.
+// Returns the time taken in microseconds or a negative value on failure.
+double connection(
+        unsigned short port,
+        const std::vector<char>& records,
+        std::shared_future<void> go)
+{
+    go.wait();
+    const auto start = std::chrono::steady_clock::now();
+
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (const sockaddr*)&address, sizeof(address)) != 0
+            || write(fd, records.data(), records.size())
+                != ssize_t(records.size()))
+    {
+        close(fd);
+        return -1;
+    }
+
+    char chunk[4096];
+    ssize_t count;
+    while((count = read(fd, chunk, sizeof(chunk))) > 0);
+    close(fd);
+    if(count < 0)
+        return -1;
+
+    const std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+//! [Benchmark]
+
+//! [Main]
+int main(int argc, char** argv)
+{
+    const char* const port = argc>1 ? argv[1] : "23458";
+    const unsigned connections = argc>2 ? std::stoul(argv[2]) : 200;
+    const unsigned rounds = argc>3 ? std::stoul(argv[3]) : 10;
+
+    Fastcgipp::Manager<Hello> manager;
+    if(!manager.listen("127.0.0.1", port))
+        return 1;
+    manager.start();
+
+    const std::vector<char> records = request();
+    std::vector<double> latencies;
+    unsigned failed = 0;
+    std::chrono::duration<double> elapsed(0);
+
+    // Open a storm of connections all at once each round
+    for(unsigned round=0; round<rounds; ++round)
+    {
+        std::promise<void> go;
+        const std::shared_future<void> released(go.get_future());
+        std::vector<std::future<double>> clients;
+        for(unsigned i=0; i<connections; ++i)
+            clients.push_back(std::async(
+                        std::launch::async,
+                        connection,
+                        std::stoul(port),
+                        std::cref(records),
+                        released));
+
+        const auto start = std::chrono::steady_clock::now();
+        go.set_value();
+        for(auto& client: clients)
+        {
+            const double latency = client.get();
+            if(latency < 0)
+                ++failed;
+            else
+                latencies.push_back(latency);
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    if(failed != 0)
+        std::cerr << failed << " connections failed\n";
+    if(!latencies.empty())
+        std::cout << latencies.size()/elapsed.count() \
+            << " connections/second, median " \
+            << latencies[latencies.size()/2] << " us, p99 " \
+            << latencies[latencies.size()*99/100] << " us, max " \
+            << latencies.back() << " us\n";
+
+    manager.stop();
+    manager.join();
+
+    return 0;
+}
+//! [Main]
@@ -0,0 +1,211 @@
+//! [Request definition]
+#include <fastcgi++/request.hpp>
+#include <fastcgi++/manager.hpp>
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+class Hello: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        out << "Content-Type: text/plain\r\n\r\nHello World!";
+        return true;
+    }
+};
+//! [Request definition]
+
+//! [Records]
+void record(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::RecordType type,
+        Fastcgipp::Protocol::FcgiId id,
+        const char* content,
+        size_t size)
+{
+    Fastcgipp::Protocol::Header header;
+    header.version = Fastcgipp::Protocol::version;
+    header.type = type;
+    header.fcgiId = id;
+    header.contentLength = uint16_t(size);
+    header.paddingLength = 0;
+    header.reserved = 0;
+
+    const char* const start = (const char*)&header;
+    records.insert(records.end(), start, start+sizeof(header));
+    records.insert(records.end(), content, content+size);
+}
+
+// Frame a complete GET request ahead of time
+std::vector<char> request(Fastcgipp::Protocol::FcgiId id)
+{
+    std::vector<char> records;
+
+    Fastcgipp::Protocol::BeginRequest begin;
+    std::fill(begin.reserved, begin.reserved+sizeof(begin.reserved), 0);
+    begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+    begin.flags = Fastcgipp::Protocol::BeginRequest::keepConnBit;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+            id,
+            (const char*)&begin,
+            sizeof(begin));
+
+    const std::string params = std::string(1, char(11)) + char(1)
+        + "REQUEST_URI/";
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            params.data(),
+            params.size());
+    record(records, Fastcgipp::Protocol::RecordType::PARAMS, id, nullptr, 0);
+    record(records, Fastcgipp::Protocol::RecordType::IN, id, nullptr, 0);
+
+    return records;
+}
+//! [Records]
+
+//! [Benchmark]
+// Send requests one at a time over a plain blocking socket. Every response
+// is tiny so the Transceiver gets woken up to send nearly every one.
+void pingPong(
+        unsigned short port,
+        unsigned requests,
+        std::atomic_uint& failed)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (const sockaddr*)&address, sizeof(address)) != 0)
+    {
+        failed += requests;
+        close(fd);
+        return;
+    }
+
+    // Take turns with the FcgiIds so none is reused straight after it ends
+    std::vector<std::vector<char>> framed;
+    for(Fastcgipp::Protocol::FcgiId id=1; id<=256; ++id)
+        framed.push_back(request(id));
+    std::vector<char> buffer;
+    char chunk[4096];
+
+    for(unsigned i=0; i<requests; ++i)
+    {
+        const std::vector<char>& records = framed[i%framed.size()];
+        if(write(fd, records.data(), records.size())
+                != ssize_t(records.size()))
+        {
+            failed += requests-i;
+            break;
+        }
+
+        bool ended = false;
+        while(!ended)
+        {
+            const ssize_t count = read(fd, chunk, sizeof(chunk));
+            if(count <= 0)
+            {
+                failed += requests-i;
+                close(fd);
+                return;
+            }
+            buffer.insert(buffer.end(), chunk, chunk+count);
+
+            size_t position = 0;
+            while(buffer.size()-position
+                    >= sizeof(Fastcgipp::Protocol::Header))
+            {
+                const Fastcgipp::Protocol::Header& header =
+                    *(const Fastcgipp::Protocol::Header*)(
+                            buffer.data()+position);
+                const size_t size = sizeof(header)
+                    +header.contentLength
+                    +header.paddingLength;
+                if(buffer.size()-position < size)
+                    break;
+                if(header.type
+                        == Fastcgipp::Protocol::RecordType::END_REQUEST)
+                    ended = true;
+                position += size;
+            }
+            buffer.erase(buffer.begin(), buffer.begin()+position);
+        }
+    }
+
+    close(fd);
+}
+
+// Run ping pong clients on some connections and return requests/second
+double benchmark(
+        unsigned short port,
+        unsigned connections,
+        unsigned requests)
+{
+    std::atomic_uint failed(0);
+    std::vector<std::thread> clients;
+
+    const auto start = std::chrono::steady_clock::now();
+    for(unsigned i=0; i<connections; ++i)
+        clients.emplace_back(
+                pingPong,
+                port,
+                requests/connections,
+                std::ref(failed));
+    for(auto& client: clients)
+        client.join();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    if(failed != 0)
+        std::cerr << failed << " requests failed\n";
+    return requests/elapsed.count();
+}
+//! [Benchmark]
+
+//! [Main]
+int main(int argc, char** argv)
+{
+    const char* const port = argc>1 ? argv[1] : "23457";
+    const unsigned requests = argc>2 ? std::stoul(argv[2]) : 50000;
+
+    Fastcgipp::ListenOptions options;
+    options.noDelay = true;
+
+    Fastcgipp::Manager<Hello> manager;
+    if(!manager.listen("127.0.0.1", port, options))
+        return 1;
+    manager.start();
+
+    for(unsigned connections: {1, 8})
+    {
+        benchmark(std::stoul(port), connections, connections*100);
+        const double rate = benchmark(std::stoul(port), connections, requests);
+        std::cout << connections << " connections x 1 request: " << rate \
+            << " requests/second, " << 1e6/rate << " us/request\n";
+    }
+
+    manager.stop();
+    manager.join();
+
+    return 0;
+}
+//! [Main]
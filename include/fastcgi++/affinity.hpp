@@ -0,0 +1,61 @@
+/*!
+ * @file       affinity.hpp
+ * @brief      Declares CPU affinity functions
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_AFFINITY_HPP
+#define FASTCGIPP_AFFINITY_HPP
+
+#include <vector>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! A set of CPU numbers
+    /*!
+     * An empty set means no particular CPU.
+     */
+    typedef std::vector<unsigned> CpuSet;
+
+    //! The CPUs of a NUMA node
+    /*!
+     * Hand these to Manager_base::setAffinity() to keep all of a Manager's
+     * threads on one node.
+     *
+     * @param[in] node Index of the NUMA node
+     * @return The node's CPUs. Empty if there is no such node.
+     */
+    CpuSet nodeCpus(unsigned node);
+
+    //! Pin the calling thread to a set of CPUs
+    /*!
+     * @param[in] cpus CPUs the thread may run on. If empty nothing is done.
+     * @return True on success. False on failure.
+     */
+    bool pinThread(const CpuSet& cpus);
+}
+
+#endif
@@ -0,0 +1,179 @@
+/*!
+ * @file       arena.hpp
+ * @brief      Declares the Arena class and it's allocator
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_ARENA_HPP
+#define FASTCGIPP_ARENA_HPP
+
+#include <cstddef>
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Monotonic memory arena
+    /*!
+     * Allocation is a simple pointer bump out of the current chunk and
+     * deallocation does nothing at all. Everything is freed in one go when
+     * the arena is released or destroyed.
+     *
+     * Chunks start at 4KiB and double in size as the arena grows. Released
+     * chunks are kept in per thread free lists, one for each chunk size, so
+     * that the next arena to grow on the thread can reuse them without going
+     * through the heap.
+     *
+     * Arenas aren't thread safe.
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Arena
+    {
+    public:
+        Arena():
+            m_chunk(nullptr),
+            m_current(nullptr),
+            m_end(nullptr)
+        {}
+
+        Arena(const Arena&) =delete;
+        Arena& operator=(const Arena&) =delete;
+
+        ~Arena()
+        {
+            release();
+        }
+
+        //! Allocate some memory
+        /*!
+         * @param[in] size Size of the allocation in bytes
+         * @param[in] alignment Required alignment of the allocation. Must be a
+         *                      power of two.
+         * @return Pointer to the allocated memory
+         */
+        void* allocate(
+                size_t size,
+                size_t alignment=alignof(std::max_align_t))
+        {
+            char* const start = (char*)(
+                    (size_t(m_current)+alignment-1) & ~(alignment-1));
+            if(m_current == nullptr
+                    || start > m_end
+                    || size_t(m_end-start) < size)
+                return grow(size, alignment);
+            m_current = start+size;
+            return start;
+        }
+
+        //! Free everything allocated from the arena
+        void release();
+
+        //! Total size of the chunks held by the arena in bytes
+        size_t capacity() const;
+
+        //! Smallest chunk size
+        static const size_t minChunk = 4096;
+
+        //! Largest chunk size kept for reuse
+        static const size_t maxChunk = 1<<20;
+
+    private:
+        //! Header at the start of every chunk
+        struct Chunk
+        {
+            //! The chunk allocated before this one
+            Chunk* previous;
+
+            //! Size of the chunk including this header
+            size_t size;
+        };
+
+        //! Allocate out of a new chunk
+        void* grow(size_t size, size_t alignment);
+
+        //! Most recently allocated chunk
+        Chunk* m_chunk;
+
+        //! Next free byte in the current chunk
+        char* m_current;
+
+        //! End of the current chunk
+        char* m_end;
+    };
+
+    //! Standard allocator drawing from an Arena
+    /*!
+     * Use this to put containers in an arena.
+     *
+     * @code
+     * std::vector<int, Fastcgipp::ArenaAllocator<int>> numbers(arena());
+     * @endcode
+     *
+     * @tparam T Type to allocate
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    template<class T> class ArenaAllocator
+    {
+    public:
+        typedef T value_type;
+
+        ArenaAllocator(Arena& arena):
+            m_arena(&arena)
+        {}
+
+        template<class U> ArenaAllocator(const ArenaAllocator<U>& x):
+            m_arena(x.m_arena)
+        {}
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(m_arena->allocate(n*sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T*, size_t)
+        {}
+
+        template<class U> bool operator==(const ArenaAllocator<U>& x) const
+        {
+            return m_arena == x.m_arena;
+        }
+
+        template<class U> bool operator!=(const ArenaAllocator<U>& x) const
+        {
+            return m_arena != x.m_arena;
+        }
+
+    private:
+        template<class U> friend class ArenaAllocator;
+
+        //! Where our memory comes from
+        Arena* m_arena;
+    };
+}
+
+#endif
@@ -0,0 +1,247 @@
+/*!
+ * @file       cache.hpp
+ * @brief      Declares the ResponseCache class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_CACHE_HPP
+#define FASTCGIPP_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <atomic>
+
+#include "fastcgi++/message.hpp"
+#include "fastcgi++/sockets.hpp"
+#include "fastcgi++/timer.hpp"
+#include "fastcgi++/config.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    class PendingRequest;
+
+    //! Cache of complete responses
+    /*!
+     * Once handed to Manager_base::setCache(), the cache is consulted for
+     * every GET and HEAD request as soon as it's parameters have arrived. On
+     * a hit the request is never constructed. The stored records are simply
+     * sent back with the request's ID patched in.
+     *
+     * Responses are keyed by the REQUEST_METHOD and REQUEST_URI parameters
+     * along with any parameters added with vary(). Since the lookup happens
+     * before the Http::Environment is built these are raw FastCGI parameter
+     * names such as HTTP_ACCEPT_LANGUAGE or HTTP_COOKIE.
+     *
+     * Only one request per key is ever constructed to generate a response.
+     * Any other requests for the key that arrive in the meantime wait for it
+     * to finish and are then replied to from the cache. Should the response
+     * turn out not to be cacheable they all go on to generate it themselves
+     * and the key is marked to pass for a short while. Requests for a
+     * passing key are generated in parallel rather than one at a time.
+     *
+     * A response is cacheable if it ends normally without being aborted or
+     * cancelled, has no status or a 200 status, has no Set-Cookie header, has
+     * no Cache-Control header with no-store, no-cache or private and isn't
+     * larger than the maximum entry size. The least recently used entries are
+     * evicted to stay within the capacity.
+     *
+     * The cache must outlive any Manager using it.
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class ResponseCache
+    {
+    public:
+        //! Sole constructor
+        /*!
+         * @param[in] capacity Total size of all cached responses in bytes
+         * @param[in] ttl How long a response is served from the cache
+         * @param[in] maxEntry Largest response to cache in bytes. Zero means
+         *                     an eighth of the capacity.
+         * @param[in] pass How long a key passes once it's response is found
+         *                 not to be cacheable
+         */
+        ResponseCache(
+                size_t capacity,
+                Timer::Clock::duration ttl,
+                size_t maxEntry=0,
+                Timer::Clock::duration pass=std::chrono::seconds(1));
+
+        ~ResponseCache();
+
+        //! Key responses on another parameter
+        /*!
+         * @param[in] parameter Raw FastCGI parameter name (e.g. HTTP_COOKIE)
+         */
+        void vary(const std::string& parameter)
+        {
+            m_vary.push_back(parameter);
+        }
+
+        //! Drop every cached response
+        void clear();
+
+        //! Function for sending records
+        typedef std::function<void(const Socket&, std::vector<char>&&, bool)>
+            Send;
+
+        //! Outcome of lookup()
+        enum class Result
+        {
+            HIT,      //!< The response was found
+            GENERATE, //!< The caller should generate the response
+            WAIT,     //!< Someone else is generating the response
+            BYPASS    //!< The request isn't cacheable
+        };
+
+        //! Look a request up in the cache
+        /*!
+         * If WAIT is returned the pending request is sent a Message once the
+         * response is generated and should look itself up again. If GENERATE
+         * is returned the caller must either wrap the request's send function
+         * with capture() or call abandon().
+         *
+         * @param[in] pending The request to look up
+         * @param[out] key Key of the request
+         * @param[out] records Framed OUT records of a hit
+         * @return What to do next
+         */
+        Result lookup(
+                PendingRequest& pending,
+                std::string& key,
+                std::shared_ptr<const std::vector<char>>& records);
+
+        //! Capture a response into the cache as it is sent
+        /*!
+         * @param[in] key Key returned from lookup()
+         * @param[in] send The function to wrap
+         * @return A send function that captures the response
+         */
+        Send capture(const std::string& key, const Send& send);
+
+        //! Give up on generating a response
+        /*!
+         * Unlike an uncacheable response this doesn't make the key pass.
+         */
+        void abandon(const std::string& key);
+
+    private:
+        //! A cached response
+        struct Entry
+        {
+            Entry():
+                size(0),
+                generating(true)
+            {}
+
+            //! The framed OUT records or nullptr if the key passes
+            std::shared_ptr<const std::vector<char>> records;
+
+            //! Bytes counted against the capacity
+            size_t size;
+
+            //! When the entry goes stale
+            Timer::Clock::time_point expiry;
+
+            //! Position in m_lru
+            std::list<std::string>::iterator lru;
+
+            //! True while the response is being generated
+            bool generating;
+
+            //! Requests waiting on the response
+            std::vector<std::function<void(Message)>> waiters;
+        };
+
+        //! Accumulates a response as it is sent
+        class Capture;
+
+        //! Finish generating a response
+        /*!
+         * @param[in] key Key of the response
+         * @param[in] records The framed OUT records or nullptr if the
+         *                    response isn't cacheable and the key should pass
+         */
+        void store(
+                const std::string& key,
+                std::shared_ptr<const std::vector<char>>&& records);
+
+        //! Remove an entry's response or pass and it's place in the LRU list
+        void drop(Entry& entry);
+
+        //! Total size of all cached responses in bytes
+        const size_t m_capacity;
+
+        //! How long a response is served from the cache
+        const Timer::Clock::duration m_ttl;
+
+        //! How long a key passes once found not to be cacheable
+        const Timer::Clock::duration m_pass;
+
+        //! Largest response to cache in bytes
+        const size_t m_maxEntry;
+
+        //! Parameters responses are keyed on besides method and URI
+        std::vector<std::string> m_vary;
+
+        //! Thread safe our entries
+        std::mutex m_mutex;
+
+        //! Cached and in progress responses
+        std::unordered_map<std::string, Entry> m_entries;
+
+        //! Keys of cached responses, least recently used first
+        std::list<std::string> m_lru;
+
+        //! Current size of all cached responses in bytes
+        size_t m_size;
+
+#if FASTCGIPP_LOG_LEVEL > 3
+        //! Debug counter for hits
+        std::atomic_ullong m_hitCount;
+
+        //! Debug counter for misses
+        std::atomic_ullong m_missCount;
+
+        //! Debug counter for misses collapsed onto another
+        std::atomic_ullong m_waitCount;
+
+        //! Debug counter for misses passed to generate in parallel
+        std::atomic_ullong m_passCount;
+
+        //! Debug counter for evicted responses
+        std::atomic_ullong m_evictCount;
+#endif
+    };
+}
+
+#endif
@@ -0,0 +1,225 @@
+/*!
+ * @file       capture.hpp
+ * @brief      Declares the Capture and Replay classes
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+
+#ifndef FASTCGIPP_CAPTURE_HPP
+#define FASTCGIPP_CAPTURE_HPP
+
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+
+#include "fastcgi++/loopback.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Writes incoming FastCGI records to a file as they arrive
+    /*!
+     * The file starts with an eight byte magic number. Every event after that
+     * is a little endian header made up of the nanoseconds since the capture
+     * was opened (64 bits), the connection it happened on (32 bits) and the
+     * size of the record that follows (32 bits). A size of zero means the
+     * connection was closed.
+     *
+     * Hand a path to Manager_base::capture() to record live traffic and
+     * feed the file back in with Replay.
+     */
+    class Capture
+    {
+    public:
+        //! Magic number the file starts with
+        static const char magic[8];
+
+        //! Size of the header preceding each event
+        static const size_t eventHeaderSize = 16;
+
+        //! Start writing to a file
+        /*!
+         * Any existing file at the path is truncated.
+         *
+         * @param[in] path File to write to
+         * @return True if the file could be opened
+         */
+        bool open(const char* path);
+
+        //! Are we capturing?
+        bool active() const
+        {
+            return m_file.is_open();
+        }
+
+        //! Identify a new connection
+        /*!
+         * @return Id to pass to record() and closed(). Never zero.
+         */
+        std::uint32_t connect()
+        {
+            return ++m_connections;
+        }
+
+        //! Write a complete FastCGI record
+        /*!
+         * @param[in] connection Connection the record arrived on
+         * @param[in] data Start of the record
+         * @param[in] size Size of the record including header and padding
+         */
+        void record(
+                std::uint32_t connection,
+                const char* data,
+                size_t size);
+
+        //! Note that a connection was closed
+        void closed(std::uint32_t connection)
+        {
+            record(connection, nullptr, 0);
+        }
+
+        Capture():
+            m_connections(0)
+        {}
+
+    private:
+        //! Where the capture goes
+        std::ofstream m_file;
+
+        //! When the capture was opened
+        std::chrono::steady_clock::time_point m_start;
+
+        //! Number of connections seen
+        std::uint32_t m_connections;
+    };
+
+    //! Plays a file written by Capture back into a %Manager
+    /*!
+     * Every captured connection gets a Loopback connection of it's own and
+     * the records are written to it with the same relative timing they
+     * originally arrived with. The speed can be scaled or the timing ignored
+     * completely so the %Manager is driven as hard as possible with a real
+     * world request mix. A record starting a request is held back while an
+     * earlier request on the connection with the same id hasn't ended, just
+     * as the original client would have had to.
+     *
+     * @code
+     * Fastcgipp::Replay replay;
+     * replay.load("traffic.cap");
+     *
+     * Fastcgipp::Loopback loopback;
+     * Fastcgipp::Manager<MyRequest> manager;
+     * manager.setTransport(loopback);
+     * manager.start();
+     *
+     * const Fastcgipp::Replay::Statistics stats = replay.play(loopback, 2);
+     * @endcode
+     */
+    class Replay
+    {
+    public:
+        //! What happened during playback
+        struct Statistics
+        {
+            //! Connections opened
+            unsigned connections;
+
+            //! Requests started
+            unsigned requests;
+
+            //! Requests that were completed by the %Manager
+            unsigned completed;
+
+            //! Bytes written to the %Manager
+            size_t sent;
+
+            //! Bytes received from the %Manager
+            size_t received;
+
+            //! How long it all took
+            std::chrono::steady_clock::duration elapsed;
+
+            //! Largest amount an event fell behind it's schedule
+            std::chrono::steady_clock::duration lag;
+        };
+
+        //! Read in a capture file
+        /*!
+         * @param[in] path File written by Capture
+         * @return False if the file couldn't be opened or isn't a capture.
+         *         Events up to a truncated end are kept.
+         */
+        bool load(const char* path);
+
+        //! Number of events loaded
+        size_t size() const
+        {
+            return m_events.size();
+        }
+
+        //! Play the loaded events
+        /*!
+         * Returns once every connection has been closed and all it's
+         * requests have been completed, or once the %Manager has made no
+         * progress for the given timeout.
+         *
+         * @param[in] loopback Transport the %Manager is using
+         * @param[in] speed Multiple of the original speed to play at. Zero
+         *                  plays everything as fast as possible.
+         * @param[in] timeout How long to wait for progress before giving up
+         */
+        Statistics play(
+                Loopback& loopback,
+                double speed = 1,
+                std::chrono::steady_clock::duration timeout
+                    = std::chrono::seconds(10)) const;
+
+    private:
+        //! A single captured event
+        struct Event
+        {
+            //! When it happened relative to the start of the capture
+            std::chrono::nanoseconds time;
+
+            //! Connection it happened on
+            std::uint32_t connection;
+
+            //! Where the record is in #m_data
+            size_t offset;
+
+            //! Size of the record. Zero if the connection was closed.
+            size_t size;
+        };
+
+        //! Events in the order they happened
+        std::vector<Event> m_events;
+
+        //! Records of all events back to back
+        std::vector<char> m_data;
+    };
+}
+
+#endif
@@ -0,0 +1,333 @@
+/*!
+ * @file       client.hpp
+ * @brief      Declares the Fastcgipp::Client class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_CLIENT_HPP
+#define FASTCGIPP_CLIENT_HPP
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <utility>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "fastcgi++/protocol.hpp"
+#include "fastcgi++/config.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Makes requests of other FastCGI applications
+    /*!
+     * This is the other side of the Manager. Requests are queued from any
+     * thread and carried out by a handler thread that owns a small pool of
+     * connections to a single FastCGI application. Each connection carries up
+     * to a set number of requests at once, multiplexed by their FcgiId, and new
+     * requests are pipelined onto it without waiting for earlier ones to
+     * finish.
+     *
+     * @code
+     * Fastcgipp::Client client(4, 16);
+     * client.server("127.0.0.1", "9000");
+     * client.start();
+     *
+     * auto response = client.request({{"REQUEST_URI", "/hello"}});
+     * const std::vector<char>& output = response.get().out;
+     * @endcode
+     *
+     * The records for a request are encoded in full by request() in the
+     * calling thread. Parameters are written straight into the records that
+     * end up being written to the socket so there is no intermediate copy of
+     * them.
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Client
+    {
+    public:
+        //! The complete response to a request
+        struct Response
+        {
+            //! Everything the application sent on it's output stream
+            std::vector<char> out;
+
+            //! Everything the application sent on it's error stream
+            std::vector<char> err;
+
+            //! Application status from the END_REQUEST record
+            int32_t appStatus;
+
+            //! %Protocol status from the END_REQUEST record
+            Protocol::ProtocolStatus protocolStatus;
+
+            //! False if the request never got it's END_REQUEST record
+            /*!
+             * This happens when we couldn't connect, the connection was lost
+             * or the client was terminated.
+             */
+            bool complete;
+
+            Response():
+                appStatus(0),
+                protocolStatus(Protocol::ProtocolStatus::REQUEST_COMPLETE),
+                complete(false)
+            {}
+        };
+
+        //! Called from the handler thread once a request is finished
+        typedef std::function<void(Response&&)> Callback;
+
+        //! Name-value pairs to send as the FastCGI parameters
+        typedef std::vector<std::pair<std::string, std::string>> Parameters;
+
+        //! Constructor
+        /*!
+         * @param[in] connections Maximum connections to open to the server
+         * @param[in] requests Maximum requests to have in progress at once on
+         *                     each connection. Keep this at 1 for applications
+         *                     that can't multiplex.
+         */
+        Client(unsigned connections=1, unsigned requests=16);
+
+        ~Client();
+
+        //! Make requests of the application at a TCP address
+        /*!
+         * Call this before start().
+         *
+         * @param[in] host Hostname or IP address
+         * @param[in] service Port or service name
+         */
+        void server(const char* host, const char* service);
+
+        //! Make requests of the application at a named socket
+        /*!
+         * Call this before start().
+         *
+         * @param[in] name Name of socket (path in Unix world)
+         */
+        void server(const char* name);
+
+        //! Queue up a request from any thread
+        /*!
+         * The callback is called from the handler thread so it should return
+         * quickly and mustn't call stop(), terminate() or join().
+         *
+         * @param[in] parameters FastCGI parameters to send
+         * @param[in] in Data for the input stream
+         * @param[in] size Size of the input data
+         * @param[in] callback Called with the response
+         */
+        void request(
+                const Parameters& parameters,
+                const char* in,
+                size_t size,
+                Callback callback);
+
+        //! Queue up a request from any thread and get a future to the response
+        std::future<Response> request(
+                const Parameters& parameters,
+                const char* in=nullptr,
+                size_t size=0);
+
+        //! General client handler
+        /*!
+         * Transmits queued requests and relays received responses back to
+         * their callbacks. Runs in the thread started by start().
+         */
+        void handler();
+
+        //! Call from any thread to start the handler() thread
+        /*!
+         * If the thread is already running this will do nothing.
+         */
+        void start();
+
+        //! Call from any thread to stop the handler() thread
+        /*!
+         * The handler keeps going until all queued requests are complete.
+         *
+         * @sa join()
+         */
+        void stop();
+
+        //! Call from any thread to terminate the handler() thread
+        /*!
+         * Requests that aren't complete are failed.
+         *
+         * @sa join()
+         */
+        void terminate();
+
+        //! Block until a stop() or terminate() is called and completed
+        void join();
+
+    private:
+        //! A request waiting for a connection
+        struct Job
+        {
+            //! The encoded records with their FcgiIds left as zero
+            std::vector<char> records;
+
+            //! Called with the response
+            Callback callback;
+        };
+
+        //! A request in progress on a connection
+        struct Pending
+        {
+            //! Called with the response. Empty if the FcgiId isn't in use.
+            Callback callback;
+
+            //! The response received so far
+            Response response;
+        };
+
+        //! State of a single connection to the server
+        struct Connection
+        {
+            //! Received data that doesn't yet make up a complete record
+            std::vector<char> buffer;
+
+            //! Records waiting to be written
+            std::vector<char> outgoing;
+
+            //! How much of #outgoing has been written
+            size_t sent;
+
+            //! Requests in progress indexed by their FcgiId less one
+            std::vector<Pending> requests;
+
+            //! FcgiIds available for new requests
+            /*!
+             * The least recently freed goes first to give the server as much
+             * time as possible to let go of it.
+             */
+            std::deque<Protocol::FcgiId> free;
+
+            Connection():
+                sent(0)
+            {}
+        };
+
+        //! Maximum connections to open
+        const unsigned m_maxConnections;
+
+        //! Maximum requests in progress per connection
+        const unsigned m_maxRequests;
+
+        //! Host or named socket to connect to
+        std::string m_host;
+
+        //! Service to connect to. Empty for a named socket.
+        std::string m_service;
+
+        //! Our connections to the server
+        SocketGroup m_sockets;
+
+        //! Container associating sockets with their state
+        std::map<Socket, Connection> m_connections;
+
+        //! Requests queued by request()
+        std::deque<Job> m_jobs;
+
+        //! Thread safe the job queue
+        std::mutex m_jobsMutex;
+
+        //! Wakes the handler when it has no connections to poll
+        std::condition_variable m_jobsWake;
+
+        //! Requests taken from #m_jobs waiting for a free FcgiId
+        std::deque<Job> m_backlog;
+
+        //! Requests currently in progress on all connections
+        size_t m_active;
+
+        //! Set when the last attempt to open another connection failed
+        /*!
+         * We don't try again until a connection closes so that a server at
+         * it's connection limit isn't hammered with attempts.
+         */
+        bool m_connectFailed;
+
+        //! Hand requests from the backlog out to connections
+        inline void dispatch();
+
+        //! Transmit all buffered data possible
+        /*!
+         * @return True if we successfully sent all data that was queued up.
+         */
+        inline bool transmit();
+
+        //! Receive data on the specified socket
+        inline void receive(const Socket& socket);
+
+        //! Open a new connection to the server
+        /*!
+         * @return The new connection or nullptr if we couldn't connect.
+         */
+        Connection* connect();
+
+        //! Fail all requests on a connection and close it
+        void cleanupSocket(const Socket& socket);
+
+        //! Fail all requests that haven't been completed
+        void cleanup();
+
+        //! True when handler() should be terminating
+        std::atomic_bool m_terminate;
+
+        //! True when handler() should be stopping
+        std::atomic_bool m_stop;
+
+        //! Thread our handler is running in
+        std::thread m_thread;
+
+#if FASTCGIPP_LOG_LEVEL > 3
+        //! Debug counter for requests queued
+        std::atomic_ullong m_requestCount;
+
+        //! Debug counter for requests completed
+        std::atomic_ullong m_completeCount;
+
+        //! Debug counter for requests failed
+        std::atomic_ullong m_failCount;
+
+        //! Debug counter for connections opened
+        std::atomic_ullong m_connectionCount;
+#endif
+    };
+}
+
+#endif
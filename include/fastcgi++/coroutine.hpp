@@ -0,0 +1,480 @@
+/*!
+ * @file       coroutine.hpp
+ * @brief      Declares the CoRequest class and it's Task coroutine type
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ *
+ * Unlike the rest of fastcgi++, this header requires a C++20 compiler as it is
+ * built upon the language's coroutine support. The library itself does not
+ * need to be rebuilt to use it.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_COROUTINE_HPP
+#define FASTCGIPP_COROUTINE_HPP
+
+#if __cplusplus < 202002L
+#error "fastcgi++/coroutine.hpp requires a C++20 compiler"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <optional>
+#include <deque>
+
+#include "fastcgi++/request.hpp"
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/timer.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    template<class T> class Task;
+
+    //! Stuff shared by all Task promise types
+    class TaskPromise_base
+    {
+    public:
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        //! Transfers control back to whoever was awaiting the Task
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            template<class Promise>
+            std::coroutine_handle<> await_suspend(
+                    std::coroutine_handle<Promise> handle) noexcept
+            {
+                const auto continuation = handle.promise().m_continuation;
+                if(continuation)
+                    return continuation;
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept
+            {}
+        };
+
+        FinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void unhandled_exception()
+        {
+            m_exception = std::current_exception();
+        }
+
+        //! The coroutine to resume once this one completes
+        std::coroutine_handle<> m_continuation;
+
+        //! Exception thrown out of the coroutine body
+        std::exception_ptr m_exception;
+    };
+
+    //! Promise type for Task objects returning a value
+    template<class T> class TaskPromise: public TaskPromise_base
+    {
+    public:
+        Task<T> get_return_object();
+
+        template<class U> void return_value(U&& value)
+        {
+            m_value.emplace(std::forward<U>(value));
+        }
+
+        //! Retrieve the returned value (or rethrow the exception)
+        T result()
+        {
+            if(m_exception)
+                std::rethrow_exception(m_exception);
+            return std::move(*m_value);
+        }
+
+    private:
+        std::optional<T> m_value;
+    };
+
+    //! Promise type for Task objects returning nothing
+    template<> class TaskPromise<void>: public TaskPromise_base
+    {
+    public:
+        Task<void> get_return_object();
+
+        void return_void()
+        {}
+
+        //! Rethrow any exception caught in the coroutine
+        void result()
+        {
+            if(m_exception)
+                std::rethrow_exception(m_exception);
+        }
+    };
+
+    //! A lazily started coroutine
+    /*!
+     * This is the return type for CoRequest::coResponse() and for any
+     * coroutines it may wish to co_await on. A Task doesn't begin executing
+     * until it is either co_awaited on or resumed by CoRequest. Once complete,
+     * control is transferred directly back to the coroutine that awaited it so
+     * arbitrarily deep chains of Tasks don't grow the stack.
+     *
+     * Exceptions thrown from within the coroutine are propagated to the
+     * awaiter.
+     *
+     * @tparam T Type returned by the coroutine with co_return.
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    template<class T=void> class Task
+    {
+    public:
+        typedef TaskPromise<T> promise_type;
+
+        Task():
+            m_handle(nullptr)
+        {}
+
+        Task(Task&& x):
+            m_handle(x.m_handle)
+        {
+            x.m_handle = nullptr;
+        }
+
+        Task& operator=(Task&& x)
+        {
+            if(m_handle)
+                m_handle.destroy();
+            m_handle = x.m_handle;
+            x.m_handle = nullptr;
+            return *this;
+        }
+
+        Task(const Task&) =delete;
+        Task& operator=(const Task&) =delete;
+
+        ~Task()
+        {
+            if(m_handle)
+                m_handle.destroy();
+        }
+
+        //! True if the coroutine has run to completion
+        bool done() const
+        {
+            return !m_handle || m_handle.done();
+        }
+
+        //! Resume the coroutine from wherever it last suspended
+        void resume() const
+        {
+            m_handle.resume();
+        }
+
+        //! Retrieve the result of a completed coroutine
+        T result()
+        {
+            return m_handle.promise().result();
+        }
+
+        bool await_ready() const noexcept
+        {
+            return done();
+        }
+
+        std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<> awaiter) noexcept
+        {
+            m_handle.promise().m_continuation = awaiter;
+            return m_handle;
+        }
+
+        T await_resume()
+        {
+            return result();
+        }
+
+    private:
+        friend class TaskPromise<T>;
+
+        explicit Task(std::coroutine_handle<promise_type> handle):
+            m_handle(handle)
+        {}
+
+        //! Handle to the coroutine frame we own
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    template<class T> Task<T> TaskPromise<T>::get_return_object()
+    {
+        return Task<T>(
+                std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object()
+    {
+        return Task<void>(
+                std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+
+    //! %Request handling class with a coroutine based response
+    /*!
+     * Derivations of this class define coResponse() instead of response().
+     * The coroutine is started once all client data has been received and can
+     * suspend itself as many times as it likes by co_awaiting receive().
+     * Rather than hand crafting a state machine that is re-entered with every
+     * callback Message, all state is simply held in local variables of the
+     * coroutine.
+     *
+     * A suspended coroutine blocks no threads. When a Message is sent to the
+     * request through it's callback() function the request is queued by the
+     * Manager as usual and the coroutine is resumed from within one of the
+     * Manager's handler threads. As with a regular Request, only one thread
+     * will ever be executing the coroutine at a time.
+     *
+     * Exceptions that escape coResponse() are rethrown from response() just
+     * as they would be from any other request.
+     *
+     * Should the request be cancelled while the coroutine is suspended it is
+     * never resumed. The coroutine frame, along with everything on it, is
+     * simply destroyed along with the request. Long running stretches of code
+     * can co_await checkpoint() to bail out the same way.
+     *
+     * @tparam charT Character type for internal processing (wchar_t or char)
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    template<class charT> class CoRequest: public Request<charT>
+    {
+    public:
+        //! Initializes what it can. configure() to finish.
+        /*!
+         * @param maxPostSize This would be the maximum size, in bytes, you want
+         *                    to allow for post data. See Request::Request().
+         */
+        CoRequest(const size_t maxPostSize=0):
+            Request<charT>(maxPostSize),
+            m_started(false),
+            m_waiting(nullptr)
+        {}
+
+        virtual ~CoRequest() {}
+
+    protected:
+        //! Coroutine response generator
+        /*!
+         * This coroutine is started by the library once all request data has
+         * been received from the other side. Simply co_return when the
+         * response is complete.
+         *
+         * @sa receive()
+         */
+        virtual Task<> coResponse() =0;
+
+        //! Awaitable returned by receive()
+        class Receiver
+        {
+        public:
+            bool await_ready() const noexcept
+            {
+                return m_buffered && !m_request.m_buffer.empty();
+            }
+
+            void await_suspend(std::coroutine_handle<> handle) noexcept
+            {
+                m_request.m_waiting = handle;
+            }
+
+            Message await_resume()
+            {
+                if(m_buffered && !m_request.m_buffer.empty())
+                {
+                    Message message(std::move(m_request.m_buffer.front()));
+                    m_request.m_buffer.pop_front();
+                    return message;
+                }
+                return std::move(m_request.m_message);
+            }
+
+        private:
+            friend class CoRequest;
+
+            Receiver(CoRequest& request, bool buffered):
+                m_request(request),
+                m_buffered(buffered)
+            {}
+
+            CoRequest& m_request;
+
+            //! True if messages put aside by sleep() come first
+            const bool m_buffered;
+        };
+
+        //! Suspend until the next Message is passed through callback()
+        /*!
+         * The typical pattern is to pass callback() off to something that
+         * will perform an operation asynchronously and then co_await
+         * receive() to retrieve the Message it sends back.
+         *
+         * @code
+         * lookup(key, callback());
+         * Fastcgipp::Message result = co_await receive();
+         * @endcode
+         *
+         * @return An awaitable that evaluates to the received Message
+         */
+        Receiver receive()
+        {
+            return Receiver(*this, true);
+        }
+
+        //! Awaitable returned by checkpoint()
+        class Checkpoint
+        {
+        public:
+            bool await_ready() const noexcept
+            {
+                return m_request.cancelled() == Cancellation::NONE;
+            }
+
+            void await_suspend(std::coroutine_handle<>) noexcept
+            {}
+
+            void await_resume() const noexcept
+            {}
+
+        private:
+            friend class CoRequest;
+
+            Checkpoint(const CoRequest& request):
+                m_request(request)
+            {}
+
+            const CoRequest& m_request;
+        };
+
+        //! Cancellation point
+        /*!
+         * If the request hasn't been cancelled this does nothing. If it has,
+         * the coroutine suspends and is never resumed. The library then
+         * finishes off the request according to the reason it was cancelled.
+         *
+         * @code
+         * for(const auto& row: rows)
+         * {
+         *     co_await checkpoint();
+         *     out << expensive(row);
+         * }
+         * @endcode
+         *
+         * @return An awaitable that only suspends if the request is cancelled
+         * @sa Request_base::cancelled()
+         */
+        Checkpoint checkpoint() const
+        {
+            return Checkpoint(*this);
+        }
+
+        //! Suspend for a period of time
+        /*!
+         * This has the Timer send a Message of type -1 through callback()
+         * once the delay has passed and waits for it to arrive. Any other
+         * Message sent to the request in the meantime is put aside and
+         * returned by the following calls to receive() in the order they
+         * arrived.
+         *
+         * @param[in] timer Timer service to schedule the wakeup with
+         * @param[in] delay How long to sleep for
+         */
+        Task<> sleep(Timer& timer, Timer::Clock::duration delay)
+        {
+            timer.push(this->callback(), Message(-1), delay);
+            while(true)
+            {
+                Message message = co_await Receiver(*this, false);
+                if(message.type == -1)
+                    break;
+                m_buffer.push_back(std::move(message));
+            }
+        }
+
+    private:
+        //! Drive the coroutine
+        /*!
+         * The first call starts coResponse(). Every subsequent call resumes
+         * whatever coroutine in the chain is waiting on receive().
+         */
+        bool response() override final
+        {
+            if(m_waiting)
+            {
+                const auto waiting = m_waiting;
+                m_waiting = nullptr;
+                waiting.resume();
+            }
+            else if(!m_started)
+            {
+                m_started = true;
+                m_task = coResponse();
+                m_task.resume();
+            }
+            else
+            {
+                WARNING_LOG("CoRequest got a message while it wasn't "\
+                        "waiting on one")
+                return false;
+            }
+
+            if(!m_task.done())
+                return false;
+
+            m_task.result();
+            return true;
+        }
+
+        //! True once coResponse() has been called
+        bool m_started;
+
+        //! The coroutine returned from coResponse()
+        Task<> m_task;
+
+        //! The coroutine currently suspended in receive()
+        std::coroutine_handle<> m_waiting;
+
+        //! Messages that arrived during sleep() not yet received
+        std::deque<Message> m_buffer;
+    };
+}
+
+#endif
@@ -33,6 +33,7 @@
 #include "fastcgi++/webstreambuf.hpp"
 
 #include <istream>
+#include <functional>
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -0,0 +1,121 @@
+/*!
+ * @file       handoff.hpp
+ * @brief      Declares the Handoff class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_HANDOFF_HPP
+#define FASTCGIPP_HANDOFF_HPP
+
+#include <string>
+#include <thread>
+
+#include "fastcgi++/manager.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Hands listening sockets over to a replacement process
+    /*!
+     * This allows a new binary to be deployed without ever refusing a
+     * connection. The running process offers it's listeners on a control
+     * socket. The new process takes them over with take(), passed along with
+     * SCM_RIGHTS, and starts accepting on them right away. Once it has them
+     * the old process stops gracefully, finishing the requests it already
+     * has while the new one handles everything else.
+     *
+     * @code
+     * Fastcgipp::Manager<HelloWorld> manager;
+     * if(!Fastcgipp::Handoff::take(manager, "/run/hello.handoff"))
+     *     manager.listen("127.0.0.1", "9000");
+     * manager.start();
+     *
+     * Fastcgipp::Handoff handoff(manager);
+     * handoff.offer("/run/hello.handoff");
+     * manager.join();
+     * @endcode
+     *
+     * Only listeners are handed over. Connections the old process already
+     * has are drained by it as they would be with Manager_base::stop().
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Handoff
+    {
+    public:
+        //! Sole constructor
+        /*!
+         * @param[in] manager The %Manager whose listeners we offer
+         */
+        Handoff(Manager_base& manager);
+
+        ~Handoff();
+
+        //! Offer our listeners on a control socket
+        /*!
+         * This starts a thread that waits for a replacement process to
+         * connect to the control socket. Once the listeners are handed over
+         * the %Manager is stopped.
+         *
+         * @param[in] path Path of the control socket
+         * @return True on success. False on failure.
+         */
+        bool offer(const char* path);
+
+        //! Take over the listeners of a running process
+        /*!
+         * Call this before Manager_base::start(). If there is no process
+         * offering listeners on the control socket, false is returned and
+         * you'll need to listen normally.
+         *
+         * @param[in] manager The %Manager to give the listeners to
+         * @param[in] path Path of the control socket
+         * @return True if we got at least one listener
+         */
+        static bool take(Manager_base& manager, const char* path);
+
+        //! Most listeners that can be handed over
+        static const unsigned maxListeners = 64;
+
+    private:
+        //! Serves the control socket
+        void handler();
+
+        //! The %Manager whose listeners we offer
+        Manager_base& m_manager;
+
+        //! The control socket. -1 if we aren't offering.
+        int m_control;
+
+        //! Path of the control socket
+        std::string m_path;
+
+        //! Thread our handler is running in
+        std::thread m_thread;
+    };
+}
+
+#endif
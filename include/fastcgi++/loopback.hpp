@@ -0,0 +1,320 @@
+/*!
+ * @file       loopback.hpp
+ * @brief      Declares the Loopback transport
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_LOOPBACK_HPP
+#define FASTCGIPP_LOOPBACK_HPP
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "fastcgi++/sockets.hpp"
+#include "fastcgi++/config.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! In process transport that never touches the kernel
+    /*!
+     * Each connection is a pair of lock-free single producer single consumer
+     * ring buffers. Hand it to Manager_base::setTransport() and drive the
+     * %Manager from a Client in the same process. With no sockets or system
+     * calls on the data path, what gets measured is the cost of the
+     * Transceiver, %Manager, Request and stream layers alone.
+     *
+     * @code
+     * Fastcgipp::Loopback loopback;
+     * Fastcgipp::Manager<HelloWorld> manager;
+     * manager.setTransport(loopback);
+     * manager.start();
+     *
+     * Fastcgipp::Loopback::Client client = loopback.connect();
+     * client.write(records.data(), records.size());
+     * @endcode
+     *
+     * The Transceiver thread only sleeps on a condition variable when every
+     * connection is idle. Data arriving while it's busy costs nothing but the
+     * ring buffer writes. Connection timeouts aren't supported.
+     *
+     * The transport must outlive it's clients.
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Loopback: public Transport
+    {
+    private:
+        //! Lock-free single producer single consumer byte queue
+        class Ring
+        {
+        public:
+            //! @param[in] capacity Size in bytes. Rounded up to a power of 2.
+            Ring(size_t capacity);
+
+            //! Queue as much data as fits. Call from the producer only.
+            /*!
+             * @return Number of bytes queued
+             */
+            size_t write(const char* data, size_t size);
+
+            //! Dequeue as much data as is available. Call from the consumer
+            //! only.
+            /*!
+             * @return Number of bytes dequeued
+             */
+            size_t read(char* data, size_t size);
+
+            //! True if there is nothing to read. Call from the consumer only.
+            bool empty() const
+            {
+                return m_head.load(std::memory_order_acquire)
+                    == m_tail.load(std::memory_order_relaxed);
+            }
+
+        private:
+            //! Storage for the data
+            const std::unique_ptr<char[]> m_buffer;
+
+            //! One less than the capacity
+            const size_t m_mask;
+
+            //! Total bytes ever written. Only the producer changes this.
+            std::atomic_size_t m_head;
+
+            //! Keep the producer's and consumer's counters on separate cache
+            //! lines
+            char m_padding[64];
+
+            //! Total bytes ever read. Only the consumer changes this.
+            std::atomic_size_t m_tail;
+        };
+
+        //! The state shared by both ends of a connection
+        struct Pipe
+        {
+            Pipe(size_t capacity):
+                in(capacity),
+                out(capacity),
+                clientClosed(false),
+                serverClosed(false)
+            {}
+
+            //! Data from the client to us
+            Ring in;
+
+            //! Data from us to the client
+            Ring out;
+
+            //! Set once the client has closed it's end
+            std::atomic_bool clientClosed;
+
+            //! Set once we have closed our end
+            std::atomic_bool serverClosed;
+        };
+
+    public:
+        //! The client end of a loopback connection
+        /*!
+         * A client should only be used from one thread at a time. Nothing
+         * blocks. The other end closes the connection if this object is
+         * destroyed.
+         */
+        class Client
+        {
+        public:
+            //! Queue data to send to the server
+            /*!
+             * @return Number of bytes queued. This is less than the size if
+             *         the ring buffer is full and zero if the connection is
+             *         closed.
+             */
+            size_t write(const char* data, size_t size);
+
+            //! Retrieve data the server has sent
+            /*!
+             * @return Number of bytes retrieved
+             */
+            size_t read(char* data, size_t size);
+
+            //! Close our end of the connection
+            void close();
+
+            //! True once the server has closed the connection and everything
+            //! it sent has been read
+            bool closed() const
+            {
+                return !m_pipe
+                    || (m_pipe->serverClosed && m_pipe->out.empty());
+            }
+
+            Client(Client&& x) =default;
+            Client& operator=(Client&& x);
+            Client(const Client&) =delete;
+            Client& operator=(const Client&) =delete;
+
+            ~Client()
+            {
+                close();
+            }
+
+        private:
+            friend class Loopback;
+
+            Client(Loopback& loopback, std::shared_ptr<Pipe>&& pipe):
+                m_loopback(&loopback),
+                m_pipe(std::move(pipe))
+            {}
+
+            //! Transport the connection belongs to
+            Loopback* m_loopback;
+
+            //! State shared with the server end
+            std::shared_ptr<Pipe> m_pipe;
+        };
+
+        //! Sole constructor
+        /*!
+         * @param[in] capacity Size of each direction's ring buffer in bytes
+         */
+        Loopback(size_t capacity = 65536);
+
+        ~Loopback();
+
+        //! Open a new connection
+        /*!
+         * Thread safe. If we aren't accepting connections the client comes
+         * back already closed.
+         */
+        Client connect();
+
+        Socket poll(bool block) override;
+
+        void wake() override;
+
+        //! Timeouts aren't supported so this does nothing
+        void setTimeout(const Socket&, Clock::duration) override
+        {}
+
+        //! Timeouts aren't supported so nothing ever expires
+        Socket expired() override
+        {
+            return Socket();
+        }
+
+        size_t size() const override
+        {
+            return m_count;
+        }
+
+        void accept(bool status) override;
+
+    private:
+        ssize_t readSocket(const Socket& socket, char* buffer, size_t size)
+            override;
+        ssize_t writeSocket(
+                const Socket& socket,
+                const char* buffer,
+                size_t size) override;
+        void closeSocket(const Socket& socket) override;
+
+        //! Wake up poll() if it is asleep
+        /*!
+         * This is the only cost a client pays on top of the ring buffers
+         * while the Transceiver is busy.
+         */
+        void notify();
+
+        //! Find the next connection with something for us
+        Socket ready();
+
+        //! Size of each direction's ring buffer in bytes
+        const size_t m_capacity;
+
+        //! A connection's server end
+        struct Connection
+        {
+            Connection():
+                generation(0)
+            {}
+
+            //! The original socket. Invalid if the slot is free.
+            Socket socket;
+
+            //! State shared with the client. Empty if the slot is free.
+            std::shared_ptr<Pipe> pipe;
+
+            //! Incremented every time a connection takes the slot
+            uint32_t generation;
+        };
+
+        //! All our connections indexed by socket identifier
+        std::vector<Connection> m_connections;
+
+        //! Free slots in #m_connections
+        std::vector<socket_t> m_free;
+
+        //! Where ready() starts looking so no connection is starved
+        size_t m_next;
+
+        //! How many connections are open
+        std::atomic_size_t m_count;
+
+        //! Set to true if we should be accepting new connections
+        std::atomic_bool m_accept;
+
+        //! Thread safe #m_pending and sleeping in poll()
+        std::mutex m_mutex;
+
+        //! Signalled when poll() should wake up
+        std::condition_variable m_wake;
+
+        //! Connections made that poll() hasn't picked up yet
+        std::vector<std::shared_ptr<Pipe>> m_pending;
+
+        //! True while #m_pending isn't empty
+        std::atomic_bool m_connecting;
+
+        //! True while poll() is asleep or about to be
+        std::atomic_bool m_sleeping;
+
+        //! Set by wake()
+        std::atomic_bool m_woken;
+
+#if FASTCGIPP_LOG_LEVEL > 3
+        //! Debug counter for connections made
+        std::atomic_ullong m_connectionCount;
+
+        //! Debug counter for times poll() went to sleep
+        std::atomic_ullong m_sleepCount;
+#endif
+    };
+}
+
+#endif
@@ -30,6 +30,7 @@
 #define FASTCGIPP_MANAGER_HPP
 
 #include <map>
+#include <set>
 #include <list>
 #include <algorithm>
 #include <thread>
@@ -37,14 +38,149 @@
 #include <shared_mutex>
 #include <memory>
 #include <functional>
+#include <condition_variable>
 
 #include "fastcgi++/protocol.hpp"
 #include "fastcgi++/transceiver.hpp"
 #include "fastcgi++/request.hpp"
+#include "fastcgi++/timer.hpp"
+#include "fastcgi++/cache.hpp"
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
 {
+    class Manager_base;
+
+    //! Lightweight record of a request that hasn't been constructed yet
+    /*!
+     * When a request begins the Manager doesn't construct it right away.
+     * Instead it holds onto the BEGIN_REQUEST and PARAMS records in one of
+     * these until all parameters have arrived. It then calls
+     * Manager_base::dispatch() which may construct the real request, or
+     * reject the request or reply to it outright. Either way requests that
+     * never make it past their parameters cost next to nothing.
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class PendingRequest: public Request_base
+    {
+    public:
+        PendingRequest(
+                Manager_base& manager,
+                const Protocol::RequestId& id,
+                const Protocol::Role& role,
+                bool kill):
+            m_manager(manager),
+            m_id(id),
+            m_role(role),
+            m_kill(kill),
+            m_parametersComplete(false),
+            m_finished(false),
+            m_waiting(false)
+        {}
+
+        //! Buffers records until the request can be dispatched
+        /*!
+         * Once all the parameters have arrived, or something else comes
+         * along first, Manager_base::dispatch() is called. Should it return a
+         * request all the buffered records are handed to it and it replaces
+         * this one.
+         *
+         * @return A lock locking the requests message queue. This is unlocked
+         *         if the request was finished without being constructed.
+         */
+        std::unique_lock<std::mutex> handler();
+
+        //! Complete ID of the request
+        const Protocol::RequestId& id() const
+        {
+            return m_id;
+        }
+
+        //! The role that the other side expects this request to play
+        Protocol::Role role() const
+        {
+            return m_role;
+        }
+
+        //! Should the socket be closed upon completion?
+        bool kill() const
+        {
+            return m_kill;
+        }
+
+        //! Have all the parameters arrived?
+        /*!
+         * This is only false if something other than parameters came along
+         * first or the request was cancelled.
+         */
+        bool parametersComplete() const
+        {
+            return m_parametersComplete;
+        }
+
+        //! Retrieve a parameter
+        /*!
+         * The parameters aren't parsed into an Http::Environment so this
+         * simply scans the raw records each call.
+         *
+         * @param[in] name Name of the parameter (e.g. "SCRIPT_NAME")
+         * @return The raw value of the parameter or an empty string if it
+         *         isn't present.
+         */
+        std::string parameter(const char* name) const;
+
+        //! Finish the request without constructing it
+        /*!
+         * @param[in] status Protocol status to end the request with
+         */
+        void reject(
+                Protocol::ProtocolStatus status
+                    = Protocol::ProtocolStatus::OVERLOADED);
+
+        //! Reply to the request without constructing it
+        /*!
+         * @param[in] data Complete response including headers
+         * @param[in] size Size of the response in bytes
+         */
+        void reply(const char* data, size_t size);
+
+        //! Function for passing messages to the pending request
+        std::function<void(Message)> callback() const;
+
+    private:
+        //! Send cached records
+        void reply(const std::vector<char>& records);
+
+        //! Send a record ending the request
+        void end(Protocol::ProtocolStatus status, std::vector<char>&& record);
+
+        //! The Manager we dispatch through
+        Manager_base& m_manager;
+
+        //! Complete ID of the request
+        const Protocol::RequestId m_id;
+
+        //! The role that the other side expects this request to play
+        const Protocol::Role m_role;
+
+        //! Close the socket once the request is complete
+        const bool m_kill;
+
+        //! Everything received so far
+        std::vector<Message> m_buffer;
+
+        //! True once the empty PARAMS record has arrived
+        bool m_parametersComplete;
+
+        //! True once reject() or reply() has been called
+        bool m_finished;
+
+        //! True while waiting on the ResponseCache
+        bool m_waiting;
+    };
+
     //! General task and protocol management class base
     /*!
      * Handles all task and protocol management, creation/destruction of
@@ -105,10 +241,223 @@ namespace Fastcgipp
         //! Block until a stop() or terminate() is called and completed
         void join();
 
+        //! Set the default deadline for requests
+        /*!
+         * Every request created after this is called will be cancelled with
+         * Cancellation::DEADLINE if it hasn't completed within this amount of
+         * time. Requests can override this with Request::setDeadline().
+         *
+         * @param[in] timeout Maximum lifetime of a request. Zero, the default,
+         *                    means requests have no deadline.
+         */
+        void setDeadline(Timer::Clock::duration timeout)
+        {
+            m_deadline = timeout;
+        }
+
+        //! Set the time slice for request handling
+        /*!
+         * By default a request that has a lot of messages queued up, say a
+         * large upload, keeps a handler thread until it has handled them all.
+         * Setting a time slice makes the request yield the thread once it has
+         * used up it's slice. It then goes to the back of the task queue so
+         * other requests get a turn. Requests can ask for a multiple of the
+         * slice with Request::setWeight().
+         *
+         * This applies to requests created after it is called.
+         *
+         * @param[in] messages Maximum number of messages to handle in a slice.
+         *                     Zero means no limit.
+         * @param[in] time Maximum amount of time to spend in a slice. Zero
+         *                 means no limit. This is only checked between
+         *                 messages so a single long response() will still run
+         *                 to completion.
+         */
+        void setSlice(unsigned messages, std::chrono::microseconds time)
+        {
+            m_sliceMessages = messages;
+            m_sliceTime = time;
+        }
+
+        //! Serve responses from a cache
+        /*!
+         * The cache is consulted before dispatch() so cache hits never
+         * construct a request. Call this before start().
+         *
+         * @param[in] cache The cache to use. It must outlive the Manager.
+         */
+        void setCache(ResponseCache& cache)
+        {
+            m_cache = &cache;
+        }
+
+        //! Configure a scheduling class
+        /*!
+         * Requests are placed into scheduling classes by
+         * Request::classify() and each class gets it's own task queue. Handler
+         * threads take tasks from the classes in weighted round robin order so
+         * that, for example, health checks and interactive pages don't sit
+         * behind a pile of slow exports. A class can also be capped in how
+         * many of it's tasks can be handled at once.
+         *
+         * By default there is only class 0 with a weight of 1 and no cap.
+         * Requests are in class 0 until they've been classified. Requests
+         * classified into a class that hasn't been configured go into class 0.
+         * Call this before start().
+         *
+         * @param[in] id Index of the class to configure
+         * @param[in] weight How many tasks are taken from this class in a row
+         *                   before moving on to the next one
+         * @param[in] cap Maximum number of this class's tasks that can be
+         *                handled at the same time. Zero means no limit.
+         */
+        void setClass(unsigned id, unsigned weight, unsigned cap=0);
+
+        //! Protect ourselves from connection storms
+        /*!
+         * While over either limit we stop accepting connections and they
+         * wait in the listen queue. Call this before start().
+         *
+         * @param[in] rate Most connections to accept per second. Zero, the
+         *                 default, means no limit.
+         * @param[in] connections Most connections to have open at once. Zero,
+         *                        the default, means no limit.
+         * @param[in] batch Most connections to accept each time a listener
+         *                  is ready
+         */
+        void setAcceptLimits(
+                unsigned rate,
+                size_t connections,
+                unsigned batch=64)
+        {
+            m_transceiver.setAcceptLimits(batch, rate, connections);
+        }
+
+        //! Carry connections over something other than OS level sockets
+        /*!
+         * This is mainly for driving the %Manager with a Loopback so that
+         * benchmarks and tests measure the library and not the kernel. Call
+         * this before start(). The transport must outlive the %Manager.
+         *
+         * @param[in] transport Transport to use in place of listening sockets
+         */
+        void setTransport(Transport& transport)
+        {
+            m_transceiver.setTransport(transport);
+        }
+
+        //! Record all incoming traffic for later replay
+        /*!
+         * Every record received is written to the file with it's arrival time
+         * and connection. Play it back against a %Manager with Replay to
+         * repeat a real world load exactly. Call this before start().
+         *
+         * @param[in] path File to write the capture to
+         * @return True if the file could be opened
+         */
+        bool capture(const char* path)
+        {
+            return m_transceiver.capture(path);
+        }
+
+        //! Pin our threads to CPUs
+        /*!
+         * To partition a machine by NUMA node run one %Manager per node and
+         * pin all of it's threads to the node's CPUs as given by nodeCpus().
+         * Call this before start().
+         *
+         * @param[in] handlers CPUs for the request handling threads. Empty
+         *                     means no particular CPU.
+         * @param[in] transceiver CPUs for the transceiver thread. Empty means
+         *                        no particular CPU.
+         * @param[in] incomingCpu If true, set SO_INCOMING_CPU on our listeners
+         *                        to the first transceiver CPU so that
+         *                        connections handled on it are steered to us.
+         *                        Only useful with listeners shared between
+         *                        managers.
+         */
+        void setAffinity(
+                const CpuSet& handlers,
+                const CpuSet& transceiver,
+                bool incomingCpu=false)
+        {
+            m_handlerCpus = handlers;
+            m_transceiver.setAffinity(transceiver, incomingCpu);
+        }
+
+        //! Let the number of handler threads follow the load
+        /*!
+         * By default the Manager runs the fixed number of handler threads it
+         * was constructed with. In an elastic pool it starts with the
+         * minimum and adds a thread whenever none are idle and a task that
+         * could be handled has been waiting longer than the target. This
+         * covers both CPU saturation and threads blocked on backend I/O.
+         * Threads beyond the minimum exit once they've been idle for the idle
+         * timeout. Call this before start().
+         *
+         * @param[in] minThreads Threads to always keep. At least one.
+         * @param[in] maxThreads Most threads to ever run
+         * @param[in] target How long a task can wait in the queue before
+         *                   another thread is added. The pool is checked
+         *                   this often.
+         * @param[in] idle How long a thread can sit idle before it exits
+         *
+         * @sa poolStats()
+         */
+        void setElastic(
+                unsigned minThreads,
+                unsigned maxThreads,
+                Timer::Clock::duration target,
+                Timer::Clock::duration idle);
+
+        //! State of the handler thread pool
+        struct PoolStats
+        {
+            //! Handler threads currently running
+            unsigned threads;
+
+            //! Handler threads currently waiting for tasks
+            unsigned idle;
+
+            //! Threads added by the elastic pool
+            unsigned long long grown;
+
+            //! Threads removed by the elastic pool
+            unsigned long long shrunk;
+        };
+
+        //! Current state of the handler thread pool
+        PoolStats poolStats();
+
+        //! Set the connection timeouts
+        /*!
+         * A connection that exceeds any of these is closed and any requests
+         * associated with it are killed. A zero value disables that particular
+         * timeout, which is the default for all of them. Call this before
+         * start().
+         *
+         * @param[in] idle How long a connection can sit open with no requests
+         *                 in progress and no records partially received.
+         * @param[in] header How long the web server has to finish sending a
+         *                   record header once it has started.
+         * @param[in] body How long the web server has to finish sending a
+         *                 record's content once the header is received.
+         */
+        void setTimeouts(
+                SocketGroup::Clock::duration idle,
+                SocketGroup::Clock::duration header,
+                SocketGroup::Clock::duration body)
+        {
+            m_transceiver.setTimeouts(idle, header, body);
+        }
+
         //! Configure the handlers for POSIX signals
         /*!
          * By calling this function appropriate handlers will be set up for
-         * SIGPIPE, SIGUSR1 and SIGTERM.
+         * SIGPIPE, SIGUSR1 and SIGTERM. A SIGUSR1 stops and a SIGTERM
+         * terminates every %Manager in the process, so any number of them
+         * can coexist. The signals are passed on from a dedicated thread
+         * rather than from within the signal handler itself.
          *
          * @sa signalHandler()
          */
@@ -119,11 +468,12 @@ namespace Fastcgipp
          * Calling this simply adds the default socket used on FastCGI
          * applications that are initialized from HTTP servers.
          *
+         * @param [in] options Tuning options for the socket
          * @return True on success. False on failure.
          */
-        bool listen()
+        bool listen(const ListenOptions& options = ListenOptions())
         {
-            return m_transceiver.listen();
+            return m_transceiver.listen(options);
         }
 
         //! Listen to a named socket
@@ -139,15 +489,17 @@ namespace Fastcgipp
          *                   do not wish to set it.
          * @param [in] group Group (group name) of socket. Leave as nullptr if
          *                   you do not wish to set it.
+         * @param [in] options Tuning options for the socket
          * @return True on success. False on failure.
          */
         bool listen(
                 const char* name,
                 uint32_t permissions = 0xffffffffUL,
                 const char* owner = nullptr,
-                const char* group = nullptr)
+                const char* group = nullptr,
+                const ListenOptions& options = ListenOptions())
         {
-            return m_transceiver.listen(name, permissions, owner, group);
+            return m_transceiver.listen(name, permissions, owner, group, options);
         }
 
         //! Listen to a TCP port
@@ -160,13 +512,47 @@ namespace Fastcgipp
          * @param [in] service Port or service to listen on. This could be a
          *                     service name, or a string representation of a
          *                     port number.
+         * @param [in] options Tuning options for the socket
          * @return True on success. False on failure.
          */
         bool listen(
                 const char* interface,
-                const char* service)
+                const char* service,
+                const ListenOptions& options = ListenOptions())
         {
-            return m_transceiver.listen(interface, service);
+            return m_transceiver.listen(interface, service, options);
+        }
+
+        //! Listen on a socket that is already listening
+        /*!
+         * This is for sockets inherited from a parent process, such as those
+         * set up by Prefork. The socket is made non-blocking and, since other
+         * processes may be using it, is closed but never shut down.
+         *
+         * @param [in] listener The listening socket
+         * @return True on success. False on failure.
+         */
+        bool adopt(socket_t listener)
+        {
+            return m_transceiver.adopt(listener);
+        }
+
+        //! Listen on sockets passed to us by systemd socket activation
+        /*!
+         * Since systemd holds on to the sockets, connections queue up in them
+         * while we aren't running. This allows the service to be started
+         * lazily on the first connection and restarted without losing any.
+         *
+         * @param [in] name Only listen on sockets given this name with
+         *                  FileDescriptorName=. Pass nullptr to listen on them
+         *                  all.
+         * @return True if we are listening on at least one socket
+         *
+         * @sa SocketGroup::listenActivated()
+         */
+        bool listenActivated(const char* name = nullptr)
+        {
+            return m_transceiver.listenActivated(name);
         }
 
     protected:
@@ -176,6 +562,31 @@ namespace Fastcgipp
                 const Protocol::Role& role,
                 bool kill) =0;
 
+        //! Pre-dispatch hook
+        /*!
+         * This is called once a request's parameters have arrived to decide
+         * what to do with it. Override it to route requests to different
+         * types, to shed load or to reply from a cache before any of the
+         * expense of constructing a full request is incurred. The default
+         * simply calls makeRequest().
+         *
+         * To finish the request without constructing anything call either
+         * PendingRequest::reject() or PendingRequest::reply() and return
+         * nullptr. Returning nullptr without doing either rejects the request
+         * as overloaded.
+         *
+         * This is called from within the handler threads so it should be
+         * thread safe.
+         *
+         * @param[in] pending The request's BEGIN_REQUEST and PARAMS records
+         * @return The configured request or nullptr if the request is
+         *         finished
+         */
+        virtual std::unique_ptr<Request_base> dispatch(PendingRequest& pending)
+        {
+            return makeRequest(pending.id(), pending.role(), pending.kill());
+        }
+
         //! Handles low level communication with the other side
         Transceiver m_transceiver;
 
@@ -183,18 +594,147 @@ namespace Fastcgipp
         void push(Protocol::RequestId id, Message&& message);
 
     private:
-        //! Queue for pending tasks
-        std::queue<Protocol::RequestId> m_tasks;
+        //! Enforces request deadlines
+        /*!
+         * This must outlive m_requests as they cancel their timeouts when
+         * destroyed.
+         */
+        Timer m_timer;
+
+        //! A scheduling class and it's queue of pending tasks
+        struct TaskClass
+        {
+            //! Queue for pending tasks and when they were queued
+            /*!
+             * The time is only filled in with an elastic pool.
+             */
+            std::queue<std::pair<Protocol::RequestId, Timer::Clock::time_point>>
+                tasks;
+
+            //! How many tasks are taken from the class in a row
+            unsigned weight;
+
+            //! Maximum tasks handled at once. Zero is unlimited.
+            unsigned cap;
+
+            //! How many tasks are currently being handled
+            unsigned active;
+
+            TaskClass():
+                weight(1),
+                cap(0),
+                active(0)
+            {}
+        };
+
+        //! Our scheduling classes
+        std::vector<TaskClass> m_classes;
+
+        //! Which class we're currently taking tasks from
+        unsigned m_currentClass;
+
+        //! How many more tasks we can take from the current class
+        unsigned m_credit;
 
         //! Thread safe our tasks
         std::mutex m_tasksMutex;
 
+        //! Queue up a task
+        /*!
+         * Make sure m_tasksMutex is locked before calling this.
+         */
+        inline void queueTask(const Protocol::RequestId& id, unsigned taskClass);
+
+        //! Take the next task to handle
+        /*!
+         * Make sure m_tasksMutex is locked before calling this. If a task is
+         * returned it's class's active count is incremented.
+         *
+         * @param[out] id Task to handle
+         * @param[out] taskClass The class the task came from
+         * @return False if there are no tasks that can be handled right now
+         */
+        inline bool nextTask(Protocol::RequestId& id, unsigned& taskClass);
+
         //! An associative container for our requests
+        /*!
+         * This doubles as the per connection request table. Requests are
+         * ordered by socket first so those of a connection form one range
+         * that equal_range() finds from the Socket alone. A separate table
+         * per connection would need its own locking as connections come and
+         * go without taking any load off #m_requestsMutex, which push() only
+         * holds shared unless it's creating a request.
+         */
         Protocol::Requests<std::unique_ptr<Request_base>> m_requests;
 
         //! Thread safe our requests
         std::shared_timed_mutex m_requestsMutex;
 
+        //! Records for requests whose FcgiId is still held by an ended request
+        /*!
+         * Once a request sends it's END_REQUEST record the other side is free
+         * to reuse it's FcgiId. These wait here until the ended request is
+         * erased. Guarded by #m_requestsMutex.
+         */
+        Protocol::Requests<std::vector<Message>> m_successors;
+
+        //! Create a new request from it's BEGIN_REQUEST record
+        /*!
+         * Make sure m_requestsMutex is locked for writing before calling this.
+         */
+        Protocol::Requests<std::unique_ptr<Request_base>>::iterator create(
+                const Protocol::RequestId& id,
+                const Message& message);
+
+        //! Create the request waiting for an erased one's FcgiId
+        /*!
+         * Make sure m_requestsMutex is locked for writing before calling this.
+         *
+         * @return True if the new request has records that need handling
+         */
+        bool succeed(const Protocol::RequestId& id);
+
+        //! Default deadline for new requests
+        Timer::Clock::duration m_deadline;
+
+        //! Maximum messages handled per time slice
+        unsigned m_sliceMessages;
+
+        //! Maximum time per time slice
+        std::chrono::microseconds m_sliceTime;
+
+        //! Response cache consulted before dispatch()
+        ResponseCache* m_cache;
+
+        //! CPUs our handler threads run on
+        CpuSet m_handlerCpus;
+
+        //! Hook a new request up to the Manager's facilities
+        inline void attach(Request_base& request, const Protocol::RequestId& id);
+
+        //! Swap a request in for the one that asked to be replaced
+        /*!
+         * This hands over the old request's queued messages, deadline and
+         * cancellation state. Make sure the requests are write locked and the
+         * old request's mutex is held.
+         *
+         * @param[in] request The replacement
+         * @param[in] old The request being replaced
+         * @param[in] id ID of both requests
+         */
+        inline void replace(
+                Request_base& request,
+                Request_base& old,
+                const Protocol::RequestId& id);
+
+        //! Cancel a request whose deadline has passed
+        /*!
+         * This is the callback for the deadline timeouts. Since request IDs
+         * get recycled, the request is checked to make sure it's deadline
+         * really has passed.
+         */
+        void expire(Protocol::RequestId id, Message message);
+
         //! Local messages
         std::queue<std::pair<Message, Socket>> m_messages;
 
@@ -221,16 +761,83 @@ namespace Fastcgipp
         std::mutex m_startStopMutex;
 
         //! Threads our manager is running in
+        /*!
+         * Threads removed from an elastic pool move themselves from here to
+         * #m_retiredThreads.
+         */
         std::vector<std::thread> m_threads;
 
+        //! Threads removed from an elastic pool that are yet to be joined
+        /*!
+         * These still touch our members on their way out so they can't be
+         * detached. They are joined by spawn() and join().
+         */
+        std::vector<std::thread> m_retiredThreads;
+
+        //! Start another handler thread
+        /*!
+         * Make sure m_tasksMutex is locked before calling this.
+         */
+        void spawn();
+
+        //! Grow the elastic pool if tasks are waiting too long
+        /*!
+         * This is called by m_timer every #m_queueTarget while the Manager is
+         * running.
+         */
+        void checkPool();
+
+        //! Handler threads to always run
+        unsigned m_minThreads;
+
+        //! Most handler threads to run
+        unsigned m_maxThreads;
+
+        //! Handler threads currently running
+        unsigned m_runningThreads;
+
+        //! Handler threads currently waiting for tasks
+        unsigned m_idleThreads;
+
+        //! Longest a task should wait before the pool grows
+        Timer::Clock::duration m_queueTarget;
+
+        //! How long a surplus thread waits for a task before exiting
+        Timer::Clock::duration m_idleTimeout;
+
+        //! True while checkPool() is scheduled
+        bool m_checkingPool;
+
+        //! Threads added by the elastic pool
+        unsigned long long m_growCount;
+
+        //! Threads removed by the elastic pool
+        unsigned long long m_shrinkCount;
+
         //! Condition variable to wake handler() threads up
         std::condition_variable m_wake;
 
         //! General function to handler POSIX signals
+        /*!
+         * This just writes the signal number into #signalPipe.
+         */
         static void signalHandler(int signum);
 
-        //! Pointer to the %Manager object
-        static Manager_base* instance;
+        //! Passes signals from #signalPipe on to every %Manager
+        /*!
+         * Runs in it's own thread started by the first call to
+         * setupSignals().
+         */
+        static void signalDispatcher();
+
+        //! Thread safe #instances
+        static std::mutex instancesMutex;
+
+        //! Every %Manager object in the process
+        static std::set<Manager_base*> instances;
+
+        //! Pipe from signalHandler() to signalDispatcher()
+        static int signalPipe[2];
 
 #if FASTCGIPP_LOG_LEVEL > 3
         //! Debug counter for new requests
@@ -251,12 +858,33 @@ namespace Fastcgipp
         //! Debug counter for request messages received
         std::atomic_ullong m_messageCount;
 
+        //! Debug counter for requests aborted by the web server
+        std::atomic_ullong m_abortCount;
+
+        //! Debug counter for records held back for a reused FcgiId
+        std::atomic_ullong m_successorCount;
+
+        //! Debug counter for requests that exceeded their deadline
+        std::atomic_ullong m_deadlineCount;
+
+        //! Debug counter for tasks requeued by yielding or classification
+        std::atomic_ullong m_requeueCount;
+
+        //! Debug counter for requests replaced by another
+        std::atomic_ullong m_replacementCount;
+
+        //! Debug counter for requests finished without being constructed
+        std::atomic_ullong m_unconstructedCount;
+
         //! Debug counter currently active handler() threads
         unsigned m_activeThreads;
 
         //! Debug counter max active handler() threads
         unsigned m_maxActiveThreads;
 #endif
+
+        friend class PendingRequest;
+        friend class Handoff;
     };
 
     //! General task and protocol management class
@@ -305,7 +933,7 @@ namespace Fastcgipp
                     role,
                     kill,
                     std::bind(&Transceiver::send, &m_transceiver, _1, _2, _3),
-                    std::bind(&Manager_base::push, this, id, _1));
+                    std::bind(&Manager<RequestT>::push, this, id, _1));
             return request;
         }
 
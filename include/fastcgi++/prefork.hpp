@@ -0,0 +1,213 @@
+/*!
+ * @file       prefork.hpp
+ * @brief      Declares the Prefork class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_PREFORK_HPP
+#define FASTCGIPP_PREFORK_HPP
+
+#include <functional>
+#include <chrono>
+#include <vector>
+#include <thread>
+
+#include <sys/types.h>
+#include <signal.h>
+
+#include "fastcgi++/manager.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Supervisor of multiple worker processes sharing listeners
+    /*!
+     * The supervisor sets up the listening sockets and then forks off a
+     * number of worker processes. Each worker runs it's own Manager on the
+     * inherited sockets. Workers that die are restarted.
+     *
+     * @code
+     * Fastcgipp::Prefork prefork(4);
+     * prefork.listen("127.0.0.1", "9000");
+     * return prefork.run([&prefork] ()
+     * {
+     *     Fastcgipp::Manager<HelloWorld> manager;
+     *     prefork.adopt(manager);
+     *     manager.setupSignals();
+     *     manager.start();
+     *     manager.join();
+     *     return 0;
+     * });
+     * @endcode
+     *
+     * The supervisor responds to the following signals.
+     *  - SIGTERM or SIGINT: Terminate the workers with SIGTERM.
+     *  - SIGUSR1: Gracefully stop the workers with SIGUSR1.
+     *  - SIGHUP: Rolling restart. One at a time, each worker is replaced with
+     *            a fresh one and then gracefully stopped.
+     *
+     * A worker that dies within a second of starting is restarted after a
+     * second's delay so a broken worker doesn't spin.
+     *
+     * Since run() forks, the supervisor process should not have any other
+     * threads running when it is called.
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Prefork
+    {
+    public:
+        //! Sole constructor
+        /*!
+         * @param[in] workers Number of worker processes to run
+         */
+        Prefork(unsigned workers = std::thread::hardware_concurrency());
+
+        //! Listen to the default Fastcgi socket
+        bool listen(const ListenOptions& options = ListenOptions())
+        {
+            return m_sockets.listen(options);
+        }
+
+        //! Listen to a named socket
+        /*!
+         * @sa SocketGroup::listen(const char*, uint32_t, const char*,
+         *                         const char*)
+         */
+        bool listen(
+                const char* name,
+                uint32_t permissions = 0xffffffffUL,
+                const char* owner = nullptr,
+                const char* group = nullptr,
+                const ListenOptions& options = ListenOptions())
+        {
+            return m_sockets.listen(name, permissions, owner, group, options);
+        }
+
+        //! Listen to a TCP port
+        /*!
+         * @sa SocketGroup::listen(const char*, const char*)
+         */
+        bool listen(
+                const char* interface,
+                const char* service,
+                const ListenOptions& options = ListenOptions())
+        {
+            return m_sockets.listen(interface, service, options);
+        }
+
+        //! Listen on sockets passed to us by systemd
+        /*!
+         * @sa SocketGroup::listenActivated()
+         */
+        bool listenActivated(const char* name = nullptr)
+        {
+            return m_sockets.listenActivated(name);
+        }
+
+        //! Have a worker's Manager listen on our sockets
+        /*!
+         * Call this from within the worker function.
+         *
+         * @param[in] manager The worker's Manager
+         * @return True on success. False on failure.
+         */
+        bool adopt(Manager_base& manager) const;
+
+        //! Fork off the workers and supervise them
+        /*!
+         * In the supervisor this doesn't return until all workers have been
+         * stopped. In the workers the worker function is called and the
+         * process exits with whatever it returns.
+         *
+         * @param[in] worker Function run by each worker process
+         * @return Exit status for the supervisor
+         */
+        int run(const std::function<int()>& worker);
+
+        //! Index of this worker process
+        /*!
+         * Within a worker this is a number from 0 to one less than the
+         * number of workers. A replacement worker gets the index of the one
+         * it replaces.
+         */
+        unsigned slot() const
+        {
+            return m_slot;
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        //! A worker process
+        struct Worker
+        {
+            //! Process ID. Zero if there isn't one.
+            pid_t pid;
+
+            //! When the worker was started
+            Clock::time_point started;
+
+            //! When to next try and start a worker
+            Clock::time_point respawn;
+        };
+
+        //! Fork a worker process
+        /*!
+         * This only returns in the supervisor.
+         *
+         * @param[in] slot Index of the worker
+         * @param[in] worker Function run by the worker process
+         */
+        void spawn(unsigned slot, const std::function<int()>& worker);
+
+        //! Send a signal to every worker process
+        void signal(int signum) const;
+
+        //! The sockets we listen on
+        SocketGroup m_sockets;
+
+        //! Our workers
+        std::vector<Worker> m_workers;
+
+        //! Workers being gracefully stopped
+        std::vector<pid_t> m_retiring;
+
+        //! Index of this worker process
+        unsigned m_slot;
+
+        //! Signal mask to restore in worker processes
+        sigset_t m_mask;
+
+        //! Debug counter for worker processes started
+        unsigned m_spawnCount;
+
+        //! Debug counter for worker processes that died unexpectedly
+        unsigned m_crashCount;
+    };
+}
+
+#endif
@@ -402,6 +402,41 @@ namespace Fastcgipp
                 std::vector<char>::const_iterator& value,
                 std::vector<char>::const_iterator& end);
 
+        //! Where a single name-value pair is within a record body
+        struct Parameter
+        {
+            //! Offset of the name from the start of the body
+            uint32_t name;
+
+            //! Size of the name in bytes
+            uint32_t nameSize;
+
+            //! Offset of the value from the start of the body
+            uint32_t value;
+
+            //! Size of the value in bytes
+            uint32_t valueSize;
+        };
+
+        //! Decode every name-value pair in a record body at once
+        /*!
+         * This does the job of calling processParamHeader() in a loop but
+         * checks bounds once per pair and reads four byte lengths with a
+         * single byte swap. Pairs are appended to the array until the data
+         * ends or a pair doesn't fit in it.
+         *
+         * @param[in] data Start of the body of a RecordType::PARAMS or
+         *                 RecordType::GET_VALUES record
+         * @param[in] size Size of the body not including padding
+         * @param[out] parameters Complete pairs are appended to this
+         * @return Number of bytes taken up by the complete pairs. This is
+         *         less than size if the data ends part way through a pair.
+         */
+        size_t decodeParameters(
+                const char* data,
+                size_t size,
+                std::vector<Parameter>& parameters);
+
         //! For the reply of FastCGI management records
         /*!
          * This class template is an efficient tool for replying to
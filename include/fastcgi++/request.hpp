@@ -32,34 +32,74 @@
 #include "fastcgi++/protocol.hpp"
 #include "fastcgi++/fcgistreambuf.hpp"
 #include "fastcgi++/http.hpp"
+#include "fastcgi++/timer.hpp"
+#include "fastcgi++/arena.hpp"
 
 #include <ostream>
 #include <functional>
 #include <queue>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <map>
+#include <string>
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
 {
+    //! Reasons a request might be cancelled
+    enum class Cancellation: int
+    {
+        //! The request has not been cancelled
+        NONE,
+        //! The web server sent an ABORT_REQUEST record
+        ABORTED,
+        //! The request's deadline passed before it completed
+        DEADLINE,
+        //! The connection to the web server was lost
+        DISCONNECTED
+    };
+
+    class Manager_base;
+    template<class charT> class RoutingManager;
+
     //! De-templating base class for Request
     class Request_base
     {
     public:
+        Request_base():
+            m_sliceMessages(0),
+            m_sliceTime(std::chrono::microseconds::zero()),
+            m_weight(1),
+            m_class(0),
+            m_ended(false),
+            m_cancellation(Cancellation::NONE),
+            m_deadline(Timer::Clock::time_point::max()),
+            m_timer(nullptr),
+            m_timeout(Timer::invalid)
+        {}
+
         //! Request Handler
         /*!
          * This function is called by Manager::handler() to handle messages
          * destined for the request.  It deals with FastCGI messages (type=0)
          * while passing all other messages off to response().
          *
+         * Should the request use up it's time slice it will stop handling
+         * messages and return even though some are still queued. It is up to
+         * the caller to queue the request up to be handled again.
+         *
          * @return A lock locking the requests message queue. If the request
          *         completes this will be unlocked. If the request isn't
          *         complete it will be locked. If locked, makes sure to unlock
          *         it \e after unlocking Request::mutex.
+         * @sa yielded()
          * @sa callback
          */
         virtual std::unique_lock<std::mutex> handler() =0;
 
-        virtual ~Request_base() {}
+        virtual ~Request_base();
 
         //! Only one thread is allowed to handle the request at a time
         std::mutex mutex;
@@ -71,12 +111,209 @@ namespace Fastcgipp
             m_messages.push(std::move(message));
         }
 
+        //! Did the last handler() call leave messages in the queue?
+        /*!
+         * Only call this while holding the lock returned by handler().
+         */
+        bool yielded() const
+        {
+            return !m_messages.empty();
+        }
+
+        //! Scheduling class of the request
+        /*!
+         * This is 0 until all the request's parameters have been received at
+         * which point it is set by Request::classify().
+         *
+         * @sa Manager_base::setClass()
+         */
+        unsigned schedulingClass() const
+        {
+            return m_class.load(std::memory_order_relaxed);
+        }
+
+        //! Cancellation token
+        /*!
+         * This can be safely polled from any thread. Long running response()
+         * code should check it periodically and return as soon as it stops
+         * being Cancellation::NONE. Whatever is returned, handler() will
+         * finish off the request appropriately the next time it runs.
+         *
+         * @return Why the request was cancelled or Cancellation::NONE
+         */
+        Cancellation cancelled() const
+        {
+            return m_cancellation.load(std::memory_order_acquire);
+        }
+
+        //! Has the request sent it's END_REQUEST record?
+        /*!
+         * From then on the other side is free to reuse it's FcgiId even though
+         * the request may not have been erased yet.
+         */
+        bool ended() const
+        {
+            return m_ended.load(std::memory_order_acquire);
+        }
+
+        //! Cancel the request
+        /*!
+         * Sets the cancellation token and queues an empty message so that
+         * handler() notices it. Only the first cancellation sticks. This does
+         * \e not queue the request for handling.
+         *
+         * @param[in] reason Why the request is being cancelled
+         * @return True if this call cancelled the request
+         */
+        bool cancel(Cancellation reason);
+
+        //! Pass the request's records through a different send function
+        /*!
+         * This allows something like the ResponseCache to see everything the
+         * request sends. Call it before the request has been handled.
+         *
+         * @param[in] send Function for sending data out of the stream buffers
+         * @return False if the request doesn't support it
+         */
+        virtual bool redirect(
+                const std::function<void(const Socket&, std::vector<char>&&, bool)>&
+                    send)
+        {
+            return false;
+        }
+
     protected:
         //! A queue of message for the request
         std::queue<Message> m_messages;
 
         //! Thread safe our message queue
         std::mutex m_messagesMutex;
+
+        //! Set a deadline for the request to complete by
+        /*!
+         * Should the deadline pass before the request completes it will be
+         * cancelled with Cancellation::DEADLINE. This replaces any deadline
+         * previously set, including the default one from the Manager.
+         *
+         * @param[in] deadline When the request must be complete by
+         */
+        void setDeadline(Timer::Clock::time_point deadline);
+
+        //! Set a deadline relative to now for the request to complete by
+        void setDeadline(Timer::Clock::duration timeout)
+        {
+            setDeadline(Timer::Clock::now()+timeout);
+        }
+
+        //! Set the request's scheduling weight
+        /*!
+         * A request with a weight of 2 gets twice the time slice of one with
+         * a weight of 1, the default. This only has an effect if the Manager
+         * has time slicing enabled.
+         *
+         * @param[in] weight Multiple of the Manager's time slice to use
+         * @sa Manager_base::setSlice()
+         */
+        void setWeight(unsigned weight)
+        {
+            m_weight = std::max(1u, weight);
+        }
+
+        //! Maximum messages to handle per handler() call. Zero is unlimited.
+        unsigned m_sliceMessages;
+
+        //! Maximum time to spend per handler() call. Zero is unlimited.
+        std::chrono::microseconds m_sliceTime;
+
+        //! Multiple of the time slice this request gets
+        unsigned m_weight;
+
+        //! Scheduling class of the request
+        std::atomic_uint m_class;
+
+        //! Set before sending the END_REQUEST record
+        std::atomic_bool m_ended;
+
+        //! Path segments captured by the Router
+        /*!
+         * If the request was constructed by a RoutingManager this contains
+         * the named segments captured from the route's pattern. For example
+         * the pattern "/users/:id" captures "id".
+         */
+        const std::map<std::string, std::string>& captures() const
+        {
+            return m_captures;
+        }
+
+        //! Replace this request with another one
+        /*!
+         * Once handler() returns, the Manager will swap the replacement in for
+         * this request and hand it any messages still queued. This is how a
+         * PendingRequest hands over to the real request once it has been
+         * constructed. The replacement should be fully configured and have
+         * any messages it needs pushed into it.
+         *
+         * @param[in] request The request to take this one's place
+         */
+        void replace(std::unique_ptr<Request_base>&& request)
+        {
+            m_replacement = std::move(request);
+        }
+
+        //! Memory arena that lives as long as the request
+        /*!
+         * Per request data can be allocated from here with ArenaAllocator
+         * instead of going through the heap. Everything in it is released in
+         * one go once the request is complete and destroyed. Since this
+         * belongs to the base class it outlives any members of the derived
+         * request.
+         *
+         * Nothing is freed before then so it suits node based containers and
+         * ones reserved up front. A vector left to grow by reallocation
+         * strands every block it outgrows.
+         *
+         * @code
+         * std::list<Row, Fastcgipp::ArenaAllocator<Row>> m_rows(arena());
+         * @endcode
+         */
+        Arena& arena()
+        {
+            return m_arena;
+        }
+
+    private:
+        //! Memory arena that lives as long as the request
+        Arena m_arena;
+
+        //! Path segments captured by the Router
+        std::map<std::string, std::string> m_captures;
+
+        //! The request to take this one's place
+        std::unique_ptr<Request_base> m_replacement;
+
+        //! Why the request was cancelled
+        std::atomic<Cancellation> m_cancellation;
+
+        //! When the request must be complete by
+        std::atomic<Timer::Clock::time_point> m_deadline;
+
+        //! Timer service enforcing our deadline
+        Timer* m_timer;
+
+        //! Handle of our pending deadline timeout
+        Timer::Handle m_timeout;
+
+        //! Passes the deadline timeout back to the Manager
+        std::function<void(Message)> m_expire;
+
+        //! Has the deadline passed?
+        bool expired() const
+        {
+            return Timer::Clock::now() >= m_deadline.load();
+        }
+
+        friend class Manager_base;
+        template<class charT> friend class RoutingManager;
     };
 
     //! %Request handling class
@@ -146,6 +383,14 @@ namespace Fastcgipp
 
         std::unique_lock<std::mutex> handler();
 
+        bool redirect(
+                const std::function<void(const Socket&, std::vector<char>&&, bool)>&
+                    send)
+        {
+            configure(m_id, m_role, m_kill, send, m_callback);
+            return true;
+        }
+
         virtual ~Request() {}
 
     protected:
@@ -178,6 +423,32 @@ namespace Fastcgipp
          */
         virtual void bigPostErrorHandler();
 
+        //! Classify the request for scheduling
+        /*!
+         * This function is called once all of the request's parameters have
+         * been received and before any POST data is. Override it to place
+         * requests into the scheduling classes set up with
+         * Manager_base::setClass(). Typically you would look at something like
+         * environment().scriptName or environment().requestUri. By default
+         * every request goes in class 0.
+         *
+         * @return The scheduling class the request belongs to
+         */
+        virtual unsigned classify()
+        {
+            return 0;
+        }
+
+        //! Called when the request's deadline passes
+        /*!
+         * This function is called when the request is cancelled because it
+         * didn't complete before it's deadline. By default it will send a
+         * standard 504 Gateway Timeout message to the user. Note that if part
+         * of the response has already been flushed this will simply be
+         * appended to it. Override for more specialized purposes.
+         */
+        virtual void timeoutHandler();
+
         //! See the requests role
         Protocol::Role role() const
         {
@@ -352,7 +623,13 @@ namespace Fastcgipp
         Protocol::RecordType m_state;
 
         //! Generates an END_REQUEST FastCGI record
-        void complete();
+        /*!
+         * @param[in] aborted True if the request was aborted before it
+         *                    finished. This is reported with a non-zero
+         *                    application status so the response is known to
+         *                    be truncated.
+         */
+        void complete(bool aborted=false);
 
         //! Function to actually send the record
         std::function<void(const Socket&, std::vector<char>&&, bool kill)> m_send;
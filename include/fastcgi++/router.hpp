@@ -0,0 +1,342 @@
+/*!
+ * @file       router.hpp
+ * @brief      Declares the RoutingManager class and it's helpers
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_ROUTER_HPP
+#define FASTCGIPP_ROUTER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "fastcgi++/manager.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Radix trie mapping URL paths to values
+    /*!
+     * Patterns are made up of literal text, named segments and an optional
+     * trailing catch-all.
+     *  - "/users/:id" matches "/users/42" and captures "id" as "42". A named
+     *    segment matches one or more characters up to the next '/'.
+     *  - A catch-all is a final segment starting with '*'. Appending "*file"
+     *    to "/static/" gives a pattern that matches "/static/css/site.css" and
+     *    captures "file" as "css/site.css". A catch-all matches everything
+     *    that remains, including nothing at all.
+     *
+     * Literal text always wins over a named segment which always wins over a
+     * catch-all. Lookups are linear in the length of the path and allocate
+     * nothing unless something is captured.
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class PathTrie
+    {
+    public:
+        //! Add a pattern to the trie
+        /*!
+         * @param[in] pattern The pattern to match paths against
+         * @param[in] value The value to return when the pattern matches
+         * @return False if the pattern is malformed or conflicts with one
+         *         already in the trie.
+         */
+        bool insert(const std::string& pattern, unsigned value);
+
+        //! Look up a path
+        /*!
+         * @param[in] begin Start of the path
+         * @param[in] end End of the path
+         * @param[out] value Value of the matching pattern
+         * @param[out] captures Named segments captured by the pattern
+         * @return True if a pattern matched
+         */
+        bool match(
+                const char* begin,
+                const char* end,
+                unsigned& value,
+                std::map<std::string, std::string>& captures) const;
+
+    private:
+        //! A single node in the trie
+        struct Node
+        {
+            Node():
+                terminal(false),
+                catchAll(false)
+            {}
+
+            //! Literal text leading to this node from it's parent
+            std::string prefix;
+
+            //! Literal children. Their prefixes all start differently.
+            std::vector<std::unique_ptr<Node>> children;
+
+            //! Child reached through a named segment
+            std::unique_ptr<Node> param;
+
+            //! Name of the segment leading to param
+            std::string paramName;
+
+            //! True if a pattern ends at this node
+            bool terminal;
+
+            //! Value of the pattern ending at this node
+            unsigned value;
+
+            //! True if a catch-all pattern ends at this node
+            bool catchAll;
+
+            //! Name of the catch-all segment
+            std::string catchAllName;
+
+            //! Value of the catch-all pattern
+            unsigned catchAllValue;
+        };
+
+        //! Find or create the node at the end of some literal text
+        static Node* insertLiteral(
+                Node* node,
+                const char* begin,
+                const char* end);
+
+        //! Recursive guts of match()
+        static bool match(
+                const Node& node,
+                const char* begin,
+                const char* end,
+                unsigned& value,
+                std::map<std::string, std::string>& captures);
+
+        //! Root of the trie
+        Node m_root;
+    };
+
+    //! Fallback request that responds with a 404
+    template<class charT> class NotFound: public Request<charT>
+    {
+    private:
+        bool response()
+        {
+            this->out <<
+"Status: 404 Not Found\n"
+"Content-Type: text/html; charset=utf-8\r\n\r\n"
+"<!DOCTYPE html>\n"
+"<html lang='en'>"
+    "<head>"
+        "<title>404 Not Found</title>"
+    "</head>"
+    "<body>"
+        "<h1>404 Not Found</h1>"
+    "</body>"
+"</html>";
+            return true;
+        }
+    };
+
+    //! Maps URL paths to Request types
+    /*!
+     * @tparam charT Character type of the requests being routed to
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    template<class charT> class Router
+    {
+    public:
+        Router():
+            m_fallback(&construct<NotFound<charT>>)
+        {}
+
+        //! Route a pattern to a Request type
+        /*!
+         * @param[in] pattern See PathTrie for the syntax
+         * @tparam RequestT Request type to construct for matching paths
+         * @return False if the pattern is malformed or conflicts with one
+         *         already routed.
+         */
+        template<class RequestT> bool route(const std::string& pattern)
+        {
+            if(!m_trie.insert(pattern, m_factories.size()))
+                return false;
+            m_factories.push_back(&construct<RequestT>);
+            return true;
+        }
+
+        //! Set the Request type to construct when no pattern matches
+        /*!
+         * By default this is NotFound.
+         *
+         * @tparam RequestT Request type to construct for unmatched paths
+         */
+        template<class RequestT> void fallback()
+        {
+            m_fallback = &construct<RequestT>;
+        }
+
+        //! Construct the request a path is routed to
+        /*!
+         * @param[in] begin Start of the path
+         * @param[in] end End of the path
+         * @param[out] captures Named segments captured by the route
+         * @return The unconfigured request
+         */
+        std::unique_ptr<Request<charT>> make(
+                const char* begin,
+                const char* end,
+                std::map<std::string, std::string>& captures) const
+        {
+            unsigned route;
+            if(m_trie.match(begin, end, route, captures))
+                return m_factories[route]();
+            captures.clear();
+            return m_fallback();
+        }
+
+    private:
+        //! Function constructing a request
+        typedef std::unique_ptr<Request<charT>>(*Factory)();
+
+        template<class RequestT>
+        static std::unique_ptr<Request<charT>> construct()
+        {
+            return std::unique_ptr<Request<charT>>(new RequestT);
+        }
+
+        //! Maps paths to indices in m_factories
+        PathTrie m_trie;
+
+        //! Factories for each route
+        std::vector<Factory> m_factories;
+
+        //! Factory for unmatched paths
+        Factory m_fallback;
+    };
+
+    //! Manager handling many Request types
+    /*!
+     * Rather than construct a single request type for everything, the
+     * RoutingManager picks the type based on the request's path once it's
+     * parameters have arrived. The path is the concatenation of the
+     * SCRIPT_NAME and PATH_INFO parameters so patterns should account for
+     * where the web server mounted the application.
+     *
+     * @code
+     * Fastcgipp::RoutingManager<wchar_t> manager;
+     * manager.route<Users>("/users/:id");
+     * manager.route<Posts>("/users/:id/posts");
+     * manager.fallback<Missing>();
+     * @endcode
+     *
+     * Segments captured from the path are available to the request through
+     * Request_base::captures(). All routes must be set up before start() is
+     * called.
+     *
+     * @tparam charT Character type of the requests being routed to
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    template<class charT> class RoutingManager: public Manager_base
+    {
+    public:
+        //! Sole constructor
+        /*!
+         * @param[in] threads Number of threads to use for request handling
+         */
+        RoutingManager(unsigned threads = std::thread::hardware_concurrency()):
+            Manager_base(threads)
+        {}
+
+        //! See Router::route()
+        template<class RequestT> bool route(const std::string& pattern)
+        {
+            return m_router.template route<RequestT>(pattern);
+        }
+
+        //! See Router::fallback()
+        template<class RequestT> void fallback()
+        {
+            m_router.template fallback<RequestT>();
+        }
+
+    private:
+        //! Construct the request the path is routed to
+        std::unique_ptr<Request_base> dispatch(PendingRequest& pending)
+        {
+            const std::string path(
+                    pending.parameter("SCRIPT_NAME")
+                    +pending.parameter("PATH_INFO"));
+            return construct(
+                    path,
+                    pending.id(),
+                    pending.role(),
+                    pending.kill());
+        }
+
+        //! Construct the request an empty path is routed to
+        std::unique_ptr<Request_base> makeRequest(
+                const Protocol::RequestId& id,
+                const Protocol::Role& role,
+                bool kill)
+        {
+            return construct(std::string(), id, role, kill);
+        }
+
+        //! Construct and configure the request a path is routed to
+        std::unique_ptr<Request_base> construct(
+                const std::string& path,
+                const Protocol::RequestId& id,
+                const Protocol::Role& role,
+                bool kill)
+        {
+            using namespace std::placeholders;
+
+            std::map<std::string, std::string> captures;
+            std::unique_ptr<Request<charT>> request(m_router.make(
+                        path.data(),
+                        path.data()+path.size(),
+                        captures));
+            request->configure(
+                    id,
+                    role,
+                    kill,
+                    std::bind(&Transceiver::send, &m_transceiver, _1, _2, _3),
+                    std::bind(&RoutingManager<charT>::push, this, id, _1));
+            static_cast<Request_base&>(*request).m_captures
+                = std::move(captures);
+            return std::unique_ptr<Request_base>(std::move(request));
+        }
+
+        //! Our routes
+        Router<charT> m_router;
+    };
+}
+
+#endif
@@ -36,11 +36,13 @@
 
 #include <memory>
 #include <map>
-#include <mutex>
 #include <set>
 #include <atomic>
 
 #include "fastcgi++/config.hpp"
+#include "fastcgi++/timer.hpp"
+
+#include <sys/socket.h>
 
 #ifdef FASTCGIPP_UNIX
 #include <vector>
@@ -62,6 +64,73 @@ namespace Fastcgipp
 #endif
 
     class SocketGroup;
+    class Transport;
+
+    //! Tuning options for listening sockets
+    /*!
+     * Options that only make sense for TCP are ignored on unix sockets. The
+     * per connection options are applied to every connection accepted on the
+     * listener.
+     *
+     * @code
+     * Fastcgipp::ListenOptions options;
+     * options.backlog = 4096;
+     * options.deferAccept = 5;
+     * manager.listen("127.0.0.1", "9000", options);
+     * @endcode
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    struct ListenOptions
+    {
+        //! Length of the accept queue. Capped by net.core.somaxconn.
+        int backlog;
+
+        //! Set SO_REUSEADDR so we can bind while old connections linger
+        bool reuseAddress;
+
+        //! Set SO_REUSEPORT so several sockets can listen on one port
+        /*!
+         * The kernel then spreads connections across them. This is how
+         * multiple managers or processes each get their own listener.
+         */
+        bool reusePort;
+
+        //! Seconds to wait for data before accepting. Zero disables.
+        /*!
+         * With TCP_DEFER_ACCEPT a connection isn't accepted until the web
+         * server has actually sent something.
+         */
+        int deferAccept;
+
+        //! Length of the TCP_FASTOPEN queue. Zero disables.
+        int fastOpen;
+
+        //! Set TCP_NODELAY on connections
+        bool noDelay;
+
+        //! SO_RCVBUF of connections in bytes. Zero leaves the default.
+        int receiveBuffer;
+
+        //! SO_SNDBUF of connections in bytes. Zero leaves the default.
+        int sendBuffer;
+
+        //! SO_BUSY_POLL of connections in microseconds. Zero disables.
+        int busyPoll;
+
+        ListenOptions():
+            backlog(SOMAXCONN),
+            reuseAddress(true),
+            reusePort(false),
+            deferAccept(0),
+            fastOpen(0),
+            noDelay(false),
+            receiveBuffer(0),
+            sendBuffer(0),
+            busyPoll(0)
+        {}
+    };
 
     //! Class for representing an OS level I/O socket.
     /*!
@@ -84,6 +153,9 @@ namespace Fastcgipp
         //! Our respective SocketGroup needs private access.
         friend class SocketGroup;
 
+        //! As does any other transport
+        friend class Transport;
+
         //! Data structure to hold the shared socket data.
         struct Data
         {
@@ -100,57 +172,78 @@ namespace Fastcgipp
              */
             bool m_closing;
 
-            //! SocketGroup object this socket is tied to.
-            SocketGroup& m_group;
+            //! Transport this socket is tied to.
+            Transport& m_transport;
+
+            //! Handle of the socket's pending timeout
+            TimingWheel<uint64_t>::Handle m_timeout;
+
+            //! Distinguishes this connection from others that used the fd
+            const uint32_t m_generation;
+
+            //! How many Socket objects point to this
+            std::atomic_uint m_references;
 
             //! Sole constructor
             /*!
              * @param [inout] socket The OS level socket identifier to associate
              *                       with this.
-             * @param [inout] group The SocketGroup object that created and is
-             *                      consolidating this socket and it's peers.
-             * @param [in] valid Set to false if this is a dead socket.
-             *                   Sometimes it may be needed to create a socket
-             *                   that is invalid off the start.
+             * @param [inout] transport The Transport that created and is
+             *                          consolidating this socket and it's
+             *                          peers.
+             * @param [in] generation Generation of the socket's slot in the
+             *                        SocketGroup.
              */
             Data(
                     const socket_t& socket,
-                    bool valid,
-                    SocketGroup& group):
+                    Transport& transport,
+                    uint32_t generation):
                 m_socket(socket),
-                m_valid(valid),
+                m_valid(true),
                 m_closing(false),
-                m_group(group)
+                m_transport(transport),
+                m_timeout(TimingWheel<uint64_t>::invalid),
+                m_generation(generation),
+                m_references(1)
             {}
 
             Data() =delete;
             Data(const Data&) =delete;
         };
 
-        //! Shared pointer to hold the socket data.
-        std::shared_ptr<Data> m_data;
+        //! Intrusively reference counted socket data
+        /*!
+         * This is nullptr for sockets that were invalid from the start.
+         */
+        Data* m_data;
 
         //! This is only true for a non-copy constructed object.
         bool m_original;
 
         //! Sole non-copy/move constructor
         /*!
-         * This constructor is only accessible to the SocketGroup class to create
-         * new "original" sockets as they are accepted. Only sockets created
-         * with this constructor will have m_original set to true.
+         * This constructor is only accessible to transports to create new
+         * "original" sockets as they are accepted. Only sockets created with
+         * this constructor will have m_original set to true.
          *
          * @param [inout] socket The OS level socket identifier to associate
          *                       with this.
-         * @param [inout] group The SocketGroup object that created and is
-         *                      consolidating this socket and it's peers.
-         * @param [in] valid Set to false if this is a dead socket. Sometimes it
-         *                   may be needed to create a socket that is invalid
-         *                   off the start.
+         * @param [inout] transport The Transport that created and is
+         *                          consolidating this socket and it's peers.
+         * @param [in] generation Generation of the socket's slot in the
+         *                        SocketGroup.
          */
         Socket(
                 const socket_t& socket,
-                SocketGroup& group,
-                bool valid=true);
+                Transport& transport,
+                uint32_t generation);
+
+        //! Drop our reference to the socket data
+        void release()
+        {
+            if(m_data != nullptr && --m_data->m_references == 0)
+                delete m_data;
+        }
 
     public:
         //! Try and read a chunk of data out of the socket.
@@ -217,7 +310,10 @@ namespace Fastcgipp
         Socket(const Socket& x):
             m_data(x.m_data),
             m_original(false)
-        {}
+        {
+            if(m_data != nullptr)
+                ++m_data->m_references;
+        }
 
         //! Assignment
         /*!
@@ -225,6 +321,9 @@ namespace Fastcgipp
          */
         Socket& operator=(const Socket& x)
         {
+            if(x.m_data != nullptr)
+                ++x.m_data->m_references;
+            release();
             m_data = x.m_data;
             m_original = false;
             return *this;
@@ -236,28 +335,47 @@ namespace Fastcgipp
          * into containers. The source socket has it's originality stripped and
          * moved to the destination.
          */
-        Socket(Socket&& x):
+        Socket(Socket&& x) noexcept:
             m_data(x.m_data),
             m_original(x.m_original)
         {
+            x.m_data=nullptr;
             x.m_original=false;
         }
 
+        //! Move assignment
+        /*!
+         * As with the move constructor, originality is moved along with the
+         * data. Don't assign over an original that is still valid.
+         */
+        Socket& operator=(Socket&& x) noexcept
+        {
+            if(this != &x)
+            {
+                release();
+                m_data = x.m_data;
+                m_original = x.m_original;
+                x.m_data = nullptr;
+                x.m_original = false;
+            }
+            return *this;
+        }
+
         //! Calls close() on the socket if we are destructing the original
         ~Socket();
 
         //! Returns true if this socket is still open and capable of read/write.
         bool valid() const
         {
-            return m_data->m_valid;
+            return m_data != nullptr && m_data->m_valid;
         }
 
         //! Call this to close the socket
         /*!
          * If the socket is valid, this will do the following:
          *  - Close/hangup the OS level socket.
-         *  - Remove the socket from the associated SocketGroup polling set.
-         *  - Fully disassociate the socket with the SocketGroup.
+         *  - Remove the socket from the associated Transport polling set.
+         *  - Fully disassociate the socket with the Transport.
          *  - Mark the socket as invalid.
          *
          * If the socket is already invalid, calling this does nothing.
@@ -268,6 +386,127 @@ namespace Fastcgipp
         Socket();
     };
 
+    //! Interface to whatever carries connections to and from the Transceiver
+    /*!
+     * SocketGroup is the implementation that works with OS level sockets.
+     * Others, like the in process Loopback, can be handed to
+     * Manager_base::setTransport() in it's place. Each connection is
+     * represented by an original Socket made with create() and all reading,
+     * writing and closing done through any copy of it is routed back to the
+     * transport.
+     *
+     * Only wake() needs to be thread safe. Everything else is called from
+     * the Transceiver's thread.
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Transport
+    {
+    public:
+        //! Clock used for connection timeouts
+        typedef TimingWheel<uint64_t>::Clock Clock;
+
+        virtual ~Transport() {}
+
+        //! Wait for a connection with incoming data
+        /*!
+         * @param[in] block Set \em true to sleep until there is data or a
+         *                  wake().
+         * @return A connection with data waiting or an invalid socket
+         * @sa SocketGroup::poll()
+         */
+        virtual Socket poll(bool block) =0;
+
+        //! Wake up from a nap inside poll()
+        virtual void wake() =0;
+
+        //! Set a timeout on a connection
+        /*!
+         * @sa SocketGroup::setTimeout()
+         */
+        virtual void setTimeout(const Socket& socket, Clock::duration timeout)
+            =0;
+
+        //! Retrieve a connection whose timeout has passed
+        /*!
+         * @sa SocketGroup::expired()
+         */
+        virtual Socket expired() =0;
+
+        //! How many connections are open
+        virtual size_t size() const =0;
+
+        //! Should we accept new connections?
+        virtual void accept(bool status) =0;
+
+    protected:
+        //! Sockets route their I/O through us
+        friend class Socket;
+
+        //! Read out of a connection
+        /*!
+         * @sa Socket::read()
+         */
+        virtual ssize_t readSocket(
+                const Socket& socket,
+                char* buffer,
+                size_t size) =0;
+
+        //! Write into a connection
+        /*!
+         * @sa Socket::write()
+         */
+        virtual ssize_t writeSocket(
+                const Socket& socket,
+                const char* buffer,
+                size_t size) =0;
+
+        //! Close a valid connection and mark it invalid
+        virtual void closeSocket(const Socket& socket) =0;
+
+        //! Create the original socket of a new connection
+        /*!
+         * @param [in] id Identifier of the connection within the transport
+         * @param [in] generation Distinguishes the connection from earlier
+         *                        ones with the same identifier
+         */
+        Socket create(socket_t id, uint32_t generation=0)
+        {
+            return Socket(id, *this, generation);
+        }
+
+        //! Identifier the connection was created with
+        static socket_t id(const Socket& socket)
+        {
+            return socket.m_data->m_socket;
+        }
+
+        //! Generation the connection was created with
+        static uint32_t generation(const Socket& socket)
+        {
+            return socket.m_data->m_generation;
+        }
+
+        //! Has the other side hung up?
+        static bool closing(const Socket& socket)
+        {
+            return socket.m_data->m_closing;
+        }
+
+        //! Note that the other side has hung up
+        static void setClosing(const Socket& socket)
+        {
+            socket.m_data->m_closing = true;
+        }
+
+        //! Mark a connection invalid
+        static void invalidate(const Socket& socket)
+        {
+            socket.m_data->m_valid = false;
+        }
+    };
+
     //! Class for representing an OS level socket that listens for connections.
     /*!
      * It works together with the Socket class to establish all the interfacing
@@ -275,6 +514,7 @@ namespace Fastcgipp
      * world. The object of this class represents the socket that listens for
      * incoming connections to the FastCGI server. This class will create and
      * manage an array of Socket objects as new connections are initiated.
+     * It is the Transport for OS level sockets.
      *
      * <em>The only part of this class that is safe to call from multiple
      * threads is the wake() function.</em>
@@ -282,7 +522,7 @@ namespace Fastcgipp
      * @date    May 18, 2016
      * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
      */
-    class SocketGroup
+    class SocketGroup: public Transport
     {
     public:
         SocketGroup();
@@ -294,9 +534,10 @@ namespace Fastcgipp
          * Calling this simply adds the default socket used on FastCGI
          * applications that are initialized from HTTP servers.
          *
+         * @param [in] options Tuning options for the socket
          * @return True on success. False on failure.
          */
-        bool listen();
+        bool listen(const ListenOptions& options = ListenOptions());
 
         //! Listen to a named socket
         /*!
@@ -311,13 +552,15 @@ namespace Fastcgipp
          *                   do not wish to set it.
          * @param [in] group Group (group name) of socket. Leave as nullptr if
          *                   you do not wish to set it.
+         * @param [in] options Tuning options for the socket
          * @return True on success. False on failure.
          */
         bool listen(
                 const char* name,
                 uint32_t permissions = 0xffffffffUL,
                 const char* owner = nullptr,
-                const char* group = nullptr);
+                const char* group = nullptr,
+                const ListenOptions& options = ListenOptions());
 
         //! Listen to a TCP port
         /*!
@@ -329,11 +572,70 @@ namespace Fastcgipp
          * @param [in] service Port or service to listen on. This could be a
          *                     service name, or a string representation of a
          *                     port number.
+         * @param [in] options Tuning options for the socket
          * @return True on success. False on failure.
          */
         bool listen(
                 const char* interface,
-                const char* service);
+                const char* service,
+                const ListenOptions& options = ListenOptions());
+
+        //! Listen on a socket that is already listening
+        /*!
+         * This is for sockets inherited from a parent process. The socket
+         * must be a listening stream socket in the unix, IPv4 or IPv6 domain.
+         * It is made non-blocking so that processes sharing it can race to
+         * accept connections. Since other processes may still be using it, it
+         * is closed but never shut down when the group is destroyed.
+         *
+         * @param [in] listener The listening socket
+         * @return True on success. False on failure.
+         */
+        bool adopt(socket_t listener);
+
+        //! Listen on sockets passed to us by systemd
+        /*!
+         * This implements the socket activation protocol. Sockets are passed
+         * starting at file descriptor 3 with their count in LISTEN_FDS and
+         * optionally their names from the FileDescriptorName= setting in
+         * LISTEN_FDNAMES. They are only ours if LISTEN_PID matches our process
+         * ID. The environment variables are removed so they aren't passed on
+         * to child processes.
+         *
+         * @param [in] name Only adopt sockets with this name. Pass nullptr to
+         *                  adopt them all.
+         * @return True if at least one socket was adopted
+         */
+        bool listenActivated(const char* name = nullptr);
+
+        //! Mark all our listeners as shared with other processes
+        /*!
+         * From now on they are closed but never shut down when the group is
+         * destroyed. This can be called from any thread. The listeners are
+         * marked by whichever thread is calling poll().
+         */
+        void share()
+        {
+            m_share = true;
+            wake();
+        }
+
+        //! Steer incoming connections towards a CPU
+        /*!
+         * Sets SO_INCOMING_CPU on all our listeners. When several processes or
+         * managers share a port with SO_REUSEPORT, the kernel then prefers
+         * handing connections that arrive on that CPU to us. It has no effect
+         * where SO_INCOMING_CPU isn't supported.
+         *
+         * @param [in] cpu CPU the connections should arrive on
+         */
+        void incomingCpu(unsigned cpu);
+
+        //! The sockets we listen for connections on
+        const std::set<socket_t>& listeners() const
+        {
+            return m_listeners;
+        }
 
         //! Connect to a named socket
         /*!
@@ -377,6 +679,8 @@ namespace Fastcgipp
          *    return the socket.
          *  - If the call has been set to non-blocking and no new data awaits, a
          *    generic invalid socket is returned.
+         *  - If a socket timeout passes while blocking, a generic invalid
+         *    socket is returned. Check expired().
          *
          * This function can be either blocking or non-blocking depending on the
          * boolean value passed to it. If the call is blocking it can be awoken
@@ -387,7 +691,7 @@ namespace Fastcgipp
          * @return The socket for which there is new data waiting. Make sure to
          *         Socket::valid() on it to ensure validity.
          */
-        Socket poll(bool block);
+        Socket poll(bool block) override;
 
         //! Wake up from a nap inside poll()
         /*!
@@ -398,12 +702,64 @@ namespace Fastcgipp
          * This function is thread safe and can be called from anywhere as often
          * as is desired.
          */
-        void wake();
+        void wake() override;
+
+        //! Set a timeout on a socket
+        /*!
+         * Once the timeout passes the socket will be returned by expired().
+         * Any timeout previously set on the socket is replaced. The timeout
+         * is cleared when the socket is closed.
+         *
+         * @param [in] socket Socket to set the timeout on
+         * @param [in] timeout How long from now the socket should expire. A
+         *                     zero value simply clears the current timeout.
+         */
+        void setTimeout(const Socket& socket, Clock::duration timeout)
+            override;
+
+        //! Set the timeout given to newly accepted connections
+        /*!
+         * @param [in] timeout How long a new connection has before it expires.
+         *                     Zero, the default, means no timeout.
+         * @sa setTimeout()
+         */
+        void setAcceptTimeout(Clock::duration timeout)
+        {
+            m_acceptTimeout = timeout;
+        }
+
+        //! Limit how connections are accepted
+        /*!
+         * Each time a listener is ready up to a batch of pending connections
+         * are accepted in one go. Beyond that, connections can be limited in
+         * rate and in number. While over a limit we simply stop accepting so
+         * further connections wait in the listen queue rather than swamping
+         * us.
+         *
+         * @param [in] batch Most connections to accept per wakeup. At least
+         *                   one.
+         * @param [in] rate Most connections to accept per second. Zero means
+         *                  no limit.
+         * @param [in] connections Most connections to have open at once.
+         *                         Zero means no limit.
+         */
+        void setAcceptLimits(unsigned batch, unsigned rate, size_t connections);
+
+        //! Retrieve a socket whose timeout has passed
+        /*!
+         * The socket is not closed. That is left to the caller. Call this
+         * repeatedly until it returns an invalid socket after every poll()
+         * as poll() will return early for the sake of expiring sockets.
+         *
+         * @return A socket whose timeout has passed or an invalid socket if
+         *         there are none.
+         */
+        Socket expired() override;
 
         //! How many active sockets (not counting listeners) are in the group
-        size_t size() const
+        size_t size() const override
         {
-            return m_sockets.size();
+            return m_socketCount;
         }
 
         //! Should we accept new connections?
@@ -411,23 +767,65 @@ namespace Fastcgipp
          * @param [in] status Set to false if you want to start refusing new
          *                    connections. True otherwise (default).
          */
-        void accept(bool status);
+        void accept(bool status) override;
 
     private:
         //! Our sockets need access to our private data
         friend class Socket;
 
+        ssize_t readSocket(const Socket& socket, char* buffer, size_t size)
+            override;
+        ssize_t writeSocket(
+                const Socket& socket,
+                const char* buffer,
+                size_t size) override;
+        void closeSocket(const Socket& socket) override;
+
         //! These are the sockets we listen for connections on
         std::set<socket_t> m_listeners;
 
+        //! Listeners shared with other processes
+        std::set<socket_t> m_adopted;
+
+        //! Per connection options of listeners that have any
+        std::map<socket_t, ListenOptions> m_options;
+
+        //! Apply options to a listener before it starts listening
+        /*!
+         * This also makes the listener non-blocking so that createSocket()
+         * can drain it's accept queue.
+         *
+         * @param [in] listener The socket to apply them to
+         * @param [in] options The options
+         * @param [in] tcp True if it's a TCP socket
+         * @return False if the socket should be abandoned
+         */
+        bool configureListener(
+                socket_t listener,
+                const ListenOptions& options,
+                bool tcp);
+
+        //! Apply per connection options to an accepted socket
+        void configureConnection(socket_t socket, const ListenOptions& options);
+
         //! Our poll object
         poll_t m_poll;
 
+#ifdef FASTCGIPP_LINUX
+        //! An eventfd for wakeup purposes
+        const int m_wakeEvent;
+#else
         //! A pair of sockets for wakeup purposes
         socket_t m_wakeSockets[2];
+#endif
 
         //! Set to true while there is a pending wake
-        bool m_waking;
+        /*!
+         * Any number of wake() calls made before poll() picks up the wake
+         * coalesce into a single write. Only the first has to touch the
+         * kernel.
+         */
+        std::atomic_bool m_waking;
 
         //! Set to true if we should be accepting new connections
         std::atomic_bool m_accept;
@@ -435,17 +833,120 @@ namespace Fastcgipp
         //! Set to true if we should refresh the listeners in the poll
         std::atomic_bool m_refreshListeners;
 
-        //! We need this mutex to thread safe the wake() function.
-        std::mutex m_wakingMutex;
+        //! Set to true if our listeners should be marked as shared
+        std::atomic_bool m_share;
+
+        //! An entry in our connection table
+        struct Slot
+        {
+            Slot():
+                generation(0)
+            {}
 
-        //! All the sockets
-        std::map<socket_t, Socket> m_sockets;
+            //! The original socket. Invalid if the slot is free.
+            Socket socket;
 
-        //! Accept a new connection and create it's socket
+            //! Incremented every time a connection takes the slot
+            uint32_t generation;
+        };
+
+        //! All the sockets indexed by their OS level identifier
+        /*!
+         * File descriptors are small and densely packed so a flat table beats
+         * a tree. The generations let poll events and timeouts left over from
+         * an old connection be told apart from a new one that reused the fd.
+         */
+        std::vector<Slot> m_sockets;
+
+        //! How many slots in #m_sockets are taken
+        size_t m_socketCount;
+
+        //! Identifier of a connection that isn't reused along with it's fd
+        static uint64_t identify(socket_t socket, uint32_t generation)
+        {
+            return uint64_t(generation)<<32 | uint32_t(socket);
+        }
+
+        //! Find a connection's original socket
+        /*!
+         * @param [in] socket OS level socket identifier
+         * @param [in] generation Generation of the connection
+         * @return Pointer to the socket or nullptr if the connection is gone
+         */
+        Socket* find(socket_t socket, uint32_t generation)
+        {
+            if(size_t(socket) >= m_sockets.size())
+                return nullptr;
+            Slot& slot = m_sockets[socket];
+            if(slot.generation != generation || !slot.socket.valid())
+                return nullptr;
+            return &slot.socket;
+        }
+
+        //! Add a new connection to the table
+        /*!
+         * @param [in] socket OS level socket identifier of the connection
+         * @return The new socket. Invalid if it couldn't be polled.
+         */
+        Socket insert(socket_t socket);
+
+        //! Remove a closed connection from the table
+        void remove(socket_t socket);
+
+        //! Pending socket timeouts keyed by connection identifier
+        TimingWheel<uint64_t> m_timeouts;
+
+        //! Connections that have expired but haven't been retrieved yet
+        std::vector<uint64_t> m_expired;
+
+        //! Timeout given to newly accepted connections
+        Clock::duration m_acceptTimeout;
+
+        //! Most connections to accept per listener wakeup
+        unsigned m_acceptBatch;
+
+        //! Most connections to accept per second. Zero is unlimited.
+        unsigned m_acceptRate;
+
+        //! Connections we can accept before running out of rate
+        double m_acceptTokens;
+
+        //! When #m_acceptTokens was last topped up
+        Clock::time_point m_acceptRefilled;
+
+        //! Most connections to have open at once. Zero is unlimited.
+        size_t m_maxConnections;
+
+        //! Don't accept anything until this point in time
+        Clock::time_point m_acceptResume;
+
+        //! True if our listeners are currently in the poll
+        bool m_listening;
+
+        //! Spare file descriptor for when we run out
+        /*!
+         * When accept() fails because we're out of file descriptors the
+         * pending connection would otherwise keep waking us up. Closing this
+         * lets us accept and immediately close it.
+         */
+        int m_reserve;
+
+        //! Back off from accepting for a while
+        void pauseAccepting(Clock::duration duration);
+
+        //! Accept pending connections and create their sockets
         inline void createSocket(const socket_t listener);
 
         //! Add a socket identifier to the poll list
-        bool pollAdd(const socket_t socket);
+        /*!
+         * @param[in] socket Socket identifier to add
+         * @param[in] listener True if the socket is one of our listeners
+         * @param[in] generation Generation of a connection's slot
+         */
+        bool pollAdd(
+                const socket_t socket,
+                bool listener=false,
+                uint32_t generation=0);
 
         //! Remove a socket identifier to the poll list
         bool pollDel(const socket_t socket);
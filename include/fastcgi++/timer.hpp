@@ -0,0 +1,575 @@
+/*!
+ * @file       timer.hpp
+ * @brief      Declares the TimingWheel and Timer classes
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#ifndef FASTCGIPP_TIMER_HPP
+#define FASTCGIPP_TIMER_HPP
+
+#include <chrono>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "fastcgi++/message.hpp"
+
+//! Topmost namespace for the fastcgi++ library
+namespace Fastcgipp
+{
+    //! Hierarchical timing wheel
+    /*!
+     * This is a container of timeouts that allows constant time insertion and
+     * cancellation regardless of how many timeouts are pending. Time is
+     * divided into ticks of a fixed resolution and the timeouts are
+     * distributed into four levels of 256 slots each. Level 0 holds everything
+     * expiring within 256 ticks of now, level 1 everything within 256² ticks
+     * and so on. As time advances the slots of the higher levels are cascaded
+     * down into the lower ones until they eventually expire out of level 0.
+     *
+     * All timeout nodes live in a single contiguous pool and are linked into
+     * their slots by index so an insertion doesn't hit the allocator once the
+     * pool has grown to it's working size. Handles carry a generation count so
+     * cancelling a timeout that has already expired is safe and does nothing.
+     *
+     * Timeouts never expire early. They expire on the first call to advance()
+     * at or after the tick they land in.
+     *
+     * <em>This class is not thread safe.</em>
+     *
+     * @tparam T Payload associated with each timeout. Must be default
+     *           constructible and movable.
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    template<class T> class TimingWheel
+    {
+    public:
+        //! Clock used for all timeouts
+        typedef std::chrono::steady_clock Clock;
+
+        //! Identifies a timeout for cancellation
+        typedef uint64_t Handle;
+
+        //! This handle never refers to a timeout
+        static const Handle invalid = 0xffffffffffffffffULL;
+
+        //! Sole constructor
+        /*!
+         * @param[in] resolution Length of a single tick.
+         */
+        TimingWheel(
+                Clock::duration resolution = std::chrono::milliseconds(1)):
+            m_resolution(resolution),
+            m_epoch(Clock::now()),
+            m_current(0),
+            m_free(npos),
+            m_size(0)
+        {
+            m_slots.fill(npos);
+            m_occupied.fill(0);
+        }
+
+        //! Schedule a timeout
+        /*!
+         * @param[in] expiry Time at which the timeout should expire
+         * @param[in] payload Data to hand back once it does
+         * @return Handle for cancelling the timeout
+         */
+        Handle insert(Clock::time_point expiry, T&& payload);
+
+        //! Cancel a pending timeout
+        /*!
+         * @param[in] handle Handle returned from insert()
+         * @return True if the timeout was pending and is now cancelled. False
+         *         if it had already expired or been cancelled.
+         */
+        bool cancel(Handle handle);
+
+        //! Expire all timeouts up to and including a point in time
+        /*!
+         * The payload of every expired timeout is moved onto the back of the
+         * expired container in order of expiry.
+         *
+         * @param[in] now Current time
+         * @param[out] expired Container to move expired payloads into
+         */
+        void advance(Clock::time_point now, std::vector<T>& expired);
+
+        //! When advance() next needs to be called
+        /*!
+         * This is never later than the earliest pending expiry but may be
+         * earlier if some timeouts need to be cascaded down a level first.
+         *
+         * @return Time point of the next tick with work to do. If there are no
+         *         timeouts pending, Clock::time_point::max() is returned.
+         */
+        Clock::time_point next() const;
+
+        //! How many timeouts are pending
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        //! True if no timeouts are pending
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+    private:
+        //! Bits of slot index per level
+        static const unsigned bits = 8;
+
+        //! Slots per level
+        static const unsigned slots = 1<<bits;
+
+        //! Number of levels
+        static const unsigned levels = 4;
+
+        //! Index value for the end of a list
+        static const uint32_t npos = 0xffffffffUL;
+
+        //! A single timeout
+        struct Node
+        {
+            //! Tick at which the timeout expires
+            uint64_t expiry;
+
+            //! Previous node in the slot (or free list)
+            uint32_t previous;
+
+            //! Next node in the slot (or free list)
+            uint32_t next;
+
+            //! Incremented each time the node is released
+            uint32_t generation;
+
+            //! Slot the node is linked into. npos if free.
+            uint32_t slot;
+
+            //! The payload itself
+            T payload;
+        };
+
+        //! Length of a tick
+        const Clock::duration m_resolution;
+
+        //! Time point of tick zero
+        const Clock::time_point m_epoch;
+
+        //! The last tick that has been processed
+        uint64_t m_current;
+
+        //! Pool of all nodes
+        std::vector<Node> m_nodes;
+
+        //! Head of the free node list
+        uint32_t m_free;
+
+        //! Head node of every slot in every level
+        std::array<uint32_t, levels*slots> m_slots;
+
+        //! Bitmap of non-empty slots
+        std::array<uint64_t, levels*slots/64> m_occupied;
+
+        //! Number of pending timeouts
+        size_t m_size;
+
+        //! Link a node into the slot it belongs in based on m_current
+        inline void place(uint32_t index);
+
+        //! Unlink a node from it's slot
+        inline void unlink(uint32_t index);
+
+        //! Release a node back into the free list
+        inline void release(uint32_t index);
+
+        //! Re-place all nodes in a slot
+        inline void cascade(uint32_t slot);
+
+        //! Find the next occupied slot in a level
+        /*!
+         * @param[in] level Level to search in
+         * @param[in] from Slot index to start searching from
+         * @return Distance in slots from the starting slot. If the level is
+         *         empty, slots is returned.
+         */
+        unsigned search(unsigned level, unsigned from) const;
+
+        //! Convert a time point to a tick (rounding up)
+        uint64_t tick(Clock::time_point time) const
+        {
+            if(time <= m_epoch)
+                return 0;
+            return (time-m_epoch+m_resolution-Clock::duration(1))
+                / m_resolution;
+        }
+    };
+
+    //! General purpose timer service
+    /*!
+     * Most requests that need to wait for a period of time or enforce some
+     * form of timeout end up needing some way of having a Message sent to them
+     * at a specific time. This class does exactly that from within it's own
+     * thread. Timeouts are stored in a TimingWheel so having hundreds of
+     * thousands of them pending at once is cheap, as is cancelling them before
+     * they expire.
+     *
+     * Everything but start() and stop() is thread safe.
+     *
+     * @date    October 17, 2026
+     * @author  Eddie Carle &lt;eddie@isatec.ca&gt;
+     */
+    class Timer
+    {
+    public:
+        //! Clock used for all timeouts
+        typedef std::chrono::steady_clock Clock;
+
+        //! Identifies a timeout for cancellation
+        typedef uint64_t Handle;
+
+        //! This handle never refers to a timeout
+        static const Handle invalid = 0xffffffffffffffffULL;
+
+        //! Sole constructor
+        /*!
+         * @param[in] resolution Timeouts will expire at most this long after
+         *                       the time they are scheduled for.
+         */
+        Timer(Clock::duration resolution = std::chrono::milliseconds(1));
+
+        ~Timer();
+
+        //! Send a message to a callback at a specific time
+        /*!
+         * @param[in] callback Function to pass the message to. Typically a
+         *                     Request's callback().
+         * @param[in] message Message to pass to the callback
+         * @param[in] wakeup When to pass it
+         * @return Handle to use with cancel()
+         */
+        Handle push(
+                const std::function<void(Message)>& callback,
+                Message&& message,
+                Clock::time_point wakeup);
+
+        //! Send a message to a callback after some period of time
+        /*!
+         * @param[in] callback Function to pass the message to. Typically a
+         *                     Request's callback().
+         * @param[in] message Message to pass to the callback
+         * @param[in] delay How long to wait before passing it
+         * @return Handle to use with cancel()
+         */
+        Handle push(
+                const std::function<void(Message)>& callback,
+                Message&& message,
+                Clock::duration delay)
+        {
+            return push(callback, std::move(message), Clock::now()+delay);
+        }
+
+        //! Cancel a pending timeout
+        /*!
+         * @param[in] handle Handle returned by push()
+         * @return True if the message had not yet been sent and now never will
+         *         be.
+         */
+        bool cancel(Handle handle);
+
+        //! How many timeouts are pending
+        size_t size() const;
+
+        //! Start the timer thread
+        /*!
+         * If the thread is already running this will do nothing.
+         */
+        void start();
+
+        //! Stop the timer thread
+        /*!
+         * Pending timeouts remain pending and will be delivered if the
+         * thread is started again.
+         */
+        void stop();
+
+    private:
+        //! A pending message
+        struct Item
+        {
+            std::function<void(Message)> callback;
+            Message message;
+        };
+
+        //! All our pending messages
+        TimingWheel<Item> m_wheel;
+
+        //! Thread safe the wheel
+        mutable std::mutex m_mutex;
+
+        //! Wake the timer thread
+        std::condition_variable m_wake;
+
+        //! When the timer thread is next going to wake up on it's own
+        Clock::time_point m_wakeup;
+
+        //! Set to true to stop the timer thread
+        bool m_kill;
+
+        //! Thread our timer is running in
+        std::thread m_thread;
+
+        //! Function that runs in the timer thread
+        void handler();
+    };
+}
+
+template<class T>
+const typename Fastcgipp::TimingWheel<T>::Handle
+Fastcgipp::TimingWheel<T>::invalid;
+
+template<class T> const uint32_t Fastcgipp::TimingWheel<T>::npos;
+
+template<class T> typename Fastcgipp::TimingWheel<T>::Handle
+Fastcgipp::TimingWheel<T>::insert(Clock::time_point expiry, T&& payload)
+{
+    uint32_t index;
+    if(m_free != npos)
+    {
+        index = m_free;
+        m_free = m_nodes[index].next;
+    }
+    else
+    {
+        index = m_nodes.size();
+        m_nodes.emplace_back();
+        m_nodes.back().generation = 0;
+    }
+
+    Node& node = m_nodes[index];
+    node.expiry = std::max(tick(expiry), m_current+1);
+    node.payload = std::move(payload);
+    place(index);
+    ++m_size;
+
+    return (Handle(node.generation)<<32) | index;
+}
+
+template<class T>
+bool Fastcgipp::TimingWheel<T>::cancel(Handle handle)
+{
+    const uint32_t index = handle & 0xffffffffUL;
+    if(
+            index >= m_nodes.size()
+            || m_nodes[index].generation != handle>>32
+            || m_nodes[index].slot == npos)
+        return false;
+
+    unlink(index);
+    m_nodes[index].payload = T();
+    release(index);
+    --m_size;
+    return true;
+}
+
+template<class T> void Fastcgipp::TimingWheel<T>::place(uint32_t index)
+{
+    Node& node = m_nodes[index];
+
+    // We allow expiry == m_current when cascading as the level 0 slot for
+    // m_current is processed right after
+    const uint64_t delta = node.expiry-m_current;
+    uint64_t expiry = node.expiry;
+
+    unsigned level=0;
+    while(level<levels && delta >= uint64_t(1)<<(bits*(level+1)))
+        ++level;
+    if(level == levels)
+    {
+        // Too far in the future. Park it in the furthest slot and it'll be
+        // re-placed when that slot cascades.
+        level = levels-1;
+        expiry = m_current+(uint64_t(1)<<(bits*levels))-1;
+    }
+
+    const uint32_t slot = level*slots + ((expiry>>(bits*level)) & (slots-1));
+    node.slot = slot;
+    node.previous = npos;
+    node.next = m_slots[slot];
+    if(node.next != npos)
+        m_nodes[node.next].previous = index;
+    m_slots[slot] = index;
+    m_occupied[slot/64] |= uint64_t(1)<<(slot%64);
+}
+
+template<class T> void Fastcgipp::TimingWheel<T>::unlink(uint32_t index)
+{
+    Node& node = m_nodes[index];
+
+    if(node.previous != npos)
+        m_nodes[node.previous].next = node.next;
+    else
+    {
+        m_slots[node.slot] = node.next;
+        if(node.next == npos)
+            m_occupied[node.slot/64] &= ~(uint64_t(1)<<(node.slot%64));
+    }
+    if(node.next != npos)
+        m_nodes[node.next].previous = node.previous;
+}
+
+template<class T> void Fastcgipp::TimingWheel<T>::release(uint32_t index)
+{
+    Node& node = m_nodes[index];
+    node.slot = npos;
+    ++node.generation;
+    node.next = m_free;
+    m_free = index;
+}
+
+template<class T> void Fastcgipp::TimingWheel<T>::cascade(uint32_t slot)
+{
+    uint32_t index = m_slots[slot];
+    m_slots[slot] = npos;
+    m_occupied[slot/64] &= ~(uint64_t(1)<<(slot%64));
+
+    while(index != npos)
+    {
+        const uint32_t next = m_nodes[index].next;
+        place(index);
+        index = next;
+    }
+}
+
+template<class T>
+unsigned Fastcgipp::TimingWheel<T>::search(unsigned level, unsigned from) const
+{
+    const uint64_t* const bitmap = m_occupied.data()+level*slots/64;
+    const unsigned words = slots/64;
+
+    for(unsigned i=0; i<=words; ++i)
+    {
+        const unsigned word = (from/64+i)%words;
+        uint64_t bitset = bitmap[word];
+        if(i==0)
+            bitset &= ~uint64_t(0) << (from%64);
+        else if(i==words)
+            bitset &= ~(~uint64_t(0) << (from%64));
+        if(bitset)
+        {
+            const unsigned slot = word*64 + __builtin_ctzll(bitset);
+            return (slot-from)%slots;
+        }
+    }
+    return slots;
+}
+
+template<class T> typename Fastcgipp::TimingWheel<T>::Clock::time_point
+Fastcgipp::TimingWheel<T>::next() const
+{
+    if(m_size == 0)
+        return Clock::time_point::max();
+
+    uint64_t next = 0xffffffffffffffffULL;
+
+    // Next tick with a level 0 slot to expire
+    {
+        const unsigned from = (m_current+1) & (slots-1);
+        const unsigned distance = search(0, from);
+        if(distance < slots)
+            next = m_current+1+distance;
+    }
+
+    // Next tick with a higher level slot to cascade
+    for(unsigned level=1; level<levels; ++level)
+    {
+        const unsigned shift = bits*level;
+        const uint64_t boundary = (m_current>>shift)+1;
+        const unsigned distance = search(level, boundary & (slots-1));
+        if(distance < slots)
+            next = std::min(next, (boundary+distance)<<shift);
+    }
+
+    return m_epoch + m_resolution*Clock::rep(next);
+}
+
+template<class T> void Fastcgipp::TimingWheel<T>::advance(
+        Clock::time_point now,
+        std::vector<T>& expired)
+{
+    // We want the last complete tick here so we round down
+    const uint64_t target = now<m_epoch?0:(now-m_epoch)/m_resolution;
+
+    while(m_current < target)
+    {
+        if(m_size == 0)
+        {
+            m_current = target;
+            break;
+        }
+
+        const Clock::time_point nextTime = next();
+        const uint64_t nextTick = (nextTime-m_epoch)/m_resolution;
+        if(nextTick > target)
+        {
+            m_current = target;
+            break;
+        }
+        m_current = nextTick;
+
+        // Cascade from the top down so nodes can fall more than one level
+        for(unsigned level=levels-1; level>0; --level)
+        {
+            const unsigned shift = bits*level;
+            if((m_current & ((uint64_t(1)<<shift)-1)) == 0)
+                cascade(level*slots + ((m_current>>shift) & (slots-1)));
+        }
+
+        const uint32_t slot = m_current & (slots-1);
+        uint32_t index = m_slots[slot];
+        m_slots[slot] = npos;
+        m_occupied[slot/64] &= ~(uint64_t(1)<<(slot%64));
+        while(index != npos)
+        {
+            Node& node = m_nodes[index];
+            const uint32_t next = node.next;
+            expired.push_back(std::move(node.payload));
+            node.payload = T();
+            release(index);
+            --m_size;
+            index = next;
+        }
+    }
+}
+
+#endif
@@ -41,6 +41,8 @@
 #include <thread>
 
 #include <fastcgi++/protocol.hpp>
+#include <fastcgi++/affinity.hpp>
+#include <fastcgi++/capture.hpp>
 
 //! Topmost namespace for the fastcgi++ library
 namespace Fastcgipp
@@ -117,16 +119,92 @@ namespace Fastcgipp
 
         ~Transceiver();
 
+        //! Set the connection timeouts
+        /*!
+         * These protect against connections that are left open or trickle in
+         * data slowly. A connection that exceeds any of them is closed and any
+         * requests associated with it are killed. A zero value disables that
+         * particular timeout, which is the default for all of them. Call this
+         * before start().
+         *
+         * @param[in] idle How long a connection can sit open with no requests
+         *                 in progress and no records partially received.
+         * @param[in] header How long the other side has to finish sending a
+         *                   record header once it has started.
+         * @param[in] body How long the other side has to finish sending a
+         *                 record's content once the header is received.
+         */
+        void setTimeouts(
+                SocketGroup::Clock::duration idle,
+                SocketGroup::Clock::duration header,
+                SocketGroup::Clock::duration body)
+        {
+            m_idleTimeout = idle;
+            m_headerTimeout = header;
+            m_bodyTimeout = body;
+            m_sockets.setAcceptTimeout(idle);
+        }
+
+        //! Limit how connections are accepted
+        /*!
+         * @sa SocketGroup::setAcceptLimits()
+         */
+        void setAcceptLimits(unsigned batch, unsigned rate, size_t connections)
+        {
+            m_sockets.setAcceptLimits(batch, rate, connections);
+        }
+
+        //! Pin our handler thread to CPUs
+        /*!
+         * Call this before start().
+         *
+         * @param[in] cpus CPUs to run on. Empty means no particular CPU.
+         * @param[in] incomingCpu If true, steer connections arriving on the
+         *                        first of the CPUs to our listeners.
+         */
+        void setAffinity(const CpuSet& cpus, bool incomingCpu)
+        {
+            m_cpus = cpus;
+            m_incomingCpu = incomingCpu;
+        }
+
+        //! Carry connections over something other than OS level sockets
+        /*!
+         * Call this before start(). The transport must outlive us. Listening
+         * and the other settings specific to sockets only apply to our own
+         * SocketGroup and do nothing for another transport.
+         *
+         * @param[in] transport Transport to use instead of our SocketGroup
+         */
+        void setTransport(Transport& transport)
+        {
+            m_transport = &transport;
+        }
+
+        //! Write all incoming records to a file
+        /*!
+         * Call this before start(). See Capture for the format and Replay for
+         * playing it back.
+         *
+         * @param[in] path File to write the capture to
+         * @return True if the file could be opened
+         */
+        bool capture(const char* path)
+        {
+            return m_capture.open(path);
+        }
+
         //! Listen to the default Fastcgi socket
         /*!
          * Calling this simply adds the default socket used on FastCGI
          * applications that are initialized from HTTP servers.
          *
+         * @param [in] options Tuning options for the socket
          * @return True on success. False on failure.
          */
-        bool listen()
+        bool listen(const ListenOptions& options = ListenOptions())
         {
-            return m_sockets.listen();
+            return m_sockets.listen(options);
         }
 
         //! Listen to a named socket
@@ -142,15 +220,17 @@ namespace Fastcgipp
          *                   do not wish to set it.
          * @param [in] group Group (group name) of socket. Leave as nullptr if
          *                   you do not wish to set it.
+         * @param [in] options Tuning options for the socket
          * @return True on success. False on failure.
          */
         bool listen(
                 const char* name,
                 uint32_t permissions = 0xffffffffUL,
                 const char* owner = nullptr,
-                const char* group = nullptr)
+                const char* group = nullptr,
+                const ListenOptions& options = ListenOptions())
         {
-            return m_sockets.listen(name, permissions, owner, group);
+            return m_sockets.listen(name, permissions, owner, group, options);
         }
 
         //! Listen to a TCP port
@@ -163,18 +243,54 @@ namespace Fastcgipp
          * @param [in] service Port or service to listen on. This could be a
          *                     service name, or a string representation of a
          *                     port number.
+         * @param [in] options Tuning options for the socket
          * @return True on success. False on failure.
          */
         bool listen(
                 const char* interface,
-                const char* service)
+                const char* service,
+                const ListenOptions& options = ListenOptions())
+        {
+            return m_sockets.listen(interface, service, options);
+        }
+
+        //! Listen on a socket that is already listening
+        bool adopt(socket_t listener)
+        {
+            return m_sockets.adopt(listener);
+        }
+
+        //! Listen on sockets passed to us by systemd
+        bool listenActivated(const char* name)
+        {
+            return m_sockets.listenActivated(name);
+        }
+
+        //! The sockets we listen for connections on
+        const std::set<socket_t>& listeners() const
+        {
+            return m_sockets.listeners();
+        }
+
+        //! Mark all our listeners as shared with other processes
+        void share()
         {
-            return m_sockets.listen(interface, service);
+            m_sockets.share();
         }
 
     private:
-        //! Container associating sockets with their receive buffers
-        std::map<Socket, std::vector<char>> m_receiveBuffers;
+        //! What a connection is currently waiting on
+        enum class Waiting
+        {
+            //! Nothing. Requests are in progress.
+            NOTHING,
+            //! A new record or request
+            IDLE,
+            //! The rest of a record header
+            HEADER,
+            //! The rest of a record's content
+            BODY
+        };
 
         //! Simple FastCGI record to queue up for transmission
         struct Record
@@ -195,7 +311,82 @@ namespace Fastcgipp
             {}
         };
 
-        //! %Buffer for transmitting data
+        //! State of a connection
+        struct Connection
+        {
+            //! %Buffer for the record currently being received
+            std::vector<char> buffer;
+
+            //! Number of requests received that haven't been completed
+            unsigned requests;
+
+            //! What the connection's timeout is currently set for
+            Waiting waiting;
+
+            //! Data waiting to be transmitted for each request
+            std::map<Protocol::FcgiId, std::list<std::unique_ptr<Record>>>
+                output;
+
+            //! Requests in #output in the order they get to transmit
+            /*!
+             * Requests take turns a FastCGI record at a time so a big response
+             * can't hold up the others multiplexed over the same connection.
+             */
+            std::deque<Protocol::FcgiId> turns;
+
+            //! Records gathered from #output to go out in a single write
+            std::vector<char> batch;
+
+            //! How much of #batch has been written
+            size_t sent;
+
+            //! Close the connection once #batch is written
+            bool kill;
+
+            //! Identifies the connection in #m_capture. Zero until assigned.
+            std::uint32_t capture;
+
+            Connection():
+                requests(0),
+                waiting(Waiting::IDLE),
+                sent(0),
+                kill(false),
+                capture(0)
+            {}
+        };
+
+        //! Container associating sockets with their state
+        std::map<Socket, Connection> m_connections;
+
+        //! Connections with data waiting to be transmitted
+        std::deque<Socket> m_writing;
+
+        //! Connection idle timeout
+        SocketGroup::Clock::duration m_idleTimeout;
+
+        //! Record header receive timeout
+        SocketGroup::Clock::duration m_headerTimeout;
+
+        //! Record content receive timeout
+        SocketGroup::Clock::duration m_bodyTimeout;
+
+        //! CPUs our handler thread runs on
+        CpuSet m_cpus;
+
+        //! Steer connections to the first of #m_cpus with SO_INCOMING_CPU
+        bool m_incomingCpu;
+
+        //! Set the timeout appropriate for a connection's current state
+        /*!
+         * The timeout is only reset when the connection changes state so that
+         * trickling data in doesn't keep extending it.
+         */
+        inline void updateTimeout(const Socket& socket, Connection& connection);
+
+        //! Cleanup all sockets whose timeouts have passed
+        inline void expire();
+
+        //! Data queued by send() not yet handed to it's connection
         std::deque<std::unique_ptr<Record>> m_sendBuffer;
 
         //! Thread safe the send buffer
@@ -207,12 +398,29 @@ namespace Fastcgipp
         //! Listen for connections with this
         SocketGroup m_sockets;
 
+        //! Where our connections come from. Normally #m_sockets.
+        Transport* m_transport;
+
+        //! Incoming records get written here if it's active
+        Capture m_capture;
+
         //! Transmit all buffered data possible
         /*!
+         * A connection that can't take any more doesn't hold up the others.
+         *
          * @return True if we successfully sent all data that was queued up.
          */
         inline bool transmit();
 
+        //! Transmit all buffered data possible on a single connection
+        /*!
+         * Small records from any number of requests are gathered up so they
+         * cost a single write.
+         *
+         * @return True if we successfully sent all data that was queued up.
+         */
+        inline bool transmit(const Socket& socket, Connection& connection);
+
         //! Receive data on the specified socket.
         inline void receive(Socket& socket);
 
@@ -243,6 +451,15 @@ namespace Fastcgipp
 
         //! Debug counter for bytes received
         std::atomic_ullong m_recordsReceived;
+
+        //! Debug counter for connections that were idle too long
+        std::atomic_ullong m_idleTimeoutCount;
+
+        //! Debug counter for connections too slow sending a header
+        std::atomic_ullong m_headerTimeoutCount;
+
+        //! Debug counter for connections too slow sending content
+        std::atomic_ullong m_bodyTimeoutCount;
 #endif
     };
 }
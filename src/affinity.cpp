@@ -0,0 +1,93 @@
+/*!
+ * @file       affinity.cpp
+ * @brief      Defines CPU affinity functions
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/affinity.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+
+Fastcgipp::CpuSet Fastcgipp::nodeCpus(unsigned node)
+{
+    CpuSet cpus;
+
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+    std::ifstream file(path.str());
+
+    // The list looks like "0-3,8-11"
+    std::string range;
+    while(std::getline(file, range, ','))
+    {
+        unsigned first;
+        unsigned last;
+        char dash;
+        std::istringstream stream(range);
+        if(!(stream >> first))
+            break;
+        if(stream >> dash >> last)
+        {
+            if(dash != '-' || last < first)
+                break;
+        }
+        else
+            last = first;
+
+        for(unsigned cpu=first; cpu<=last; ++cpu)
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+bool Fastcgipp::pinThread(const CpuSet& cpus)
+{
+    if(cpus.empty())
+        return true;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(const auto cpu: cpus)
+        if(cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+
+    const int result = pthread_setaffinity_np(
+            pthread_self(),
+            sizeof(set),
+            &set);
+    if(result != 0)
+    {
+        WARNING_LOG("Unable to set thread affinity: " << std::strerror(result))
+        return false;
+    }
+    return true;
+}
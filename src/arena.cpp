@@ -0,0 +1,154 @@
+/*!
+ * @file       arena.cpp
+ * @brief      Defines the Arena class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/arena.hpp"
+
+#include <new>
+#include <algorithm>
+
+const size_t Fastcgipp::Arena::minChunk;
+const size_t Fastcgipp::Arena::maxChunk;
+
+namespace
+{
+    //! Per thread free lists of released chunks
+    class FreeLists
+    {
+    public:
+        FreeLists()
+        {
+            std::fill(m_heads, m_heads+sizeClasses, nullptr);
+            std::fill(m_counts, m_counts+sizeClasses, 0);
+        }
+
+        ~FreeLists()
+        {
+            for(Node* head: m_heads)
+                while(head != nullptr)
+                {
+                    Node* const next = head->next;
+                    ::operator delete(head);
+                    head = next;
+                }
+        }
+
+        //! Take a chunk of a given size or nullptr if we have none
+        void* take(size_t size)
+        {
+            const unsigned sizeClass = index(size);
+            if(sizeClass >= sizeClasses || m_heads[sizeClass] == nullptr)
+                return nullptr;
+
+            Node* const node = m_heads[sizeClass];
+            m_heads[sizeClass] = node->next;
+            --m_counts[sizeClass];
+            return node;
+        }
+
+        //! Keep a chunk for later. False if it should be freed.
+        bool give(void* chunk, size_t size)
+        {
+            const unsigned sizeClass = index(size);
+            if(sizeClass >= sizeClasses || m_counts[sizeClass] == maxCount)
+                return false;
+
+            Node* const node = static_cast<Node*>(chunk);
+            node->next = m_heads[sizeClass];
+            m_heads[sizeClass] = node;
+            ++m_counts[sizeClass];
+            return true;
+        }
+
+    private:
+        struct Node
+        {
+            Node* next;
+        };
+
+        //! Chunk sizes from minChunk to maxChunk
+        static const unsigned sizeClasses = 9;
+
+        //! Most chunks to keep of each size
+        static const unsigned maxCount = 32;
+
+        static unsigned index(size_t size)
+        {
+            unsigned sizeClass = 0;
+            for(size /= Fastcgipp::Arena::minChunk; size > 1; size >>= 1)
+                ++sizeClass;
+            return sizeClass;
+        }
+
+        Node* m_heads[sizeClasses];
+        unsigned m_counts[sizeClasses];
+    };
+
+    thread_local FreeLists freeLists;
+}
+
+void Fastcgipp::Arena::release()
+{
+    while(m_chunk != nullptr)
+    {
+        Chunk* const previous = m_chunk->previous;
+        if(!freeLists.give(m_chunk, m_chunk->size))
+            ::operator delete(m_chunk);
+        m_chunk = previous;
+    }
+    m_current = nullptr;
+    m_end = nullptr;
+}
+
+size_t Fastcgipp::Arena::capacity() const
+{
+    size_t capacity = 0;
+    for(const Chunk* chunk = m_chunk; chunk != nullptr; chunk = chunk->previous)
+        capacity += chunk->size;
+    return capacity;
+}
+
+void* Fastcgipp::Arena::grow(size_t size, size_t alignment)
+{
+    size_t chunkSize = m_chunk == nullptr ?
+        minChunk:std::min(m_chunk->size*2, maxChunk);
+    while(chunkSize < sizeof(Chunk)+size+alignment)
+        chunkSize *= 2;
+
+    void* memory = freeLists.take(chunkSize);
+    if(memory == nullptr)
+        memory = ::operator new(chunkSize);
+
+    Chunk* const chunk = static_cast<Chunk*>(memory);
+    chunk->previous = m_chunk;
+    chunk->size = chunkSize;
+    m_chunk = chunk;
+    m_current = reinterpret_cast<char*>(chunk+1);
+    m_end = reinterpret_cast<char*>(chunk)+chunkSize;
+
+    return allocate(size, alignment);
+}
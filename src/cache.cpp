@@ -0,0 +1,367 @@
+/*!
+ * @file       cache.cpp
+ * @brief      Defines the ResponseCache class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/cache.hpp"
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <cstring>
+#include <cctype>
+
+class Fastcgipp::ResponseCache::Capture
+{
+public:
+    Capture(ResponseCache& cache, const std::string& key, const Send& send):
+        m_cache(cache),
+        m_key(key),
+        m_send(send),
+        m_records(new std::vector<char>),
+        m_done(false)
+    {}
+
+    ~Capture()
+    {
+        if(!m_done)
+            m_cache.abandon(m_key);
+    }
+
+    void operator()(const Socket& socket, std::vector<char>&& data, bool kill)
+    {
+        for(
+                auto record = data.cbegin();
+                !m_done && record != data.cend();)
+        {
+            const Protocol::Header& header = *(const Protocol::Header*)&*record;
+            const auto next = record
+                +sizeof(Protocol::Header)
+                +header.contentLength
+                +header.paddingLength;
+
+            if(header.type == Protocol::RecordType::OUT && m_records)
+            {
+                if(m_records->size()+(next-record) > m_cache.m_maxEntry)
+                    m_records.reset();
+                else
+                    m_records->insert(m_records->end(), record, next);
+            }
+            else if(header.type == Protocol::RecordType::END_REQUEST)
+            {
+                const Protocol::EndRequest& body =
+                    *(const Protocol::EndRequest*)&*(
+                            record+sizeof(Protocol::Header));
+                m_done = true;
+
+                // Aborted requests end with a non-zero application status
+                if(body.protocolStatus
+                        != Protocol::ProtocolStatus::REQUEST_COMPLETE
+                        || body.appStatus != 0)
+                    m_cache.abandon(m_key);
+                else
+                {
+                    if(!cacheable())
+                        m_records.reset();
+                    m_cache.store(m_key, std::move(m_records));
+                }
+            }
+            record = next;
+        }
+
+        m_send(socket, std::move(data), kill);
+    }
+
+private:
+    //! Can the response be shared from the cache?
+    /*!
+     * The response must have no status or a 200 status, no Set-Cookie header
+     * and no Cache-Control header with no-store, no-cache or private.
+     */
+    bool cacheable() const
+    {
+        if(!m_records || m_records->empty())
+            return false;
+
+        // The headers can span records so gather them up first
+        std::string headers;
+        for(auto record = m_records->cbegin(); record != m_records->cend();)
+        {
+            const Protocol::Header& header = *(const Protocol::Header*)&*record;
+            const auto content = record+sizeof(Protocol::Header);
+            headers.append(content, content+header.contentLength);
+            if(headers.find("\n\n") != std::string::npos
+                    || headers.find("\n\r\n") != std::string::npos)
+                break;
+            record = content+header.contentLength+header.paddingLength;
+        }
+
+        size_t lineStart = 0;
+        while(lineStart < headers.size())
+        {
+            size_t lineEnd = headers.find('\n', lineStart);
+            if(lineEnd == std::string::npos)
+                lineEnd = headers.size();
+            std::string line(headers, lineStart, lineEnd-lineStart);
+            lineStart = lineEnd+1;
+
+            if(!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if(line.empty())
+                break;
+
+            const size_t colon = line.find(':');
+            if(colon == std::string::npos)
+                continue;
+            for(auto& c: line)
+                c = std::tolower(static_cast<unsigned char>(c));
+            const std::string name(line, 0, colon);
+            const size_t valueStart = line.find_first_not_of(' ', colon+1);
+            const std::string value(
+                    line,
+                    valueStart == std::string::npos ? line.size():valueStart);
+
+            if(name == "status" && value.compare(0, 3, "200") != 0)
+                return false;
+            if(name == "set-cookie")
+                return false;
+            if(name == "cache-control" && (
+                        value.find("no-store") != std::string::npos
+                        || value.find("no-cache") != std::string::npos
+                        || value.find("private") != std::string::npos))
+                return false;
+        }
+        return true;
+    }
+
+    ResponseCache& m_cache;
+    const std::string m_key;
+    const Send m_send;
+    std::shared_ptr<std::vector<char>> m_records;
+    bool m_done;
+};
+
+Fastcgipp::ResponseCache::ResponseCache(
+        size_t capacity,
+        Timer::Clock::duration ttl,
+        size_t maxEntry,
+        Timer::Clock::duration pass):
+    m_capacity(capacity),
+    m_ttl(ttl),
+    m_pass(pass),
+    m_maxEntry(maxEntry==0 ? capacity/8 : std::min(maxEntry, capacity)),
+    m_size(0)
+#if FASTCGIPP_LOG_LEVEL > 3
+    ,m_hitCount(0),
+    m_missCount(0),
+    m_waitCount(0),
+    m_passCount(0),
+    m_evictCount(0)
+#endif
+{}
+
+Fastcgipp::ResponseCache::~ResponseCache()
+{
+    DIAG_LOG("ResponseCache::~ResponseCache(): Hits ===================== " \
+            << m_hitCount)
+    DIAG_LOG("ResponseCache::~ResponseCache(): Misses =================== " \
+            << m_missCount)
+    DIAG_LOG("ResponseCache::~ResponseCache(): Collapsed misses ========= " \
+            << m_waitCount)
+    DIAG_LOG("ResponseCache::~ResponseCache(): Passed misses ============ " \
+            << m_passCount)
+    DIAG_LOG("ResponseCache::~ResponseCache(): Evictions ================ " \
+            << m_evictCount)
+    DIAG_LOG("ResponseCache::~ResponseCache(): Cached bytes ============= " \
+            << m_size)
+}
+
+void Fastcgipp::ResponseCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto entry = m_entries.begin(); entry != m_entries.end();)
+    {
+        if(entry->second.generating)
+            ++entry;
+        else
+        {
+            drop(entry->second);
+            entry = m_entries.erase(entry);
+        }
+    }
+}
+
+Fastcgipp::ResponseCache::Result Fastcgipp::ResponseCache::lookup(
+        PendingRequest& pending,
+        std::string& key,
+        std::shared_ptr<const std::vector<char>>& records)
+{
+    key = pending.parameter("REQUEST_METHOD");
+    if(key != "GET" && key != "HEAD")
+        return Result::BYPASS;
+
+    key += '\0';
+    key += pending.parameter("REQUEST_URI");
+    for(const auto& parameter: m_vary)
+    {
+        key += '\0';
+        key += pending.parameter(parameter.c_str());
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto entry = m_entries.find(key);
+    if(entry == m_entries.end())
+    {
+#if FASTCGIPP_LOG_LEVEL > 3
+        ++m_missCount;
+#endif
+        m_entries.emplace(
+                std::piecewise_construct,
+                std::forward_as_tuple(key),
+                std::forward_as_tuple());
+        return Result::GENERATE;
+    }
+
+    if(entry->second.generating)
+    {
+#if FASTCGIPP_LOG_LEVEL > 3
+        ++m_waitCount;
+#endif
+        entry->second.waiters.push_back(pending.callback());
+        return Result::WAIT;
+    }
+
+    if(Timer::Clock::now() >= entry->second.expiry)
+    {
+#if FASTCGIPP_LOG_LEVEL > 3
+        ++m_missCount;
+#endif
+        drop(entry->second);
+        entry->second.generating = true;
+        return Result::GENERATE;
+    }
+
+    // Recently found not to be cacheable so don't collapse onto anyone
+    if(!entry->second.records)
+    {
+#if FASTCGIPP_LOG_LEVEL > 3
+        ++m_passCount;
+#endif
+        return Result::BYPASS;
+    }
+
+#if FASTCGIPP_LOG_LEVEL > 3
+    ++m_hitCount;
+#endif
+    m_lru.splice(m_lru.end(), m_lru, entry->second.lru);
+    records = entry->second.records;
+    return Result::HIT;
+}
+
+Fastcgipp::ResponseCache::Send Fastcgipp::ResponseCache::capture(
+        const std::string& key,
+        const Send& send)
+{
+    std::shared_ptr<Capture> capture(new Capture(*this, key, send));
+    return [capture] (
+            const Socket& socket,
+            std::vector<char>&& data,
+            bool kill)
+    {
+        (*capture)(socket, std::move(data), kill);
+    };
+}
+
+void Fastcgipp::ResponseCache::abandon(const std::string& key)
+{
+    std::vector<std::function<void(Message)>> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto entry = m_entries.find(key);
+        if(entry == m_entries.end())
+            return;
+
+        waiters.swap(entry->second.waiters);
+        m_entries.erase(entry);
+    }
+
+    for(const auto& waiter: waiters)
+        waiter(Message(1));
+}
+
+void Fastcgipp::ResponseCache::store(
+        const std::string& key,
+        std::shared_ptr<const std::vector<char>>&& records)
+{
+    std::vector<std::function<void(Message)>> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto entry = m_entries.find(key);
+        if(entry == m_entries.end())
+            return;
+
+        waiters.swap(entry->second.waiters);
+        entry->second.generating = false;
+        entry->second.lru = m_lru.insert(m_lru.end(), key);
+        if(records)
+        {
+            entry->second.expiry = Timer::Clock::now()+m_ttl;
+            entry->second.size = records->size();
+            entry->second.records = std::move(records);
+        }
+        else
+        {
+            // A pass marker only costs it's key
+            entry->second.expiry = Timer::Clock::now()+m_pass;
+            entry->second.size = key.size();
+        }
+        m_size += entry->second.size;
+
+        // Make room by evicting the least recently used
+        while(m_size > m_capacity)
+        {
+#if FASTCGIPP_LOG_LEVEL > 3
+            ++m_evictCount;
+#endif
+            auto victim = m_entries.find(m_lru.front());
+            drop(victim->second);
+            m_entries.erase(victim);
+        }
+    }
+
+    for(const auto& waiter: waiters)
+        waiter(Message(1));
+}
+
+void Fastcgipp::ResponseCache::drop(Entry& entry)
+{
+    if(!entry.generating)
+    {
+        m_size -= entry.size;
+        entry.size = 0;
+        entry.records.reset();
+        m_lru.erase(entry.lru);
+    }
+}
@@ -0,0 +1,364 @@
+/*!
+ * @file       capture.cpp
+ * @brief      Defines the Capture and Replay classes
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/capture.hpp"
+#include "fastcgi++/protocol.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <map>
+#include <set>
+#include <deque>
+#include <thread>
+#include <algorithm>
+
+namespace
+{
+    //! Write an integer as little endian bytes
+    template<typename T> void encode(char* destination, T value)
+    {
+        for(unsigned i=0; i<sizeof(T); ++i)
+            destination[i] = static_cast<char>(value >> (8*i));
+    }
+
+    //! Read an integer from little endian bytes
+    template<typename T> T decode(const char* source)
+    {
+        T value = 0;
+        for(unsigned i=0; i<sizeof(T); ++i)
+            value |= T(static_cast<unsigned char>(source[i])) << (8*i);
+        return value;
+    }
+
+    //! Playback state of a single captured connection
+    struct Stream
+    {
+        //! Our end of the Loopback connection
+        Fastcgipp::Loopback::Client client;
+
+        //! Records held back until the request they reuse the id of ends
+        std::deque<std::pair<const char*, size_t>> queued;
+
+        //! Requests started that haven't been ended
+        std::set<Fastcgipp::Protocol::FcgiId> active;
+
+        //! Records waiting to be written
+        std::vector<char> pending;
+
+        //! How much of #pending has been written
+        size_t written;
+
+        //! Response data not yet making up a complete record
+        std::vector<char> incoming;
+
+        //! Close once everything is written and all requests are ended
+        bool closing;
+
+        Stream(Fastcgipp::Loopback::Client&& client_):
+            client(std::move(client_)),
+            written(0),
+            closing(false)
+        {}
+
+        //! Move queued records to #pending until one has to wait
+        /*!
+         * The client that was captured only reused a FastCGI id once the
+         * earlier request with it had ended. The replay has to wait for
+         * that too or the records of two requests get mixed up.
+         *
+         * @return Number of requests started
+         */
+        unsigned release()
+        {
+            unsigned started = 0;
+            while(!queued.empty())
+            {
+                const char* const record = queued.front().first;
+                const size_t size = queued.front().second;
+                if(size == 0)
+                    closing = true;
+                else
+                {
+                    const Fastcgipp::Protocol::Header& header =
+                        *(const Fastcgipp::Protocol::Header*)record;
+                    if(header.type
+                            == Fastcgipp::Protocol::RecordType::BEGIN_REQUEST)
+                    {
+                        if(!active.insert(header.fcgiId).second)
+                            break;
+                        ++started;
+                    }
+                    pending.insert(pending.end(), record, record+size);
+                }
+                queued.pop_front();
+            }
+            return started;
+        }
+
+        //! Nothing is left to send and no requests are waiting to end
+        bool idle() const
+        {
+            return queued.empty() && active.empty() && pending.empty();
+        }
+    };
+}
+
+const char Fastcgipp::Capture::magic[8] =
+    {'F', 'C', 'G', 'I', 'C', 'A', 'P', '1'};
+
+bool Fastcgipp::Capture::open(const char* path)
+{
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if(!m_file)
+    {
+        ERROR_LOG("Unable to open capture file " << path)
+        m_file.close();
+        return false;
+    }
+    m_file.write(magic, sizeof(magic));
+    m_start = std::chrono::steady_clock::now();
+    m_connections = 0;
+    return true;
+}
+
+void Fastcgipp::Capture::record(
+        std::uint32_t connection,
+        const char* data,
+        size_t size)
+{
+    const std::uint64_t time =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now()-m_start).count();
+
+    char header[eventHeaderSize];
+    encode<std::uint64_t>(header, time);
+    encode<std::uint32_t>(header+8, connection);
+    encode<std::uint32_t>(header+12, static_cast<std::uint32_t>(size));
+
+    m_file.write(header, sizeof(header));
+    m_file.write(data, size);
+}
+
+bool Fastcgipp::Replay::load(const char* path)
+{
+    m_events.clear();
+    m_data.clear();
+
+    std::ifstream file(path, std::ios::binary);
+    char header[Capture::eventHeaderSize];
+    if(!file.read(header, sizeof(Capture::magic))
+            || !std::equal(
+                Capture::magic,
+                Capture::magic+sizeof(Capture::magic),
+                header))
+    {
+        ERROR_LOG("Unable to load capture file " << path)
+        return false;
+    }
+
+    while(file.read(header, sizeof(header)))
+    {
+        Event event;
+        event.time = std::chrono::nanoseconds(
+                decode<std::uint64_t>(header));
+        event.connection = decode<std::uint32_t>(header+8);
+        event.offset = m_data.size();
+        event.size = decode<std::uint32_t>(header+12);
+
+        m_data.resize(event.offset+event.size);
+        if(!file.read(m_data.data()+event.offset, event.size))
+        {
+            WARNING_LOG("Capture file " << path << " is truncated")
+            m_data.resize(event.offset);
+            break;
+        }
+        m_events.push_back(event);
+    }
+
+    return true;
+}
+
+Fastcgipp::Replay::Statistics Fastcgipp::Replay::play(
+        Loopback& loopback,
+        double speed,
+        std::chrono::steady_clock::duration timeout) const
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Statistics stats;
+    stats.connections = 0;
+    stats.requests = 0;
+    stats.completed = 0;
+    stats.sent = 0;
+    stats.received = 0;
+    stats.lag = Clock::duration::zero();
+
+    std::map<std::uint32_t, Stream> streams;
+    std::vector<char> chunk(0x10000);
+
+    // Move data both ways on every stream. Returns true if anything moved
+    // and sets busy if any stream is still waiting on the Manager.
+    bool busy;
+    const auto pump = [&] () -> bool
+    {
+        bool progress = false;
+        busy = false;
+        for(auto it = streams.begin(); it != streams.end();)
+        {
+            Stream& stream = it->second;
+
+            if(stream.written < stream.pending.size())
+            {
+                const size_t written = stream.client.write(
+                        stream.pending.data()+stream.written,
+                        stream.pending.size()-stream.written);
+                stream.written += written;
+                stats.sent += written;
+                progress = progress || written;
+                if(stream.written == stream.pending.size())
+                {
+                    stream.pending.clear();
+                    stream.written = 0;
+                }
+            }
+
+            size_t read;
+            while((read = stream.client.read(chunk.data(), chunk.size())))
+            {
+                stream.incoming.insert(
+                        stream.incoming.end(),
+                        chunk.data(),
+                        chunk.data()+read);
+                stats.received += read;
+                progress = true;
+            }
+
+            size_t position = 0;
+            while(stream.incoming.size()-position >= sizeof(Protocol::Header))
+            {
+                const Protocol::Header& header =
+                    *(const Protocol::Header*)(
+                            stream.incoming.data()+position);
+                const size_t size = sizeof(Protocol::Header)
+                    + header.contentLength
+                    + header.paddingLength;
+                if(stream.incoming.size()-position < size)
+                    break;
+                if(header.type == Protocol::RecordType::END_REQUEST
+                        && stream.active.erase(header.fcgiId))
+                {
+                    ++stats.completed;
+                    stats.requests += stream.release();
+                }
+                position += size;
+            }
+            stream.incoming.erase(
+                    stream.incoming.begin(),
+                    stream.incoming.begin()+position);
+
+            if(stream.client.closed() || (stream.closing && stream.idle()))
+                it = streams.erase(it);
+            else
+            {
+                busy = busy || !stream.idle();
+                ++it;
+            }
+        }
+        return progress;
+    };
+
+    const Clock::time_point start = Clock::now();
+
+    for(const Event& event: m_events)
+    {
+        if(speed > 0)
+        {
+            const Clock::time_point due = start
+                + std::chrono::duration_cast<Clock::duration>(
+                        event.time/speed);
+            Clock::time_point now;
+            while((now = Clock::now()) < due)
+                if(!pump())
+                {
+                    if(busy)
+                        std::this_thread::yield();
+                    else
+                        std::this_thread::sleep_until(due);
+                }
+            stats.lag = std::max(stats.lag, now-due);
+        }
+
+        auto it = streams.find(event.connection);
+        if(event.size == 0)
+        {
+            if(it != streams.end())
+            {
+                it->second.queued.emplace_back(nullptr, 0);
+                it->second.release();
+            }
+        }
+        else
+        {
+            if(it == streams.end())
+            {
+                it = streams.emplace(
+                        event.connection,
+                        Stream(loopback.connect())).first;
+                ++stats.connections;
+            }
+            it->second.queued.emplace_back(
+                    m_data.data()+event.offset,
+                    event.size);
+            stats.requests += it->second.release();
+        }
+
+        pump();
+    }
+
+    // Whatever is left gets closed once it's done
+    for(auto& stream: streams)
+        stream.second.closing = true;
+
+    Clock::time_point progressed = Clock::now();
+    while(!streams.empty())
+    {
+        const Clock::time_point now = Clock::now();
+        if(pump())
+            progressed = now;
+        else if(now-progressed > timeout)
+        {
+            WARNING_LOG("Replay gave up on " << streams.size() \
+                    << " connections")
+            break;
+        }
+        else
+            std::this_thread::yield();
+    }
+
+    stats.elapsed = Clock::now()-start;
+    return stats;
+}
@@ -0,0 +1,622 @@
+/*!
+ * @file       client.cpp
+ * @brief      Defines the Fastcgipp::Client class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/client.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    //! Most content a single record can carry
+    const size_t maxContent = 0xffff;
+
+    //! Encodes a stream directly into records
+    /*!
+     * Data is split over as many records as needed and the stream is
+     * terminated with an empty record by finish(). FcgiIds are left as zero.
+     */
+    class StreamEncoder
+    {
+    public:
+        StreamEncoder(
+                std::vector<char>& records,
+                Fastcgipp::Protocol::RecordType type):
+            m_records(records),
+            m_type(type)
+        {
+            open();
+        }
+
+        //! Append data to the stream
+        void write(const char* data, size_t size)
+        {
+            while(size > 0)
+            {
+                const size_t room = maxContent - content();
+                if(room == 0)
+                {
+                    close();
+                    open();
+                    continue;
+                }
+                const size_t chunk = std::min(room, size);
+                m_records.insert(m_records.end(), data, data+chunk);
+                data += chunk;
+                size -= chunk;
+            }
+        }
+
+        //! Start a new record if the data won't fit in the current one
+        /*!
+         * Data bigger than a record is left to be split.
+         */
+        void keep(size_t size)
+        {
+            if(size <= maxContent && size > maxContent-content())
+            {
+                close();
+                open();
+            }
+        }
+
+        //! Append a name-value pair length
+        void length(size_t size)
+        {
+            if(size < 0x80)
+            {
+                const char byte = char(size);
+                write(&byte, 1);
+            }
+            else
+            {
+                const char bytes[4] = {
+                    char(((size>>24)&0x7f)|0x80),
+                    char((size>>16)&0xff),
+                    char((size>>8)&0xff),
+                    char(size&0xff)};
+                write(bytes, sizeof(bytes));
+            }
+        }
+
+        //! Close the last record and terminate the stream
+        /*!
+         * @param[in] stream False if the record type isn't a stream and
+         *                   shouldn't be terminated.
+         */
+        void finish(bool stream=true)
+        {
+            const bool empty = content() == 0;
+            close();
+            if(stream && !empty)
+            {
+                open();
+                close();
+            }
+        }
+
+    private:
+        std::vector<char>& m_records;
+        const Fastcgipp::Protocol::RecordType m_type;
+
+        //! Offset of the current record's header
+        size_t m_header;
+
+        //! Size of the current record's content so far
+        size_t content() const
+        {
+            return m_records.size()
+                - m_header
+                - sizeof(Fastcgipp::Protocol::Header);
+        }
+
+        void open()
+        {
+            m_header = m_records.size();
+            m_records.resize(m_header+sizeof(Fastcgipp::Protocol::Header));
+        }
+
+        void close()
+        {
+            Fastcgipp::Protocol::Header& header =
+                *(Fastcgipp::Protocol::Header*)(m_records.data()+m_header);
+            header.version = Fastcgipp::Protocol::version;
+            header.type = m_type;
+            header.fcgiId = 0;
+            header.contentLength = uint16_t(content());
+            header.paddingLength = 0;
+            header.reserved = 0;
+        }
+    };
+
+    //! Size of a stream once encoded into records
+    size_t encodedSize(size_t content)
+    {
+        return content
+            + (content/maxContent+2)*sizeof(Fastcgipp::Protocol::Header);
+    }
+}
+
+Fastcgipp::Client::Client(unsigned connections, unsigned requests):
+    m_maxConnections(std::max(connections, 1U)),
+    m_maxRequests(std::min(std::max(requests, 1U), 0xfffeU)),
+    m_active(0),
+    m_connectFailed(false),
+    m_terminate(false),
+    m_stop(false)
+#if FASTCGIPP_LOG_LEVEL > 3
+    ,m_requestCount(0),
+    m_completeCount(0),
+    m_failCount(0),
+    m_connectionCount(0)
+#endif
+{}
+
+Fastcgipp::Client::~Client()
+{
+    terminate();
+    join();
+    DIAG_LOG("Client::~Client(): Requests queued ===== " << m_requestCount)
+    DIAG_LOG("Client::~Client(): Requests completed == " << m_completeCount)
+    DIAG_LOG("Client::~Client(): Requests failed ===== " << m_failCount)
+    DIAG_LOG("Client::~Client(): Connections opened == " << m_connectionCount)
+}
+
+void Fastcgipp::Client::server(const char* host, const char* service)
+{
+    m_host = host;
+    m_service = service;
+}
+
+void Fastcgipp::Client::server(const char* name)
+{
+    m_host = name;
+    m_service.clear();
+}
+
+void Fastcgipp::Client::request(
+        const Parameters& parameters,
+        const char* in,
+        size_t size,
+        Callback callback)
+{
+    Job job;
+    job.callback = std::move(callback);
+
+    size_t parametersSize = 0;
+    for(const auto& parameter: parameters)
+        parametersSize += parameter.first.size()+parameter.second.size()+8;
+    job.records.reserve(
+            sizeof(Protocol::Header)
+            + sizeof(Protocol::BeginRequest)
+            + encodedSize(parametersSize)
+            + encodedSize(size));
+
+    {
+        StreamEncoder begin(job.records, Protocol::RecordType::BEGIN_REQUEST);
+        Protocol::BeginRequest body;
+        std::fill(body.reserved, body.reserved+sizeof(body.reserved), 0);
+        body.role = Protocol::Role::RESPONDER;
+        body.flags = Protocol::BeginRequest::keepConnBit;
+        begin.write((const char*)&body, sizeof(body));
+        begin.finish(false);
+    }
+
+    {
+        StreamEncoder params(job.records, Protocol::RecordType::PARAMS);
+        for(const auto& parameter: parameters)
+        {
+            // Plenty of applications, us included, can't handle name-value
+            // pairs split over records
+            params.keep(
+                    (parameter.first.size()<0x80?1:4)
+                    +(parameter.second.size()<0x80?1:4)
+                    +parameter.first.size()
+                    +parameter.second.size());
+            params.length(parameter.first.size());
+            params.length(parameter.second.size());
+            params.write(parameter.first.data(), parameter.first.size());
+            params.write(parameter.second.data(), parameter.second.size());
+        }
+        params.finish();
+    }
+
+    {
+        StreamEncoder input(job.records, Protocol::RecordType::IN);
+        input.write(in, size);
+        input.finish();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobsWake.notify_one();
+    m_sockets.wake();
+#if FASTCGIPP_LOG_LEVEL > 3
+    ++m_requestCount;
+#endif
+}
+
+std::future<Fastcgipp::Client::Response> Fastcgipp::Client::request(
+        const Parameters& parameters,
+        const char* in,
+        size_t size)
+{
+    const auto promise = std::make_shared<std::promise<Response>>();
+    std::future<Response> future = promise->get_future();
+    request(parameters, in, size, [promise] (Response&& response)
+    {
+        promise->set_value(std::move(response));
+    });
+    return future;
+}
+
+Fastcgipp::Client::Connection* Fastcgipp::Client::connect()
+{
+    const Socket socket = m_service.empty()?
+        m_sockets.connect(m_host.c_str()):
+        m_sockets.connect(m_host.c_str(), m_service.c_str());
+    if(!socket.valid())
+        return nullptr;
+
+    Connection& connection = m_connections[socket];
+    connection.requests.resize(m_maxRequests);
+    for(unsigned id=1; id<=m_maxRequests; ++id)
+        connection.free.push_back(Protocol::FcgiId(id));
+#if FASTCGIPP_LOG_LEVEL > 3
+    ++m_connectionCount;
+#endif
+    return &connection;
+}
+
+void Fastcgipp::Client::dispatch()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        while(!m_jobs.empty())
+        {
+            m_backlog.push_back(std::move(m_jobs.front()));
+            m_jobs.pop_front();
+        }
+    }
+
+    while(!m_backlog.empty())
+    {
+        // Spread requests out over the least busy connections
+        Connection* connection = nullptr;
+        for(auto& candidate: m_connections)
+            if(
+                    !candidate.second.free.empty()
+                    && (connection == nullptr
+                        || candidate.second.free.size()
+                            > connection->free.size()))
+                connection = &candidate.second;
+
+        if(
+                (connection == nullptr
+                    || connection->free.size() < m_maxRequests)
+                && m_connections.size() < m_maxConnections
+                && !m_connectFailed)
+        {
+            Connection* const fresh = connect();
+            if(fresh != nullptr)
+                connection = fresh;
+            else
+                m_connectFailed = true;
+        }
+
+        Job& job = m_backlog.front();
+        if(connection == nullptr)
+        {
+            if(!m_connections.empty())
+                break;
+            m_connectFailed = false;
+
+            // Nothing to wait for so the request can't be made
+            job.callback(Response());
+            m_backlog.pop_front();
+#if FASTCGIPP_LOG_LEVEL > 3
+            ++m_failCount;
+#endif
+            continue;
+        }
+
+        const Protocol::FcgiId id = connection->free.front();
+        connection->free.pop_front();
+
+        for(
+                size_t offset = 0;
+                offset < job.records.size();
+                offset += sizeof(Protocol::Header)
+                    + ((Protocol::Header*)(job.records.data()+offset))
+                        ->contentLength)
+            ((Protocol::Header*)(job.records.data()+offset))->fcgiId = id;
+
+        if(connection->sent == connection->outgoing.size())
+        {
+            connection->outgoing.swap(job.records);
+            connection->sent = 0;
+        }
+        else
+            connection->outgoing.insert(
+                    connection->outgoing.end(),
+                    job.records.begin(),
+                    job.records.end());
+
+        Pending& pending = connection->requests[id-1];
+        pending.callback = std::move(job.callback);
+        pending.response = Response();
+        ++m_active;
+        m_backlog.pop_front();
+    }
+}
+
+bool Fastcgipp::Client::transmit()
+{
+    bool flushed = true;
+
+    for(auto it = m_connections.begin(); it != m_connections.end();)
+    {
+        const Socket socket = it->first;
+        Connection& connection = it->second;
+        ++it;
+
+        if(connection.sent == connection.outgoing.size())
+            continue;
+
+        const ssize_t sent = socket.write(
+                connection.outgoing.data()+connection.sent,
+                connection.outgoing.size()-connection.sent);
+        if(sent < 0)
+        {
+            cleanupSocket(socket);
+            continue;
+        }
+
+        connection.sent += sent;
+        if(connection.sent == connection.outgoing.size())
+        {
+            connection.outgoing.clear();
+            connection.sent = 0;
+        }
+        else
+            flushed = false;
+    }
+
+    return flushed;
+}
+
+void Fastcgipp::Client::receive(const Socket& socket)
+{
+    const auto it = m_connections.find(socket);
+    if(it == m_connections.end())
+        return;
+    Connection& connection = it->second;
+    std::vector<char>& buffer = connection.buffer;
+
+    const size_t chunk = 0x10000;
+    const size_t received = buffer.size();
+    buffer.resize(received+chunk);
+    const ssize_t read = socket.read(buffer.data()+received, chunk);
+    if(read < 0)
+    {
+        cleanupSocket(socket);
+        return;
+    }
+    buffer.resize(received+read);
+
+    size_t offset = 0;
+    while(buffer.size()-offset >= sizeof(Protocol::Header))
+    {
+        const Protocol::Header& header =
+            *(const Protocol::Header*)(buffer.data()+offset);
+        const size_t size = sizeof(Protocol::Header)
+            + header.contentLength
+            + header.paddingLength;
+        if(buffer.size()-offset < size)
+            break;
+        const char* const content = buffer.data()+offset+sizeof(header);
+        offset += size;
+
+        const Protocol::FcgiId id = header.fcgiId;
+        if(
+                id == 0
+                || id > m_maxRequests
+                || !connection.requests[id-1].callback)
+        {
+            WARNING_LOG("Client received a record for unknown request " \
+                    << id)
+            continue;
+        }
+        Pending& pending = connection.requests[id-1];
+
+        switch(header.type)
+        {
+            case Protocol::RecordType::OUT:
+            {
+                pending.response.out.insert(
+                        pending.response.out.end(),
+                        content,
+                        content+header.contentLength);
+                break;
+            }
+            case Protocol::RecordType::ERR:
+            {
+                pending.response.err.insert(
+                        pending.response.err.end(),
+                        content,
+                        content+header.contentLength);
+                break;
+            }
+            case Protocol::RecordType::END_REQUEST:
+            {
+                if(header.contentLength < sizeof(Protocol::EndRequest))
+                {
+                    WARNING_LOG("Client received a short END_REQUEST record")
+                    break;
+                }
+                const Protocol::EndRequest& end =
+                    *(const Protocol::EndRequest*)content;
+                pending.response.appStatus = end.appStatus;
+                pending.response.protocolStatus = end.protocolStatus;
+                pending.response.complete = true;
+
+                const Callback callback(std::move(pending.callback));
+                pending.callback = nullptr;
+                connection.free.push_back(id);
+                --m_active;
+                callback(std::move(pending.response));
+#if FASTCGIPP_LOG_LEVEL > 3
+                ++m_completeCount;
+#endif
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    buffer.erase(buffer.begin(), buffer.begin()+offset);
+}
+
+void Fastcgipp::Client::cleanupSocket(const Socket& socket)
+{
+    const auto it = m_connections.find(socket);
+    if(it == m_connections.end())
+        return;
+
+    for(auto& pending: it->second.requests)
+        if(pending.callback)
+        {
+            pending.callback(std::move(pending.response));
+            --m_active;
+#if FASTCGIPP_LOG_LEVEL > 3
+            ++m_failCount;
+#endif
+        }
+
+    m_connections.erase(it);
+    socket.close();
+    m_connectFailed = false;
+}
+
+void Fastcgipp::Client::cleanup()
+{
+    while(!m_connections.empty())
+        cleanupSocket(m_connections.begin()->first);
+
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        while(!m_jobs.empty())
+        {
+            m_backlog.push_back(std::move(m_jobs.front()));
+            m_jobs.pop_front();
+        }
+    }
+
+    while(!m_backlog.empty())
+    {
+        m_backlog.front().callback(Response());
+        m_backlog.pop_front();
+#if FASTCGIPP_LOG_LEVEL > 3
+        ++m_failCount;
+#endif
+    }
+}
+
+void Fastcgipp::Client::handler()
+{
+    bool flushed = true;
+
+    while(!m_terminate)
+    {
+        dispatch();
+        flushed = transmit();
+
+        if(m_stop && m_backlog.empty() && m_active == 0)
+        {
+            std::lock_guard<std::mutex> lock(m_jobsMutex);
+            if(m_jobs.empty())
+                break;
+        }
+
+        if(m_connections.empty())
+        {
+            std::unique_lock<std::mutex> lock(m_jobsMutex);
+            m_jobsWake.wait(lock, [this] ()
+            {
+                return !m_jobs.empty() || m_stop || m_terminate;
+            });
+            continue;
+        }
+
+        const Socket socket = m_sockets.poll(flushed);
+        if(socket.valid())
+            receive(socket);
+    }
+
+    cleanup();
+}
+
+void Fastcgipp::Client::start()
+{
+    m_stop = false;
+    m_terminate = false;
+    if(!m_thread.joinable())
+    {
+        std::thread thread(&Fastcgipp::Client::handler, this);
+        m_thread.swap(thread);
+    }
+}
+
+void Fastcgipp::Client::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        m_stop = true;
+    }
+    m_jobsWake.notify_one();
+    m_sockets.wake();
+}
+
+void Fastcgipp::Client::terminate()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        m_terminate = true;
+    }
+    m_jobsWake.notify_one();
+    m_sockets.wake();
+}
+
+void Fastcgipp::Client::join()
+{
+    if(m_thread.joinable())
+        m_thread.join();
+}
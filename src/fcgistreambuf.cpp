@@ -48,7 +48,7 @@ namespace Fastcgipp
         while((count = this->pptr() - this->pbase()) != 0)
         {
             record.resize(sizeof(Protocol::Header)
-                    +std::min((size_t)0xffffU,
+                    +std::min((size_t)0xfff8U,
                         (count*converter.max_length()+Protocol::chunkSize-1)
                         /Protocol::chunkSize*Protocol::chunkSize));
 
@@ -98,7 +98,7 @@ namespace Fastcgipp
         while((count = this->pptr() - this->pbase()) != 0)
         {
             record.resize(sizeof(Protocol::Header)
-                    +std::min((size_t)0xffffU,
+                    +std::min((size_t)0xfff8U,
                         (count+Protocol::chunkSize-1)
                         /Protocol::chunkSize*Protocol::chunkSize));
 
@@ -168,7 +168,7 @@ void Fastcgipp::FcgiStreambuf<charT, traits>::dump(
     while(size != 0)
     {
         record.resize(sizeof(Protocol::Header)
-                +std::min((size_t)0xffffU,
+                +std::min((size_t)0xfff8U,
                     (size+Protocol::chunkSize-1)
                     /Protocol::chunkSize*Protocol::chunkSize));
 
@@ -211,7 +211,8 @@ void Fastcgipp::FcgiStreambuf<charT, traits>::dump(
         std::basic_istream<char>& stream)
 {
     std::vector<char> record;
-    const ssize_t maxContentLength = 0xffff;
+    // A multiple of chunkSize so that padding never grows the record
+    const ssize_t maxContentLength = 0xfff8;
 
     emptyBuffer();
 
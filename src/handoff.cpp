@@ -0,0 +1,255 @@
+/*!
+ * @file       handoff.cpp
+ * @brief      Defines the Handoff class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/handoff.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <vector>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace Fastcgipp
+{
+    //! Acknowledgement sent once the listeners are adopted
+    const char handoffAck = 'k';
+}
+
+Fastcgipp::Handoff::Handoff(Manager_base& manager):
+    m_manager(manager),
+    m_control(-1)
+{}
+
+Fastcgipp::Handoff::~Handoff()
+{
+    if(m_control != -1)
+        ::shutdown(m_control, SHUT_RDWR);
+    if(m_thread.joinable())
+        m_thread.join();
+    if(m_control != -1)
+        ::close(m_control);
+}
+
+bool Fastcgipp::Handoff::offer(const char* path)
+{
+    if(m_control != -1)
+    {
+        ERROR_LOG("Listeners are already being offered on " << m_path.c_str())
+        return false;
+    }
+
+    sockaddr_un address;
+    if(std::strlen(path) >= sizeof(address.sun_path))
+    {
+        ERROR_LOG("Handoff socket path is too long: " << path)
+        return false;
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path);
+
+    m_control = ::socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if(m_control == -1)
+    {
+        ERROR_LOG("Unable to create handoff socket: " << std::strerror(errno))
+        return false;
+    }
+
+    // The path may be left over from the process we took over from
+    ::unlink(path);
+    if(::bind(m_control, (sockaddr*)&address, sizeof(address)) < 0
+            || ::listen(m_control, 1) < 0)
+    {
+        ERROR_LOG("Unable to bind/listen on handoff socket " << path << ": " \
+                << std::strerror(errno))
+        ::close(m_control);
+        m_control = -1;
+        return false;
+    }
+
+    m_path = path;
+    std::thread thread(&Fastcgipp::Handoff::handler, this);
+    m_thread.swap(thread);
+    return true;
+}
+
+void Fastcgipp::Handoff::handler()
+{
+    while(true)
+    {
+        const int connection = ::accept4(
+                m_control,
+                nullptr,
+                nullptr,
+                SOCK_CLOEXEC);
+        if(connection < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        const std::set<socket_t>& listeners =
+            m_manager.m_transceiver.listeners();
+        std::vector<int> fds(listeners.cbegin(), listeners.cend());
+        if(fds.size() > maxListeners)
+        {
+            WARNING_LOG("Only handing over " << maxListeners << " of " \
+                    << fds.size() << " listeners")
+            fds.resize(maxListeners);
+        }
+
+        char count = fds.size();
+        iovec data;
+        data.iov_base = &count;
+        data.iov_len = 1;
+
+        std::vector<char> control(CMSG_SPACE(sizeof(int)*maxListeners));
+        msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        if(!fds.empty())
+        {
+            message.msg_control = control.data();
+            message.msg_controllen = CMSG_SPACE(sizeof(int)*fds.size());
+            cmsghdr* const header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int)*fds.size());
+            std::memcpy(CMSG_DATA(header), fds.data(), sizeof(int)*fds.size());
+        }
+
+        char ack = 0;
+        if(::sendmsg(connection, &message, MSG_NOSIGNAL) != 1
+                || ::recv(connection, &ack, 1, 0) != 1
+                || ack != handoffAck)
+        {
+            WARNING_LOG("Listener handoff on " << m_path.c_str() \
+                    << " failed. Still accepting.")
+            ::close(connection);
+            continue;
+        }
+        ::close(connection);
+
+        // The listeners are someone else's now
+        DIAG_LOG("Handed " << fds.size() << " listeners over. Stopping.")
+        m_manager.m_transceiver.share();
+        m_manager.stop();
+        break;
+    }
+}
+
+bool Fastcgipp::Handoff::take(Manager_base& manager, const char* path)
+{
+    sockaddr_un address;
+    if(std::strlen(path) >= sizeof(address.sun_path))
+    {
+        ERROR_LOG("Handoff socket path is too long: " << path)
+        return false;
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path);
+
+    const int connection = ::socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if(connection == -1)
+    {
+        ERROR_LOG("Unable to create handoff socket: " << std::strerror(errno))
+        return false;
+    }
+
+    if(::connect(connection, (sockaddr*)&address, sizeof(address)) < 0)
+    {
+        DIAG_LOG("No listeners offered on " << path)
+        ::close(connection);
+        return false;
+    }
+
+    char count;
+    iovec data;
+    data.iov_base = &count;
+    data.iov_len = 1;
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int)*maxListeners));
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    ssize_t received;
+    do received = ::recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+    while(received < 0 && errno == EINTR);
+
+    std::vector<int> fds;
+    if(received == 1)
+        for(
+                cmsghdr* header = CMSG_FIRSTHDR(&message);
+                header != nullptr;
+                header = CMSG_NXTHDR(&message, header))
+        {
+            if(header->cmsg_level != SOL_SOCKET
+                    || header->cmsg_type != SCM_RIGHTS)
+                continue;
+            const size_t size = header->cmsg_len-CMSG_LEN(0);
+            const size_t start = fds.size();
+            fds.resize(start+size/sizeof(int));
+            std::memcpy(fds.data()+start, CMSG_DATA(header), size);
+        }
+
+    if(message.msg_flags & MSG_CTRUNC)
+        WARNING_LOG("Some listeners offered on " << path << " were lost")
+
+    unsigned adopted = 0;
+    for(const auto fd: fds)
+    {
+        if(manager.adopt(fd))
+            ++adopted;
+        else
+            ::close(fd);
+    }
+
+    if(adopted == 0)
+    {
+        ERROR_LOG("Unable to take over listeners from " << path)
+        ::close(connection);
+        return false;
+    }
+
+    const char ack = handoffAck;
+    if(::send(connection, &ack, 1, MSG_NOSIGNAL) != 1)
+        WARNING_LOG("Unable to acknowledge listener handoff on " << path)
+    ::close(connection);
+
+    DIAG_LOG("Took over " << adopted << " listeners from " << path)
+    return true;
+}
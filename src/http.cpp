@@ -173,18 +173,21 @@ template<class charT> void Fastcgipp::Http::Environment<charT>::fill(
         std::vector<char>::const_iterator data,
         const std::vector<char>::const_iterator dataEnd)
 {
-    std::vector<char>::const_iterator name;
-    std::vector<char>::const_iterator value;
-    std::vector<char>::const_iterator end;
-
-    while(Protocol::processParamHeader(
-            data,
-            dataEnd,
-            name,
-            value,
-            end))
+    if(data == dataEnd)
+        return;
+
+    static thread_local std::vector<Protocol::Parameter> parameters;
+    parameters.clear();
+    Protocol::decodeParameters(&*data, dataEnd-data, parameters);
+
+    for(const Protocol::Parameter& parameter: parameters)
     {
-        switch(value-name)
+        const std::vector<char>::const_iterator name = data+parameter.name;
+        const std::vector<char>::const_iterator value = data+parameter.value;
+        const std::vector<char>::const_iterator end =
+            value+parameter.valueSize;
+
+        switch(parameter.nameSize)
         {
         case 9:
             if(std::equal(name, value, "HTTP_HOST"))
@@ -382,7 +385,6 @@ template<class charT> void Fastcgipp::Http::Environment<charT>::fill(
             }
             break;
         }
-        data = end;
     }
 }
 
@@ -0,0 +1,334 @@
+/*!
+ * @file       loopback.cpp
+ * @brief      Defines the Loopback transport
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/loopback.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+    //! Round up to a power of two
+    size_t roundUp(size_t size)
+    {
+        size_t rounded = 1;
+        while(rounded < size)
+            rounded <<= 1;
+        return rounded;
+    }
+}
+
+Fastcgipp::Loopback::Ring::Ring(size_t capacity):
+    m_buffer(new char[roundUp(capacity)]),
+    m_mask(roundUp(capacity)-1),
+    m_head(0),
+    m_tail(0)
+{}
+
+size_t Fastcgipp::Loopback::Ring::write(const char* data, size_t size)
+{
+    const size_t head = m_head.load(std::memory_order_relaxed);
+    const size_t tail = m_tail.load(std::memory_order_acquire);
+    const size_t count = std::min(size, m_mask+1-(head-tail));
+    const size_t start = head & m_mask;
+    const size_t first = std::min(count, m_mask+1-start);
+
+    std::memcpy(m_buffer.get()+start, data, first);
+    std::memcpy(m_buffer.get(), data+first, count-first);
+    m_head.store(head+count, std::memory_order_release);
+    return count;
+}
+
+size_t Fastcgipp::Loopback::Ring::read(char* data, size_t size)
+{
+    const size_t tail = m_tail.load(std::memory_order_relaxed);
+    const size_t head = m_head.load(std::memory_order_acquire);
+    const size_t count = std::min(size, head-tail);
+    const size_t start = tail & m_mask;
+    const size_t first = std::min(count, m_mask+1-start);
+
+    std::memcpy(data, m_buffer.get()+start, first);
+    std::memcpy(data+first, m_buffer.get(), count-first);
+    m_tail.store(tail+count, std::memory_order_release);
+    return count;
+}
+
+size_t Fastcgipp::Loopback::Client::write(const char* data, size_t size)
+{
+    if(!m_pipe || m_pipe->clientClosed || m_pipe->serverClosed)
+        return 0;
+
+    const size_t count = m_pipe->in.write(data, size);
+    if(count > 0)
+        m_loopback->notify();
+    return count;
+}
+
+size_t Fastcgipp::Loopback::Client::read(char* data, size_t size)
+{
+    if(!m_pipe)
+        return 0;
+    return m_pipe->out.read(data, size);
+}
+
+void Fastcgipp::Loopback::Client::close()
+{
+    if(m_pipe && !m_pipe->clientClosed)
+    {
+        m_pipe->clientClosed = true;
+        m_loopback->notify();
+    }
+}
+
+Fastcgipp::Loopback::Client& Fastcgipp::Loopback::Client::operator=(
+        Client&& x)
+{
+    if(this != &x)
+    {
+        close();
+        m_loopback = x.m_loopback;
+        m_pipe = std::move(x.m_pipe);
+    }
+    return *this;
+}
+
+Fastcgipp::Loopback::Loopback(size_t capacity):
+    m_capacity(capacity),
+    m_next(0),
+    m_count(0),
+    m_accept(true),
+    m_connecting(false),
+    m_sleeping(false),
+    m_woken(false)
+#if FASTCGIPP_LOG_LEVEL > 3
+    ,m_connectionCount(0),
+    m_sleepCount(0)
+#endif
+{}
+
+Fastcgipp::Loopback::~Loopback()
+{
+    for(auto& connection: m_connections)
+    {
+        if(connection.socket.valid())
+        {
+            connection.pipe->serverClosed = true;
+            invalidate(connection.socket);
+        }
+    }
+
+    // Connections that were never picked up
+    for(const auto& pipe: m_pending)
+        pipe->serverClosed = true;
+
+    DIAG_LOG("Loopback::~Loopback(): Connections ========= " \
+            << m_connectionCount)
+    DIAG_LOG("Loopback::~Loopback(): Sleeps ============== " \
+            << m_sleepCount)
+}
+
+Fastcgipp::Loopback::Client Fastcgipp::Loopback::connect()
+{
+    std::shared_ptr<Pipe> pipe(new Pipe(m_capacity));
+    if(!m_accept)
+    {
+        pipe->serverClosed = true;
+        return Client(*this, std::move(pipe));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(pipe);
+        m_connecting = true;
+    }
+    notify();
+#if FASTCGIPP_LOG_LEVEL > 3
+    ++m_connectionCount;
+#endif
+    return Client(*this, std::move(pipe));
+}
+
+void Fastcgipp::Loopback::notify()
+{
+    // Pairs with the fence in poll() so that either we see it sleeping or
+    // it sees what we just did
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_wake.notify_one();
+    }
+}
+
+void Fastcgipp::Loopback::wake()
+{
+    if(!m_woken.load(std::memory_order_relaxed))
+    {
+        m_woken = true;
+        notify();
+    }
+}
+
+void Fastcgipp::Loopback::accept(bool status)
+{
+    if(status != m_accept)
+    {
+        m_accept = status;
+        wake();
+    }
+}
+
+Fastcgipp::Socket Fastcgipp::Loopback::ready()
+{
+    // Pick up new connections
+    if(m_connecting)
+    {
+        std::vector<std::shared_ptr<Pipe>> pending;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            pending.swap(m_pending);
+            m_connecting = false;
+        }
+
+        for(auto& pipe: pending)
+        {
+            if(!m_accept)
+            {
+                pipe->serverClosed = true;
+                continue;
+            }
+
+            socket_t id;
+            if(m_free.empty())
+            {
+                id = socket_t(m_connections.size());
+                m_connections.emplace_back();
+            }
+            else
+            {
+                id = m_free.back();
+                m_free.pop_back();
+            }
+
+            Connection& connection = m_connections[id];
+            connection.socket = create(id, ++connection.generation);
+            connection.pipe = std::move(pipe);
+            ++m_count;
+        }
+    }
+
+    const size_t size = m_connections.size();
+    for(size_t i=0; i<size; ++i)
+    {
+        const size_t index = (m_next+i) % size;
+        Connection& connection = m_connections[index];
+        if(!connection.pipe)
+            continue;
+
+        if(connection.pipe->clientClosed)
+            setClosing(connection.socket);
+        else if(connection.pipe->in.empty())
+            continue;
+
+        m_next = index+1;
+        return connection.socket;
+    }
+
+    return Socket();
+}
+
+Fastcgipp::Socket Fastcgipp::Loopback::poll(bool block)
+{
+    while(true)
+    {
+        if(m_woken.load(std::memory_order_relaxed))
+        {
+            m_woken = false;
+            block = false;
+        }
+
+        const Socket socket = ready();
+        if(socket.valid() || !block)
+            return socket;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_sleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!m_woken && !m_connecting && !ready().valid())
+        {
+#if FASTCGIPP_LOG_LEVEL > 3
+            ++m_sleepCount;
+#endif
+            m_wake.wait(lock);
+        }
+        m_sleeping = false;
+    }
+}
+
+ssize_t Fastcgipp::Loopback::readSocket(
+        const Socket& socket,
+        char* buffer,
+        size_t size)
+{
+    Pipe& pipe = *m_connections[id(socket)].pipe;
+    const size_t count = pipe.in.read(buffer, size);
+    if(count == 0 && closing(socket))
+    {
+        closeSocket(socket);
+        return -1;
+    }
+    return count;
+}
+
+ssize_t Fastcgipp::Loopback::writeSocket(
+        const Socket& socket,
+        const char* buffer,
+        size_t size)
+{
+    Pipe& pipe = *m_connections[id(socket)].pipe;
+    if(pipe.clientClosed)
+    {
+        closeSocket(socket);
+        return -1;
+    }
+    return pipe.out.write(buffer, size);
+}
+
+void Fastcgipp::Loopback::closeSocket(const Socket& socket)
+{
+    const socket_t index = id(socket);
+    Connection& connection = m_connections[index];
+
+    invalidate(socket);
+    connection.pipe->serverClosed = true;
+    connection.pipe.reset();
+    connection.socket = Socket();
+    m_free.push_back(index);
+    --m_count;
+}
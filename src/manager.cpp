@@ -29,7 +29,16 @@
 #include "fastcgi++/log.hpp"
 #include "fastcgi++/manager.hpp"
 
-Fastcgipp::Manager_base* Fastcgipp::Manager_base::instance=nullptr;
+#include <numeric>
+#include <cstring>
+
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+std::mutex Fastcgipp::Manager_base::instancesMutex;
+std::set<Fastcgipp::Manager_base*> Fastcgipp::Manager_base::instances;
+int Fastcgipp::Manager_base::signalPipe[2] = {-1, -1};
 
 Fastcgipp::Manager_base::Manager_base(unsigned threads):
     m_transceiver(std::bind(
@@ -37,9 +46,24 @@ Fastcgipp::Manager_base::Manager_base(unsigned threads):
                 this,
                 std::placeholders::_1,
                 std::placeholders::_2)),
+    m_classes(1),
+    m_currentClass(0),
+    m_credit(0),
+    m_deadline(Timer::Clock::duration::zero()),
+    m_sliceMessages(0),
+    m_sliceTime(std::chrono::microseconds::zero()),
+    m_cache(nullptr),
     m_terminate(true),
     m_stop(true),
-    m_threads(threads)
+    m_minThreads(std::max(1u, threads)),
+    m_maxThreads(m_minThreads),
+    m_runningThreads(0),
+    m_idleThreads(0),
+    m_queueTarget(Timer::Clock::duration::zero()),
+    m_idleTimeout(Timer::Clock::duration::zero()),
+    m_checkingPool(false),
+    m_growCount(0),
+    m_shrinkCount(0)
 #if FASTCGIPP_LOG_LEVEL > 3
     ,m_requestCount(0),
     m_maxRequests(0),
@@ -47,13 +71,20 @@ Fastcgipp::Manager_base::Manager_base(unsigned threads):
     m_badSocketMessageCount(0),
     m_badSocketKillCount(0),
     m_messageCount(0),
+    m_abortCount(0),
+    m_successorCount(0),
+    m_deadlineCount(0),
+    m_requeueCount(0),
+    m_replacementCount(0),
+    m_unconstructedCount(0),
     m_activeThreads(threads),
     m_maxActiveThreads(0)
 #endif
 {
-    if(instance != nullptr)
-        FAIL_LOG("You're not allowed to have multiple manager instances")
-    instance = this;
+    {
+        std::lock_guard<std::mutex> lock(instancesMutex);
+        instances.insert(this);
+    }
     DIAG_LOG("Manager_base::Manager_base(): Initialized")
 }
 
@@ -80,25 +111,171 @@ void Fastcgipp::Manager_base::start()
     m_stop=false;
     m_terminate=false;
     m_transceiver.start();
-    for(auto& thread: m_threads)
-        if(!thread.joinable())
-        {
-            std::thread newThread(&Fastcgipp::Manager_base::handler, this);
-            thread.swap(newThread);
-        }
+    m_timer.start();
+    while(m_runningThreads < m_minThreads)
+        spawn();
+
+    if(m_maxThreads > m_minThreads && !m_checkingPool)
+    {
+        m_checkingPool = true;
+        m_timer.push(
+                [this] (Message) { checkPool(); },
+                Message(),
+                m_queueTarget);
+    }
 }
 
 void Fastcgipp::Manager_base::join()
 {
-    for(auto& thread: m_threads)
-        if(thread.joinable())
-            thread.join();
+    // Threads can come and go while we're waiting
+    while(true)
+    {
+        std::thread thread;
+        {
+            std::lock_guard<std::mutex> lock(m_tasksMutex);
+            auto& threads = m_threads.empty() ? m_retiredThreads:m_threads;
+            if(threads.empty())
+                break;
+            thread.swap(threads.back());
+            threads.pop_back();
+        }
+        thread.join();
+    }
     m_transceiver.join();
+    m_timer.stop();
+}
+
+void Fastcgipp::Manager_base::setElastic(
+        unsigned minThreads,
+        unsigned maxThreads,
+        Timer::Clock::duration target,
+        Timer::Clock::duration idle)
+{
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    m_minThreads = std::max(1u, minThreads);
+    m_maxThreads = std::max(m_minThreads, maxThreads);
+    m_queueTarget = std::max(target, Timer::Clock::duration(1));
+    m_idleTimeout = idle;
+}
+
+Fastcgipp::Manager_base::PoolStats Fastcgipp::Manager_base::poolStats()
+{
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    PoolStats stats;
+    stats.threads = m_runningThreads;
+    stats.idle = m_idleThreads;
+    stats.grown = m_growCount;
+    stats.shrunk = m_shrinkCount;
+    return stats;
+}
+
+void Fastcgipp::Manager_base::spawn()
+{
+    // Retired threads have given up m_tasksMutex so they're all but done
+    for(auto& thread: m_retiredThreads)
+        thread.join();
+    m_retiredThreads.clear();
+
+    m_threads.emplace_back(&Fastcgipp::Manager_base::handler, this);
+    ++m_runningThreads;
+}
+
+void Fastcgipp::Manager_base::checkPool()
+{
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    if(m_stop || m_terminate)
+    {
+        m_checkingPool = false;
+        return;
+    }
+
+    if(m_idleThreads == 0 && m_runningThreads < m_maxThreads)
+    {
+        // Only tasks that a new thread could actually take count
+        const auto now = Timer::Clock::now();
+        for(const auto& taskClass: m_classes)
+            if(
+                    !taskClass.tasks.empty()
+                    && (taskClass.cap == 0 || taskClass.active < taskClass.cap)
+                    && now-taskClass.tasks.front().second >= m_queueTarget)
+            {
+                spawn();
+                ++m_growCount;
+                DIAG_LOG("Growing handler thread pool to " \
+                        << m_runningThreads << " threads")
+                break;
+            }
+    }
+
+    m_timer.push(
+            [this] (Message) { checkPool(); },
+            Message(),
+            m_queueTarget);
+}
+
+void Fastcgipp::Manager_base::setClass(
+        unsigned id,
+        unsigned weight,
+        unsigned cap)
+{
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    if(id >= m_classes.size())
+        m_classes.resize(id+1);
+    m_classes[id].weight = std::max(1u, weight);
+    m_classes[id].cap = cap;
+}
+
+void Fastcgipp::Manager_base::queueTask(
+        const Protocol::RequestId& id,
+        unsigned taskClass)
+{
+    if(taskClass >= m_classes.size())
+        taskClass = 0;
+    m_classes[taskClass].tasks.emplace(
+            id,
+            m_maxThreads > m_minThreads ?
+                Timer::Clock::now() : Timer::Clock::time_point());
+    m_wake.notify_one();
+}
+
+bool Fastcgipp::Manager_base::nextTask(
+        Protocol::RequestId& id,
+        unsigned& taskClass)
+{
+    for(unsigned i=0; i<=m_classes.size(); ++i)
+    {
+        TaskClass& current = m_classes[m_currentClass];
+        if(
+                m_credit > 0
+                && !current.tasks.empty()
+                && (current.cap == 0 || current.active < current.cap))
+        {
+            id = current.tasks.front().first;
+            current.tasks.pop();
+            ++current.active;
+            --m_credit;
+            taskClass = m_currentClass;
+            return true;
+        }
+
+        // Move on to the next class
+        m_currentClass = (m_currentClass+1)%m_classes.size();
+        m_credit = m_classes[m_currentClass].weight;
+    }
+    return false;
 }
 
-#include <signal.h>
 void Fastcgipp::Manager_base::setupSignals()
 {
+    static std::once_flag once;
+    std::call_once(once, [] ()
+    {
+        if(pipe2(signalPipe, O_CLOEXEC) != 0)
+            FAIL_LOG("Unable to create the signal pipe: " \
+                    << std::strerror(errno))
+        std::thread(&Fastcgipp::Manager_base::signalDispatcher).detach();
+    });
+
     struct sigaction sigAction;
     sigAction.sa_handler=Fastcgipp::Manager_base::signalHandler;
     sigemptyset(&sigAction.sa_mask);
@@ -111,31 +288,58 @@ void Fastcgipp::Manager_base::setupSignals()
 
 void Fastcgipp::Manager_base::signalHandler(int signum)
 {
-    switch(signum)
+    if(signum == SIGPIPE)
+        return;
+
+    // Only async-signal-safe calls in here. Hand off to signalDispatcher().
+    const int error = errno;
+    const char byte = signum;
+    if(write(signalPipe[1], &byte, 1) != 1)
+    {}
+    errno = error;
+}
+
+void Fastcgipp::Manager_base::signalDispatcher()
+{
+    char signum;
+    while(true)
     {
-        case SIGUSR1:
+        const ssize_t size = read(signalPipe[0], &signum, 1);
+        if(size < 0 && errno == EINTR)
+            continue;
+        if(size != 1)
+            break;
+
+        std::lock_guard<std::mutex> lock(instancesMutex);
+        switch(signum)
         {
-            if(instance)
+            case SIGUSR1:
             {
-                DIAG_LOG("Received SIGUSR1. Stopping fastcgi++ manager.")
-                instance->stop();
+                if(!instances.empty())
+                {
+                    DIAG_LOG("Received SIGUSR1. Stopping fastcgi++ managers.")
+                    for(auto instance: instances)
+                        instance->stop();
+                }
+                else
+                    WARNING_LOG("Received SIGUSR1 but no fastcgi++ manager " \
+                            "is running")
+                break;
             }
-            else
-                WARNING_LOG("Received SIGUSR1 but fastcgi++ manager isn't "\
-                        "running")
-            break;
-        }
-        case SIGTERM:
-        {
-            if(instance)
+            case SIGTERM:
             {
-                DIAG_LOG("Received SIGTERM. Terminating fastcgi++ manager.")
-                instance->terminate();
+                if(!instances.empty())
+                {
+                    DIAG_LOG("Received SIGTERM. Terminating fastcgi++ " \
+                            "managers.")
+                    for(auto instance: instances)
+                        instance->terminate();
+                }
+                else
+                    WARNING_LOG("Received SIGTERM but no fastcgi++ manager " \
+                            "is running")
+                break;
             }
-            else
-                WARNING_LOG("Received SIGTERM but fastcgi++ manager isn't "\
-                        "running")
-            break;
         }
     }
 }
@@ -158,18 +362,18 @@ void Fastcgipp::Manager_base::localHandler()
         {
             case Protocol::RecordType::GET_VALUES:
             {
-                std::vector<char>::const_iterator name;
-                std::vector<char>::const_iterator value;
-                std::vector<char>::const_iterator end;
+                std::vector<Protocol::Parameter> parameters;
+                const char* const body = message.data.data()+sizeof(header);
+                Protocol::decodeParameters(
+                        body,
+                        header.contentLength,
+                        parameters);
 
-                while(Protocol::processParamHeader(
-                        message.data.cbegin()+sizeof(header),
-                        message.data.cend(),
-                        name,
-                        value,
-                        end))
+                for(const Protocol::Parameter& parameter: parameters)
                 {
-                    switch(value-name)
+                    const char* const name = body+parameter.name;
+                    const char* const value = body+parameter.value;
+                    switch(parameter.nameSize)
                     {
                         case 14:
                         {
@@ -259,19 +463,24 @@ void Fastcgipp::Manager_base::localHandler()
 
 void Fastcgipp::Manager_base::handler()
 {
+    pinThread(m_handlerCpus);
+
     std::unique_lock<std::shared_timed_mutex> requestsWriteLock(
             m_requestsMutex,
             std::defer_lock);
     std::unique_lock<std::mutex> tasksLock(m_tasksMutex);
     std::shared_lock<std::shared_timed_mutex> requestsReadLock(m_requestsMutex);
 
+    Protocol::RequestId id;
+    unsigned taskClass;
+
     while(!m_terminate && !(m_stop && m_requests.empty()))
     {
         requestsReadLock.unlock();
-        while(!m_tasks.empty())
+        while(nextTask(id, taskClass))
         {
-            auto id = m_tasks.front();
-            m_tasks.pop();
+            bool requeue = false;
+            unsigned requeueClass;
             tasksLock.unlock();
 
             if(id.m_id == 0)
@@ -280,7 +489,18 @@ void Fastcgipp::Manager_base::handler()
             {
                 requestsReadLock.lock();
                 auto request = m_requests.find(id);
-                if(request != m_requests.end())
+                if(request == m_requests.end())
+                    requestsReadLock.unlock();
+                else if(
+                        (requeueClass = request->second->schedulingClass())
+                            != taskClass
+                        && requeueClass < m_classes.size())
+                {
+                    // It's been classified since this task was queued
+                    requestsReadLock.unlock();
+                    requeue = true;
+                }
+                else
                 {
                     std::unique_lock<std::mutex> requestLock(
                             request->second->mutex,
@@ -301,19 +521,47 @@ void Fastcgipp::Manager_base::handler()
                             requestsWriteLock.lock();
                             requestLock.unlock();
                             m_requests.erase(request);
+                            if(succeed(id))
+                            {
+                                requeue = true;
+                                requeueClass = 0;
+                            }
+                            requestsWriteLock.unlock();
+                        }
+                        else if(request->second->m_replacement)
+                        {
+                            lock.unlock();
+                            requestsWriteLock.lock();
+                            std::unique_ptr<Request_base> old(
+                                    std::move(request->second));
+                            request->second = std::move(old->m_replacement);
+                            replace(*request->second, *old, id);
+                            requeue = true;
+                            requeueClass = request->second->schedulingClass();
+                            requestLock.unlock();
                             requestsWriteLock.unlock();
                         }
                         else
                         {
+                            requeue = request->second->yielded();
+                            requeueClass = request->second->schedulingClass();
                             requestLock.unlock();
                             lock.unlock();
                         }
                     }
                 }
-                else
-                    requestsReadLock.unlock();
             }
             tasksLock.lock();
+            --m_classes[taskClass].active;
+
+            // Back of the line with you
+            if(requeue)
+            {
+#if FASTCGIPP_LOG_LEVEL > 3
+                ++m_requeueCount;
+#endif
+                queueTask(id, requeueClass);
+            }
         }
 
         requestsReadLock.lock();
@@ -323,7 +571,47 @@ void Fastcgipp::Manager_base::handler()
 #if FASTCGIPP_LOG_LEVEL > 3
         --m_activeThreads;
 #endif
-        m_wake.wait(tasksLock);
+        ++m_idleThreads;
+        if(m_runningThreads > m_minThreads)
+        {
+            if(m_wake.wait_for(tasksLock, m_idleTimeout)
+                    == std::cv_status::timeout
+                    && m_runningThreads > m_minThreads
+                    && !m_stop
+                    && !m_terminate
+                    && std::all_of(
+                        m_classes.cbegin(),
+                        m_classes.cend(),
+                        [] (const TaskClass& x)
+                        {
+                            return x.tasks.empty();
+                        }))
+            {
+                // We're surplus so take ourselves out of the pool. If join()
+                // already has our thread it'll join us itself. Otherwise we
+                // stay joinable since we still touch our members below.
+                const auto self = std::find_if(
+                        m_threads.begin(),
+                        m_threads.end(),
+                        [] (const std::thread& thread)
+                        {
+                            return thread.get_id() == std::this_thread::get_id();
+                        });
+                if(self != m_threads.end())
+                {
+                    m_retiredThreads.push_back(std::move(*self));
+                    m_threads.erase(self);
+                }
+                --m_idleThreads;
+                ++m_shrinkCount;
+                DIAG_LOG("Shrinking handler thread pool to " \
+                        << m_runningThreads-1 << " threads")
+                break;
+            }
+        }
+        else
+            m_wake.wait(tasksLock);
+        --m_idleThreads;
 #if FASTCGIPP_LOG_LEVEL > 3
         if(!m_stop && !m_terminate)
         {
@@ -333,10 +621,17 @@ void Fastcgipp::Manager_base::handler()
 #endif
         requestsReadLock.lock();
     }
+
+    // The other threads may be waiting for work that will never come
+    if(m_stop || m_terminate)
+        m_wake.notify_all();
+    --m_runningThreads;
 }
 
 void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
 {
+    unsigned taskClass = 0;
+
     if(id.m_id == 0)
     {
 #if FASTCGIPP_LOG_LEVEL > 3
@@ -351,6 +646,8 @@ void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
         ++m_badSocketMessageCount;
 #endif
         std::lock_guard<std::shared_timed_mutex> lock(m_requestsMutex);
+        const auto successors = m_successors.equal_range(id.m_socket);
+        m_successors.erase(successors.first, successors.second);
         const auto range = m_requests.equal_range(id.m_socket);
         auto request = range.first;
         while(request != range.second)
@@ -367,7 +664,12 @@ void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
 #endif
             }
             else
+            {
+                // Let it know so it can bail out early. The handler() thread
+                // will erase it once it sees the socket is invalid.
+                request->second->cancel(Cancellation::DISCONNECTED);
                 ++request;
+            }
         }
         return;
     }
@@ -376,28 +678,52 @@ void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
 #if FASTCGIPP_LOG_LEVEL > 3
         ++m_messageCount;
 #endif
-        std::unique_lock<std::shared_timed_mutex> lock(m_requestsMutex);
+        // Most records are for requests that already exist so only lock out
+        // the other connections while creating a new one
+        std::shared_lock<std::shared_timed_mutex> readLock(m_requestsMutex);
+        std::unique_lock<std::shared_timed_mutex> lock(
+                m_requestsMutex,
+                std::defer_lock);
         auto request = m_requests.find(id);
+        if(
+                request == m_requests.end()
+                || (message.type == 0 && request->second->ended()))
+        {
+            readLock.unlock();
+            lock.lock();
+            request = m_requests.find(id);
+
+            // The other side has reused the FcgiId of a request we haven't
+            // erased yet
+            if(
+                    request != m_requests.end()
+                    && message.type == 0
+                    && request->second->ended()
+                    && (((const Protocol::Header*)message.data.data())->type
+                            == Protocol::RecordType::BEGIN_REQUEST
+                        || m_successors.find(id) != m_successors.end()))
+            {
+                m_successors[id].push_back(std::move(message));
+#if FASTCGIPP_LOG_LEVEL > 3
+                ++m_successorCount;
+#endif
+                return;
+            }
+        }
         if(request == m_requests.end())
         {
+            if(message.type != 0)
+            {
+                DIAG_LOG("Got a callback message for a request that no "\
+                        "longer exists")
+                return;
+            }
+
             const Protocol::Header& header=
                 *(Protocol::Header*)message.data.data();
             if(header.type == Protocol::RecordType::BEGIN_REQUEST)
             {
-                const Protocol::BeginRequest& body
-                    =*(Protocol::BeginRequest*)(
-                            message.data.data()
-                            +sizeof(header));
-
-                request = m_requests.emplace(
-                        std::piecewise_construct,
-                        std::forward_as_tuple(id),
-                        std::forward_as_tuple()).first;
-
-                request->second = makeRequest(
-                        id,
-                        body.role,
-                        body.kill());
+                create(id, message);
                 lock.unlock();
 #if FASTCGIPP_LOG_LEVEL > 3
                 ++m_requestCount;
@@ -409,18 +735,140 @@ void Fastcgipp::Manager_base::push(Protocol::RequestId id, Message&& message)
                         " doesn't exist")
             return;
         }
+        else if(
+                message.type == 0
+                && ((const Protocol::Header*)message.data.data())->type
+                    == Protocol::RecordType::ABORT_REQUEST)
+        {
+            // Set the token now in case the request is busy
+            if(!request->second->cancel(Cancellation::ABORTED))
+                return;
+#if FASTCGIPP_LOG_LEVEL > 3
+            ++m_abortCount;
+#endif
+        }
         else
             request->second->push(std::move(message));
+        taskClass = request->second->schedulingClass();
     }
     std::lock_guard<std::mutex> lock(m_tasksMutex);
-    m_tasks.push(id);
-    m_wake.notify_one();
+    queueTask(id, taskClass);
+}
+
+Fastcgipp::Protocol::Requests<std::unique_ptr<Fastcgipp::Request_base>>
+::iterator Fastcgipp::Manager_base::create(
+        const Protocol::RequestId& id,
+        const Message& message)
+{
+    const Protocol::BeginRequest& body
+        =*(const Protocol::BeginRequest*)(
+                message.data.data()
+                +sizeof(Protocol::Header));
+
+    const auto request = m_requests.emplace(
+            std::piecewise_construct,
+            std::forward_as_tuple(id),
+            std::forward_as_tuple()).first;
+
+    request->second.reset(new PendingRequest(
+            *this,
+            id,
+            body.role,
+            body.kill()));
+    attach(*request->second, id);
+    if(m_deadline != Timer::Clock::duration::zero())
+        request->second->setDeadline(m_deadline);
+    return request;
+}
+
+bool Fastcgipp::Manager_base::succeed(const Protocol::RequestId& id)
+{
+    const auto successor = m_successors.find(id);
+    if(successor == m_successors.end())
+        return false;
+
+    std::vector<Message> messages(std::move(successor->second));
+    m_successors.erase(successor);
+
+    const auto request = create(id, messages.front());
+#if FASTCGIPP_LOG_LEVEL > 3
+    ++m_requestCount;
+    m_maxRequests = std::max(m_maxRequests, m_requests.size());
+#endif
+    for(auto message=messages.begin()+1; message!=messages.end(); ++message)
+        request->second->push(std::move(*message));
+    return messages.size() > 1;
+}
+
+void Fastcgipp::Manager_base::attach(
+        Request_base& request,
+        const Protocol::RequestId& id)
+{
+    request.m_timer = &m_timer;
+    request.m_expire = std::bind(
+            &Manager_base::expire,
+            this,
+            id,
+            std::placeholders::_1);
+    request.m_sliceMessages = m_sliceMessages;
+    request.m_sliceTime = m_sliceTime;
+}
+
+void Fastcgipp::Manager_base::replace(
+        Request_base& request,
+        Request_base& old,
+        const Protocol::RequestId& id)
+{
+#if FASTCGIPP_LOG_LEVEL > 3
+    ++m_replacementCount;
+#endif
+    attach(request, id);
+
+    // Anything that arrived since the old one last looked at it's queue
+    while(!old.m_messages.empty())
+    {
+        request.push(std::move(old.m_messages.front()));
+        old.m_messages.pop();
+    }
+
+    const auto deadline = old.m_deadline.load();
+    if(deadline != Timer::Clock::time_point::max())
+        request.setDeadline(deadline);
+
+    const Cancellation cancellation = old.cancelled();
+    if(cancellation != Cancellation::NONE)
+        request.cancel(cancellation);
+}
+
+void Fastcgipp::Manager_base::expire(Protocol::RequestId id, Message message)
+{
+    unsigned taskClass;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(m_requestsMutex);
+        const auto request = m_requests.find(id);
+        if(
+                request == m_requests.end()
+                || !request->second->expired()
+                || !request->second->cancel(Cancellation::DEADLINE))
+            return;
+        taskClass = request->second->schedulingClass();
+    }
+#if FASTCGIPP_LOG_LEVEL > 3
+    ++m_deadlineCount;
+#endif
+
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    queueTask(id, taskClass);
 }
 
 Fastcgipp::Manager_base::~Manager_base()
 {
-    instance=nullptr;
+    {
+        std::lock_guard<std::mutex> lock(instancesMutex);
+        instances.erase(this);
+    }
     terminate();
+    m_timer.stop();
     DIAG_LOG("Manager_base::~Manager_base(): New requests ============== " \
             << m_requestCount)
     DIAG_LOG("Manager_base::~Manager_base(): Max concurrent requests === " \
@@ -433,12 +881,298 @@ Fastcgipp::Manager_base::~Manager_base()
             << m_badSocketKillCount)
     DIAG_LOG("Manager_base::~Manager_base(): Request messages received = " \
             << m_messageCount)
+    DIAG_LOG("Manager_base::~Manager_base(): Aborted requests ========== " \
+            << m_abortCount)
+    DIAG_LOG("Manager_base::~Manager_base(): Reused FcgiId records ===== " \
+            << m_successorCount)
+    DIAG_LOG("Manager_base::~Manager_base(): Requests past deadline ==== " \
+            << m_deadlineCount)
+    DIAG_LOG("Manager_base::~Manager_base(): Requeued tasks ============ " \
+            << m_requeueCount)
+    DIAG_LOG("Manager_base::~Manager_base(): Replaced requests ========= " \
+            << m_replacementCount)
+    DIAG_LOG("Manager_base::~Manager_base(): Unconstructed requests ==== " \
+            << m_unconstructedCount)
     DIAG_LOG("Manager_base::~Manager_base(): Maximum active threads ==== " \
             << m_maxActiveThreads)
+    DIAG_LOG("Manager_base::~Manager_base(): Handler threads added ===== " \
+            << m_growCount)
+    DIAG_LOG("Manager_base::~Manager_base(): Handler threads removed === " \
+            << m_shrinkCount)
     DIAG_LOG("Manager_base::~Manager_base(): Remaining requests ======== " \
             << m_requests.size())
     DIAG_LOG("Manager_base::~Manager_base(): Remaining tasks =========== " \
-            << m_tasks.size())
+            << std::accumulate(
+                m_classes.cbegin(),
+                m_classes.cend(),
+                size_t(0),
+                [] (size_t x, const TaskClass& y)
+                {
+                    return x+y.tasks.size();
+                }))
     DIAG_LOG("Manager_base::~Manager_base(): Remaining local messages == " \
             << m_messages.size())
 }
+
+std::unique_lock<std::mutex> Fastcgipp::PendingRequest::handler()
+{
+    std::unique_lock<std::mutex> lock(m_messagesMutex);
+    while(!m_messages.empty())
+    {
+        Message message = std::move(m_messages.front());
+        m_messages.pop();
+        lock.unlock();
+
+        bool ready = false;
+        switch(cancelled())
+        {
+            case Cancellation::NONE:
+                break;
+
+            case Cancellation::ABORTED:
+            {
+                reject(Protocol::ProtocolStatus::REQUEST_COMPLETE);
+                return lock;
+            }
+
+            case Cancellation::DEADLINE:
+            {
+                // There's no point constructing the real request just to time
+                // it out
+                if(m_waiting)
+                    WARNING_LOG("Request exceeded it's deadline waiting on "\
+                            "the cache")
+                else
+                    WARNING_LOG("Request exceeded it's deadline before it "\
+                            "could be dispatched")
+                static const char timeout[] =
+                    "Status: 504 Gateway Timeout\n"
+                    "Content-Type: text/plain\r\n\r\n"
+                    "504 Gateway Timeout";
+                reply(timeout, sizeof(timeout)-1);
+                return lock;
+            }
+
+            case Cancellation::DISCONNECTED:
+                return lock;
+        }
+
+        if(!ready)
+        {
+            if(message.type == 0)
+            {
+                const Protocol::Header& header =
+                    *(const Protocol::Header*)message.data.data();
+                if(!m_parametersComplete)
+                {
+                    // Anything but parameters means a real request has to
+                    // deal with it
+                    if(header.type != Protocol::RecordType::PARAMS)
+                        ready = true;
+                    else if(header.contentLength == 0)
+                        ready = m_parametersComplete = true;
+                }
+                m_buffer.push_back(std::move(message));
+            }
+            else
+            {
+                // The cache's wake up call needn't be passed on
+                ready = true;
+                if(!m_waiting)
+                    m_buffer.push_back(std::move(message));
+            }
+        }
+
+        if(ready)
+        {
+            std::string key;
+            ResponseCache::Result result = ResponseCache::Result::BYPASS;
+            m_waiting = false;
+
+            if(m_manager.m_cache != nullptr
+                    && m_parametersComplete
+                    && cancelled() == Cancellation::NONE)
+            {
+                std::shared_ptr<const std::vector<char>> records;
+                result = m_manager.m_cache->lookup(*this, key, records);
+                if(result == ResponseCache::Result::HIT)
+                {
+                    reply(*records);
+                    return lock;
+                }
+                if(result == ResponseCache::Result::WAIT)
+                {
+                    m_waiting = true;
+                    lock.lock();
+                    continue;
+                }
+            }
+
+            std::unique_ptr<Request_base> request(m_manager.dispatch(*this));
+            if(!request)
+            {
+#if FASTCGIPP_LOG_LEVEL > 3
+                ++m_manager.m_unconstructedCount;
+#endif
+                if(result == ResponseCache::Result::GENERATE)
+                    m_manager.m_cache->abandon(key);
+                if(!m_finished)
+                    reject();
+                return lock;
+            }
+
+            if(result == ResponseCache::Result::GENERATE)
+            {
+                using namespace std::placeholders;
+                if(!request->redirect(m_manager.m_cache->capture(
+                            key,
+                            std::bind(
+                                &Transceiver::send,
+                                &m_manager.m_transceiver,
+                                _1,
+                                _2,
+                                _3))))
+                    m_manager.m_cache->abandon(key);
+            }
+
+            for(auto& buffered: m_buffer)
+                request->push(std::move(buffered));
+            m_buffer.clear();
+            replace(std::move(request));
+            lock.lock();
+            break;
+        }
+        lock.lock();
+    }
+    return lock;
+}
+
+std::function<void(Fastcgipp::Message)>
+Fastcgipp::PendingRequest::callback() const
+{
+    using namespace std::placeholders;
+    return std::bind(&Manager_base::push, &m_manager, m_id, _1);
+}
+
+std::string Fastcgipp::PendingRequest::parameter(const char* name) const
+{
+    const size_t nameSize = std::strlen(name);
+
+    for(const auto& message: m_buffer)
+    {
+        if(message.type != 0)
+            continue;
+
+        const Protocol::Header& header =
+            *(const Protocol::Header*)message.data.data();
+        if(header.type != Protocol::RecordType::PARAMS)
+            continue;
+
+        static thread_local std::vector<Protocol::Parameter> parameters;
+        parameters.clear();
+        const char* const body = message.data.data()+sizeof(header);
+        Protocol::decodeParameters(body, header.contentLength, parameters);
+
+        for(const Protocol::Parameter& parameter: parameters)
+            if(parameter.nameSize == nameSize && std::equal(
+                        name,
+                        name+nameSize,
+                        body+parameter.name))
+                return std::string(
+                        body+parameter.value,
+                        parameter.valueSize);
+    }
+
+    return std::string();
+}
+
+void Fastcgipp::PendingRequest::reject(Protocol::ProtocolStatus status)
+{
+    end(status, std::vector<char>());
+}
+
+void Fastcgipp::PendingRequest::reply(const char* data, size_t size)
+{
+    std::vector<char> record;
+    record.reserve(
+            size
+            +(size/0xfff8U+1)*(sizeof(Protocol::Header)+Protocol::chunkSize)
+            +sizeof(Protocol::Header)+sizeof(Protocol::EndRequest));
+
+    while(size != 0)
+    {
+        const size_t contentLength = std::min(size, size_t(0xfff8U));
+        const size_t start = record.size();
+        record.resize(
+                start
+                +(sizeof(Protocol::Header)
+                    +contentLength
+                    +Protocol::chunkSize-1)
+                /Protocol::chunkSize*Protocol::chunkSize);
+
+        Protocol::Header& header = *(Protocol::Header*)(record.data()+start);
+        header.version = Protocol::version;
+        header.type = Protocol::RecordType::OUT;
+        header.fcgiId = m_id.m_id;
+        header.contentLength = contentLength;
+        header.paddingLength =
+            record.size()-start-contentLength-sizeof(Protocol::Header);
+
+        std::copy(
+                data,
+                data+contentLength,
+                record.begin()+start+sizeof(Protocol::Header));
+
+        size -= contentLength;
+        data += contentLength;
+    }
+
+    end(Protocol::ProtocolStatus::REQUEST_COMPLETE, std::move(record));
+}
+
+void Fastcgipp::PendingRequest::reply(const std::vector<char>& records)
+{
+    std::vector<char> record;
+    record.reserve(
+            records.size()
+            +sizeof(Protocol::Header)
+            +sizeof(Protocol::EndRequest));
+    record.assign(records.cbegin(), records.cend());
+
+    // Patch our ID into the cached records
+    for(auto it = record.begin(); it != record.end();)
+    {
+        Protocol::Header& header = *(Protocol::Header*)&*it;
+        header.fcgiId = m_id.m_id;
+        it += sizeof(Protocol::Header)
+            +header.contentLength
+            +header.paddingLength;
+    }
+
+    end(Protocol::ProtocolStatus::REQUEST_COMPLETE, std::move(record));
+}
+
+void Fastcgipp::PendingRequest::end(
+        Protocol::ProtocolStatus status,
+        std::vector<char>&& record)
+{
+    const size_t start = record.size();
+    record.resize(
+            start+sizeof(Protocol::Header)+sizeof(Protocol::EndRequest));
+
+    Protocol::Header& header = *(Protocol::Header*)(record.data()+start);
+    header.version = Protocol::version;
+    header.type = Protocol::RecordType::END_REQUEST;
+    header.fcgiId = m_id.m_id;
+    header.contentLength = sizeof(Protocol::EndRequest);
+    header.paddingLength = 0;
+
+    Protocol::EndRequest& body = *(Protocol::EndRequest*)(
+            record.data()+start+sizeof(header));
+    body.appStatus = 0;
+    body.protocolStatus = status;
+
+    m_finished = true;
+    m_ended = true;
+    m_manager.m_transceiver.send(m_id.m_socket, std::move(record), m_kill);
+}
@@ -0,0 +1,245 @@
+/*!
+ * @file       prefork.cpp
+ * @brief      Defines the Prefork class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/prefork.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <pthread.h>
+
+Fastcgipp::Prefork::Prefork(unsigned workers):
+    m_workers(std::max(1u, workers)),
+    m_slot(0),
+    m_spawnCount(0),
+    m_crashCount(0)
+{
+    for(auto& worker: m_workers)
+    {
+        worker.pid = 0;
+        worker.respawn = Clock::time_point::min();
+    }
+    sigemptyset(&m_mask);
+}
+
+bool Fastcgipp::Prefork::adopt(Manager_base& manager) const
+{
+    for(const auto listener: m_sockets.listeners())
+        if(!manager.adopt(listener))
+            return false;
+    return true;
+}
+
+int Fastcgipp::Prefork::run(const std::function<int()>& worker)
+{
+    // We wait on these synchronously rather than with handlers
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, &m_mask);
+
+    bool stopping = false;
+    std::vector<unsigned> rolling;
+
+    while(true)
+    {
+        const auto now = Clock::now();
+        auto wakeup = Clock::time_point::max();
+        bool running = !m_retiring.empty();
+
+        for(unsigned slot=0; slot<m_workers.size(); ++slot)
+        {
+            Worker& process = m_workers[slot];
+            if(!stopping && process.pid == 0)
+            {
+                if(process.respawn <= now)
+                    spawn(slot, worker);
+                else
+                    wakeup = std::min(wakeup, process.respawn);
+            }
+            if(process.pid != 0)
+                running = true;
+        }
+
+        if(stopping && !running)
+            break;
+
+        // Replace one worker at a time, waiting for the old one to finish
+        if(!stopping && m_retiring.empty() && !rolling.empty())
+        {
+            const unsigned slot = rolling.front();
+            rolling.erase(rolling.begin());
+            const pid_t old = m_workers[slot].pid;
+            spawn(slot, worker);
+            if(old != 0)
+            {
+                m_retiring.push_back(old);
+                kill(old, SIGUSR1);
+            }
+        }
+
+        siginfo_t info;
+        int signum;
+        if(wakeup == Clock::time_point::max())
+            signum = sigwaitinfo(&signals, &info);
+        else
+        {
+            const auto wait = std::chrono::duration_cast<
+                std::chrono::nanoseconds>(wakeup-now).count();
+            timespec timeout;
+            timeout.tv_sec = wait/1000000000;
+            timeout.tv_nsec = wait%1000000000;
+            signum = sigtimedwait(&signals, &info, &timeout);
+        }
+
+        switch(signum)
+        {
+            case SIGCHLD:
+            {
+                int status;
+                pid_t pid;
+                while((pid = waitpid(-1, &status, WNOHANG)) > 0)
+                {
+                    const auto retiring = std::find(
+                            m_retiring.begin(),
+                            m_retiring.end(),
+                            pid);
+                    if(retiring != m_retiring.end())
+                    {
+                        m_retiring.erase(retiring);
+                        continue;
+                    }
+
+                    for(auto& process: m_workers)
+                    {
+                        if(process.pid != pid)
+                            continue;
+                        process.pid = 0;
+
+                        if(stopping)
+                            break;
+
+                        ++m_crashCount;
+                        if(WIFSIGNALED(status))
+                            WARNING_LOG("Worker " << pid \
+                                    << " was killed by signal " \
+                                    << WTERMSIG(status))
+                        else
+                            WARNING_LOG("Worker " << pid \
+                                    << " exited with status " \
+                                    << WEXITSTATUS(status))
+
+                        // Don't spin on a worker that can't start
+                        const auto died = Clock::now();
+                        process.respawn =
+                            died-process.started < std::chrono::seconds(1) ?
+                            died+std::chrono::seconds(1):died;
+                        break;
+                    }
+                }
+                break;
+            }
+
+            case SIGTERM:
+            case SIGINT:
+            {
+                DIAG_LOG("Prefork terminating workers")
+                stopping = true;
+                signal(SIGTERM);
+                break;
+            }
+
+            case SIGUSR1:
+            {
+                DIAG_LOG("Prefork stopping workers")
+                stopping = true;
+                signal(SIGUSR1);
+                break;
+            }
+
+            case SIGHUP:
+            {
+                DIAG_LOG("Prefork restarting workers")
+                for(unsigned slot=0; slot<m_workers.size(); ++slot)
+                    if(std::find(rolling.begin(), rolling.end(), slot)
+                            == rolling.end())
+                        rolling.push_back(slot);
+                break;
+            }
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &m_mask, nullptr);
+    DIAG_LOG("Prefork::run(): Workers started ===== " << m_spawnCount)
+    DIAG_LOG("Prefork::run(): Workers crashed ===== " << m_crashCount)
+    return 0;
+}
+
+void Fastcgipp::Prefork::spawn(
+        unsigned slot,
+        const std::function<int()>& worker)
+{
+    Worker& process = m_workers[slot];
+    const pid_t pid = fork();
+
+    if(pid < 0)
+    {
+        ERROR_LOG("Unable to fork a worker process: " << std::strerror(errno))
+        process.pid = 0;
+        process.respawn = Clock::now()+std::chrono::seconds(1);
+        return;
+    }
+
+    if(pid == 0)
+    {
+        m_slot = slot;
+        m_retiring.clear();
+        pthread_sigmask(SIG_SETMASK, &m_mask, nullptr);
+        _exit(worker());
+    }
+
+    ++m_spawnCount;
+    process.pid = pid;
+    process.started = Clock::now();
+}
+
+void Fastcgipp::Prefork::signal(int signum) const
+{
+    for(const auto& process: m_workers)
+        if(process.pid != 0)
+            kill(process.pid, signum);
+    for(const auto pid: m_retiring)
+        kill(pid, signum);
+}
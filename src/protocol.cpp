@@ -29,6 +29,24 @@
 #include "fastcgi++/protocol.hpp"
 #include "fastcgi++/config.hpp"
 
+#include <cstring>
+
+namespace
+{
+    //! Read a four byte name or value length
+    inline uint32_t readLength(const unsigned char* source)
+    {
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint32_t length;
+        std::memcpy(&length, source, sizeof(length));
+        return __builtin_bswap32(length) & 0x7fffffff;
+#else
+        return Fastcgipp::Protocol::BigEndian<uint32_t>::read(source)
+            & 0x7fffffff;
+#endif
+    }
+}
+
 bool Fastcgipp::Protocol::processParamHeader(
         std::vector<char>::const_iterator data,
         const std::vector<char>::const_iterator dataEnd,
@@ -79,6 +97,59 @@ bool Fastcgipp::Protocol::processParamHeader(
         return true;
 }
 
+size_t Fastcgipp::Protocol::decodeParameters(
+        const char* data,
+        size_t size,
+        std::vector<Parameter>& parameters)
+{
+    const unsigned char* const start = (const unsigned char*)data;
+    size_t position = 0;
+
+    while(size-position >= 2)
+    {
+        const unsigned char* const pair = start+position;
+        const size_t remaining = size-position;
+        size_t header;
+        uint32_t nameSize;
+        uint32_t valueSize;
+
+        if(!((pair[0] | pair[1]) & 0x80))
+        {
+            // By far the most common case is both lengths being short
+            header = 2;
+            nameSize = pair[0];
+            valueSize = pair[1];
+        }
+        else
+        {
+            const size_t nameHeader = pair[0]&0x80 ? 4 : 1;
+            if(remaining < nameHeader+1)
+                break;
+            const size_t valueHeader = pair[nameHeader]&0x80 ? 4 : 1;
+            header = nameHeader+valueHeader;
+            if(remaining < header)
+                break;
+            nameSize = nameHeader==4 ? readLength(pair) : pair[0];
+            valueSize = valueHeader==4 ?
+                readLength(pair+nameHeader) : pair[nameHeader];
+        }
+
+        if(size_t(nameSize)+valueSize > remaining-header)
+            break;
+
+        Parameter parameter;
+        parameter.name = uint32_t(position+header);
+        parameter.nameSize = nameSize;
+        parameter.value = parameter.name+nameSize;
+        parameter.valueSize = valueSize;
+        parameters.push_back(parameter);
+
+        position += header+nameSize+valueSize;
+    }
+
+    return position;
+}
+
 const Fastcgipp::Protocol::ManagementReply<14, 2>
 Fastcgipp::Protocol::maxConnsReply("FCGI_MAX_CONNS", "10");
 
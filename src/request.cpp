@@ -29,9 +29,39 @@
 #include "fastcgi++/request.hpp"
 #include "fastcgi++/log.hpp"
 
-template void Fastcgipp::Request<char>::complete();
-template void Fastcgipp::Request<wchar_t>::complete();
-template<class charT> void Fastcgipp::Request<charT>::complete()
+Fastcgipp::Request_base::~Request_base()
+{
+    if(m_timer != nullptr)
+        m_timer->cancel(m_timeout);
+}
+
+bool Fastcgipp::Request_base::cancel(Cancellation reason)
+{
+    Cancellation expected = Cancellation::NONE;
+    if(!m_cancellation.compare_exchange_strong(
+                expected,
+                reason,
+                std::memory_order_acq_rel))
+        return false;
+
+    // The content is irrelevant as handler() checks the token first
+    push(Message());
+    return true;
+}
+
+void Fastcgipp::Request_base::setDeadline(Timer::Clock::time_point deadline)
+{
+    m_deadline = deadline;
+    if(m_timer != nullptr)
+    {
+        m_timer->cancel(m_timeout);
+        m_timeout = m_timer->push(m_expire, Message(), deadline);
+    }
+}
+
+template void Fastcgipp::Request<char>::complete(bool);
+template void Fastcgipp::Request<wchar_t>::complete(bool);
+template<class charT> void Fastcgipp::Request<charT>::complete(bool aborted)
 {
     out.flush();
     err.flush();
@@ -48,9 +78,10 @@ template<class charT> void Fastcgipp::Request<charT>::complete()
 
     Protocol::EndRequest& body =
         *(Protocol::EndRequest*)(record.data()+sizeof(header));
-    body.appStatus = 0;
+    body.appStatus = aborted ? 1:0;
     body.protocolStatus = m_status;
 
+    m_ended = true;
     m_send(m_id.m_socket, std::move(record), m_kill);
 }
 
@@ -59,13 +90,51 @@ template std::unique_lock<std::mutex> Fastcgipp::Request<wchar_t>::handler();
 template<class charT>
 std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
 {
+    const unsigned sliceMessages = m_sliceMessages*m_weight;
+    const auto sliceTime = m_sliceTime*m_weight;
+    const auto sliceStart =
+        sliceTime != std::chrono::microseconds::zero() ?
+        std::chrono::steady_clock::now():std::chrono::steady_clock::time_point();
+    unsigned handled = 0;
+
     std::unique_lock<std::mutex> lock(m_messagesMutex);
     while(!m_messages.empty())
     {
+        // Yield if we've used up our time slice
+        if(handled > 0 && (
+                    handled == sliceMessages
+                    || (sliceTime != std::chrono::microseconds::zero()
+                        && std::chrono::steady_clock::now()-sliceStart
+                            >= sliceTime)))
+            break;
+        ++handled;
+
         Message message = std::move(m_messages.front());
         m_messages.pop();
         lock.unlock();
 
+        switch(cancelled())
+        {
+            case Cancellation::NONE:
+                break;
+
+            case Cancellation::ABORTED:
+            {
+                complete(true);
+                goto exit;
+            }
+
+            case Cancellation::DEADLINE:
+            {
+                WARNING_LOG("Request exceeded it's deadline")
+                timeoutHandler();
+                goto exit;
+            }
+
+            case Cancellation::DISCONNECTED:
+                goto exit;
+        }
+
         if(message.type == 0)
         {
             const Protocol::Header& header =
@@ -75,7 +144,7 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
 
             if(header.type == Protocol::RecordType::ABORT_REQUEST)
             {
-                complete();
+                complete(true);
                 goto exit;
             }
 
@@ -102,6 +171,8 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
 
                     if(header.contentLength == 0)
                     {
+                        const unsigned previousClass = m_class;
+                        m_class = classify();
                         if(environment().contentLength > m_maxPostSize)
                         {
                             bigPostErrorHandler();
@@ -109,6 +180,10 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
                         }
                         m_state = Protocol::RecordType::IN;
                         lock.lock();
+
+                        // Yield so the Manager can requeue us in our class
+                        if(m_class != previousClass)
+                            goto exit;
                         continue;
                     }
                     m_environment.fill(body,  bodyEnd);
@@ -157,7 +232,27 @@ std::unique_lock<std::mutex>Fastcgipp::Request<charT>::handler()
         m_message = std::move(message);
         if(response())
         {
-            complete();
+            // The response may have been cut short by cancellation
+            switch(cancelled())
+            {
+                case Cancellation::NONE:
+                    complete();
+                    break;
+
+                case Cancellation::ABORTED:
+                    complete(true);
+                    break;
+
+                case Cancellation::DEADLINE:
+                {
+                    WARNING_LOG("Request exceeded it's deadline")
+                    timeoutHandler();
+                    break;
+                }
+
+                case Cancellation::DISCONNECTED:
+                    break;
+            }
             break;
         }
         lock.lock();
@@ -206,6 +301,26 @@ template<class charT> void Fastcgipp::Request<charT>::bigPostErrorHandler()
     complete();
 }
 
+template void Fastcgipp::Request<char>::timeoutHandler();
+template void Fastcgipp::Request<wchar_t>::timeoutHandler();
+template<class charT> void Fastcgipp::Request<charT>::timeoutHandler()
+{
+    out << \
+"Status: 504 Gateway Timeout\n"\
+"Content-Type: text/html; charset=utf-8\r\n\r\n"\
+"<!DOCTYPE html>"\
+"<html lang='en'>"\
+    "<head>"\
+        "<title>504 Gateway Timeout</title>"\
+    "</head>"\
+    "<body>"\
+        "<h1>504 Gateway Timeout</h1>"\
+    "</body>"\
+"</html>";
+
+    complete();
+}
+
 template void Fastcgipp::Request<wchar_t>::configure(
         const Protocol::RequestId& id,
         const Protocol::Role& role,
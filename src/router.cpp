@@ -0,0 +1,212 @@
+/*!
+ * @file       router.cpp
+ * @brief      Defines the PathTrie class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/router.hpp"
+#include "fastcgi++/log.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+bool Fastcgipp::PathTrie::insert(const std::string& pattern, unsigned value)
+{
+    Node* node = &m_root;
+    const char* const patternEnd = pattern.data()+pattern.size();
+
+    for(const char* it = pattern.data(); it != patternEnd;)
+    {
+        if(*it == ':')
+        {
+            const char* const nameEnd = std::find(++it, patternEnd, '/');
+            if(nameEnd == it)
+            {
+                ERROR_LOG("Route pattern " << pattern.c_str() \
+                        << " has an unnamed segment")
+                return false;
+            }
+
+            const std::string name(it, nameEnd);
+            if(!node->param)
+            {
+                node->param.reset(new Node);
+                node->paramName = name;
+            }
+            else if(node->paramName != name)
+            {
+                ERROR_LOG("Route pattern " << pattern.c_str() \
+                        << " conflicts with an existing segment named " \
+                        << node->paramName.c_str())
+                return false;
+            }
+            node = node->param.get();
+            it = nameEnd;
+        }
+        else if(*it == '*')
+        {
+            if(std::find(++it, patternEnd, '/') != patternEnd || it==patternEnd)
+            {
+                ERROR_LOG("Route pattern " << pattern.c_str() \
+                        << " has a misplaced or unnamed catch-all")
+                return false;
+            }
+            if(node->catchAll)
+            {
+                ERROR_LOG("Route pattern " << pattern.c_str() \
+                        << " conflicts with an existing route")
+                return false;
+            }
+            node->catchAll = true;
+            node->catchAllName.assign(it, patternEnd);
+            node->catchAllValue = value;
+            return true;
+        }
+        else
+        {
+            const char* literalEnd = it;
+            while(literalEnd != patternEnd
+                    && *literalEnd != ':'
+                    && *literalEnd != '*')
+                ++literalEnd;
+            node = insertLiteral(node, it, literalEnd);
+            it = literalEnd;
+        }
+    }
+
+    if(node->terminal)
+    {
+        ERROR_LOG("Route pattern " << pattern.c_str() \
+                << " conflicts with an existing route")
+        return false;
+    }
+    node->terminal = true;
+    node->value = value;
+    return true;
+}
+
+Fastcgipp::PathTrie::Node* Fastcgipp::PathTrie::insertLiteral(
+        Node* node,
+        const char* begin,
+        const char* end)
+{
+    while(begin != end)
+    {
+        auto child = std::find_if(
+                node->children.begin(),
+                node->children.end(),
+                [begin] (const std::unique_ptr<Node>& x)
+                {
+                    return x->prefix.front() == *begin;
+                });
+
+        if(child == node->children.end())
+        {
+            node->children.emplace_back(new Node);
+            node->children.back()->prefix.assign(begin, end);
+            return node->children.back().get();
+        }
+
+        const std::string& prefix = (*child)->prefix;
+        const size_t common = std::mismatch(
+                prefix.begin(),
+                prefix.begin()+std::min(prefix.size(), size_t(end-begin)),
+                begin).first - prefix.begin();
+
+        // Split the child so the common part becomes a node of it's own
+        if(common < prefix.size())
+        {
+            std::unique_ptr<Node> split(new Node);
+            split->prefix = prefix.substr(0, common);
+            (*child)->prefix.erase(0, common);
+            split->children.push_back(std::move(*child));
+            *child = std::move(split);
+        }
+
+        node = child->get();
+        begin += common;
+    }
+    return node;
+}
+
+bool Fastcgipp::PathTrie::match(
+        const char* begin,
+        const char* end,
+        unsigned& value,
+        std::map<std::string, std::string>& captures) const
+{
+    captures.clear();
+    return match(m_root, begin, end, value, captures);
+}
+
+bool Fastcgipp::PathTrie::match(
+        const Node& node,
+        const char* begin,
+        const char* end,
+        unsigned& value,
+        std::map<std::string, std::string>& captures)
+{
+    if(begin == end && node.terminal)
+    {
+        value = node.value;
+        return true;
+    }
+
+    for(const auto& child: node.children)
+    {
+        const std::string& prefix = child->prefix;
+        if(begin != end
+                && *begin == prefix.front()
+                && size_t(end-begin) >= prefix.size()
+                && std::memcmp(begin, prefix.data(), prefix.size()) == 0)
+        {
+            if(match(*child, begin+prefix.size(), end, value, captures))
+                return true;
+            break;
+        }
+    }
+
+    if(node.param)
+    {
+        const char* const segmentEnd = std::find(begin, end, '/');
+        if(segmentEnd != begin)
+        {
+            std::string& capture = captures[node.paramName];
+            capture.assign(begin, segmentEnd);
+            if(match(*node.param, segmentEnd, end, value, captures))
+                return true;
+            captures.erase(node.paramName);
+        }
+    }
+
+    if(node.catchAll)
+    {
+        captures[node.catchAllName].assign(begin, end);
+        value = node.catchAllValue;
+        return true;
+    }
+
+    return false;
+}
@@ -34,6 +34,7 @@
 
 #ifdef FASTCGIPP_LINUX
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #elif defined FASTCGIPP_UNIX
 #include <algorithm>
 #endif
@@ -44,111 +45,144 @@
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <pwd.h>
 #include <grp.h>
 #include <cstring>
+#include <cstdlib>
+#include <string>
+#include <limits>
+#include <algorithm>
 
 Fastcgipp::Socket::Socket(
         const socket_t& socket,
-        SocketGroup& group,
-        bool valid):
-    m_data(new Data(socket, valid, group)),
+        Transport& transport,
+        uint32_t generation):
+    m_data(new Data(socket, transport, generation)),
     m_original(true)
-{
-    if(!group.pollAdd(socket))
-    {
-        ERROR_LOG("Unable to add socket " << socket << " to poll list: " \
-                << std::strerror(errno))
-        close();
-    }
-}
+{}
 
 ssize_t Fastcgipp::Socket::read(char* buffer, size_t size) const
 {
     if(!valid())
         return -1;
+    return m_data->m_transport.readSocket(*this, buffer, size);
+}
+
+ssize_t Fastcgipp::Socket::write(const char* buffer, size_t size) const
+{
+    if(!valid() || m_data->m_closing)
+        return -1;
+    return m_data->m_transport.writeSocket(*this, buffer, size);
+}
 
-    const ssize_t count = ::read(m_data->m_socket, buffer, size);
+void Fastcgipp::Socket::close() const
+{
+    if(valid())
+        m_data->m_transport.closeSocket(*this);
+}
+
+Fastcgipp::Socket::~Socket()
+{
+    if(m_original && valid())
+        m_data->m_transport.closeSocket(*this);
+    release();
+}
+
+ssize_t Fastcgipp::SocketGroup::readSocket(
+        const Socket& socket,
+        char* buffer,
+        size_t size)
+{
+    const ssize_t count = ::read(socket.m_data->m_socket, buffer, size);
     if(count<0)
     {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
         WARNING_LOG("Socket read() error on fd " \
-                << m_data->m_socket << ": " << std::strerror(errno))
-        close();
+                << socket.m_data->m_socket << ": " << std::strerror(errno))
+        closeSocket(socket);
         return -1;
     }
-    if(count == 0 && m_data->m_closing)
+    if(count == 0 && socket.m_data->m_closing)
     {
 #if FASTCGIPP_LOG_LEVEL > 3
-        ++m_data->m_group.m_connectionRDHupCount;
+        ++m_connectionRDHupCount;
 #endif
-        close();
+        closeSocket(socket);
         return -1;
     }
 
 #if FASTCGIPP_LOG_LEVEL > 3
-    m_data->m_group.m_bytesReceived += count;
+    m_bytesReceived += count;
 #endif
 
     return count;
 }
 
-ssize_t Fastcgipp::Socket::write(const char* buffer, size_t size) const
+ssize_t Fastcgipp::SocketGroup::writeSocket(
+        const Socket& socket,
+        const char* buffer,
+        size_t size)
 {
-    if(!valid() || m_data->m_closing)
-        return -1;
-
-    const ssize_t count = ::send(m_data->m_socket, buffer, size, MSG_NOSIGNAL);
+    const ssize_t count = ::send(
+            socket.m_data->m_socket,
+            buffer,
+            size,
+            MSG_NOSIGNAL);
     if(count<0)
     {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
         WARNING_LOG("Socket write() error on fd " \
-                << m_data->m_socket << ": " << strerror(errno))
-        close();
+                << socket.m_data->m_socket << ": " << strerror(errno))
+        closeSocket(socket);
         return -1;
     }
 
 #if FASTCGIPP_LOG_LEVEL > 3
-    m_data->m_group.m_bytesSent += count;
+    m_bytesSent += count;
 #endif
 
     return count;
 }
 
-void Fastcgipp::Socket::close() const
+void Fastcgipp::SocketGroup::closeSocket(const Socket& socket)
 {
-    if(valid())
-    {
-        ::shutdown(m_data->m_socket, SHUT_RDWR);
-        ::close(m_data->m_socket);
-        m_data->m_valid = false;
-        m_data->m_group.pollDel(m_data->m_socket);
-        m_data->m_group.m_sockets.erase(m_data->m_socket);
+    Socket::Data& data = *socket.m_data;
+    ::shutdown(data.m_socket, SHUT_RDWR);
+    ::close(data.m_socket);
+    data.m_valid = false;
+    pollDel(data.m_socket);
+    m_timeouts.cancel(data.m_timeout);
 #if FASTCGIPP_LOG_LEVEL > 3
-        if(!m_data->m_closing)
-            ++m_data->m_group.m_connectionKillCount;
+    if(!data.m_closing)
+        ++m_connectionKillCount;
 #endif
-    }
-}
-
-Fastcgipp::Socket::~Socket()
-{
-    if(m_original && valid())
-    {
-        ::shutdown(m_data->m_socket, SHUT_RDWR);
-        ::close(m_data->m_socket);
-        m_data->m_valid = false;
-        m_data->m_group.pollDel(m_data->m_socket);
-    }
+    remove(data.m_socket);
 }
 
 Fastcgipp::SocketGroup::SocketGroup():
 #ifdef FASTCGIPP_LINUX
     m_poll(epoll_create1(0)),
+    m_wakeEvent(eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)),
 #endif
     m_waking(false),
     m_accept(true),
-    m_refreshListeners(false)
+    m_refreshListeners(false),
+    m_share(false),
+    m_socketCount(0),
+    m_timeouts(std::chrono::milliseconds(10)),
+    m_acceptTimeout(Clock::duration::zero()),
+    m_acceptBatch(64),
+    m_acceptRate(0),
+    m_acceptTokens(0),
+    m_maxConnections(0),
+    m_listening(false),
+    m_reserve(open("/dev/null", O_RDONLY|O_CLOEXEC))
 #if FASTCGIPP_LOG_LEVEL > 3
     ,m_incomingConnectionCount(0),
     m_outgoingConnectionCount(0),
@@ -159,21 +193,45 @@ Fastcgipp::SocketGroup::SocketGroup():
 #endif
 {
     // Add our wakeup socket into the poll list
+#ifdef FASTCGIPP_LINUX
+    if(m_wakeEvent == -1)
+        FAIL_LOG("Unable to create wakeup eventfd: " << std::strerror(errno))
+    pollAdd(m_wakeEvent);
+#else
     socketpair(AF_UNIX, SOCK_STREAM, 0, m_wakeSockets);
     pollAdd(m_wakeSockets[1]);
+#endif
     DIAG_LOG("SocketGroup::SocketGroup(): Initialized ")
 }
 
 Fastcgipp::SocketGroup::~SocketGroup()
 {
+    // Hang up on whatever connections are left
+    for(auto& slot: m_sockets)
+    {
+        if(slot.socket.valid())
+        {
+            ::shutdown(slot.socket.m_data->m_socket, SHUT_RDWR);
+            ::close(slot.socket.m_data->m_socket);
+            slot.socket.m_data->m_valid = false;
+        }
+    }
+
 #ifdef FASTCGIPP_LINUX
     close(m_poll);
-#endif
+    close(m_wakeEvent);
+#else
     close(m_wakeSockets[0]);
     close(m_wakeSockets[1]);
+#endif
+    if(m_reserve != -1)
+        close(m_reserve);
+    if(m_share)
+        m_adopted.insert(m_listeners.cbegin(), m_listeners.cend());
     for(const auto& listener: m_listeners)
     {
-        ::shutdown(listener, SHUT_RDWR);
+        if(m_adopted.find(listener) == m_adopted.end())
+            ::shutdown(listener, SHUT_RDWR);
         ::close(listener);
     }
     DIAG_LOG("SocketGroup::~SocketGroup(): Incoming sockets ======== " \
@@ -185,27 +243,37 @@ Fastcgipp::SocketGroup::~SocketGroup()
     DIAG_LOG("SocketGroup::~SocketGroup(): Remotely closed sockets = " \
             << m_connectionRDHupCount)
     DIAG_LOG("SocketGroup::~SocketGroup(): Remaining sockets ======= " \
-            << m_sockets.size())
+            << m_socketCount)
     DIAG_LOG("SocketGroup::~SocketGroup(): Bytes sent ===== " << m_bytesSent)
     DIAG_LOG("SocketGroup::~SocketGroup(): Bytes received = " \
             << m_bytesReceived)
 }
 
-bool Fastcgipp::SocketGroup::listen()
+bool Fastcgipp::SocketGroup::listen(const ListenOptions& options)
 {
     const int listen=0;
 
-    fcntl(listen, F_SETFL, (fcntl(listen, F_GETFL)|O_NONBLOCK)^O_NONBLOCK);
-
     if(m_listeners.find(listen) == m_listeners.end())
     {
-        if(::listen(listen, 100) < 0)
+        sockaddr_storage address;
+        socklen_t size = sizeof(address);
+        const bool tcp = getsockname(listen, (sockaddr*)&address, &size) == 0
+            && (address.ss_family == AF_INET || address.ss_family == AF_INET6);
+
+        if(
+                !configureListener(listen, options, tcp)
+                || ::listen(listen, options.backlog) < 0)
         {
             ERROR_LOG("Unable to listen on default FastCGI socket: "\
                     << std::strerror(errno));
             return false;
         }
         m_listeners.insert(listen);
+        if(options.noDelay
+                || options.receiveBuffer
+                || options.sendBuffer
+                || options.busyPoll)
+            m_options[listen] = options;
         m_refreshListeners = true;
         return true;
     }
@@ -220,7 +288,8 @@ bool Fastcgipp::SocketGroup::listen(
         const char* name,
         uint32_t permissions,
         const char* owner,
-        const char* group)
+        const char* group,
+        const ListenOptions& options)
 {
     if(std::remove(name) != 0 && errno != ENOENT)
     {
@@ -242,6 +311,12 @@ bool Fastcgipp::SocketGroup::listen(
     address.sun_family = AF_UNIX;
     std::strncpy(address.sun_path, name, sizeof(address.sun_path) - 1);
 
+    if(!configureListener(fd, options, false))
+    {
+        close(fd);
+        return false;
+    }
+
     if(bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0)
     {
         ERROR_LOG("Unable to bind to unix socket \"" << name << "\": " \
@@ -280,7 +355,7 @@ bool Fastcgipp::SocketGroup::listen(
         }
     }
 
-    if(::listen(fd, 100) < 0)
+    if(::listen(fd, options.backlog) < 0)
     {
         ERROR_LOG("Unable to listen on unix socket :\"" << name << "\": "\
                 << std::strerror(errno));
@@ -289,13 +364,19 @@ bool Fastcgipp::SocketGroup::listen(
     }
 
     m_listeners.insert(fd);
+    if(options.noDelay
+            || options.receiveBuffer
+            || options.sendBuffer
+            || options.busyPoll)
+        m_options[fd] = options;
     m_refreshListeners = true;
     return true;
 }
 
 bool Fastcgipp::SocketGroup::listen(
         const char* interface,
-        const char* service)
+        const char* service,
+        const ListenOptions& options)
 {
     if(service == nullptr)
     {
@@ -324,14 +405,15 @@ bool Fastcgipp::SocketGroup::listen(
     }
 
     int fd=-1;
-    for(auto i=result; i!=nullptr; i=result->ai_next)
+    for(auto i=result; i!=nullptr; i=i->ai_next)
     {
         fd = socket(i->ai_family, i->ai_socktype, i->ai_protocol);
         if(fd == -1)
             continue;
         if(
-                bind(fd, i->ai_addr, i->ai_addrlen) == 0
-                && ::listen(fd, 100) == 0)
+                configureListener(fd, options, true)
+                && bind(fd, i->ai_addr, i->ai_addrlen) == 0
+                && ::listen(fd, options.backlog) == 0)
             break;
         close(fd);
         fd = -1;
@@ -346,10 +428,225 @@ bool Fastcgipp::SocketGroup::listen(
     }
 
     m_listeners.insert(fd);
+    if(options.noDelay
+            || options.receiveBuffer
+            || options.sendBuffer
+            || options.busyPoll)
+        m_options[fd] = options;
+    m_refreshListeners = true;
+    return true;
+}
+
+bool Fastcgipp::SocketGroup::configureListener(
+        socket_t listener,
+        const ListenOptions& options,
+        bool tcp)
+{
+    const auto set = [listener] (int level, int option, int value)
+    {
+        if(setsockopt(listener, level, option, &value, sizeof(value)) != 0)
+        {
+            WARNING_LOG("Unable to set socket option " << option \
+                    << " on listener " << listener << ": " \
+                    << std::strerror(errno))
+            return false;
+        }
+        return true;
+    };
+
+    // Accept queues are drained until EAGAIN
+    if(fcntl(listener, F_SETFL, fcntl(listener, F_GETFL)|O_NONBLOCK) < 0)
+    {
+        WARNING_LOG("Unable to set NONBLOCK on listener " << listener \
+                << ": " << std::strerror(errno))
+        return false;
+    }
+
+    // SO_REUSEPORT is asked for explicitly so it must work
+    if(options.reusePort && !set(SOL_SOCKET, SO_REUSEPORT, 1))
+        return false;
+
+    if(tcp)
+    {
+        if(options.reuseAddress)
+            set(SOL_SOCKET, SO_REUSEADDR, 1);
+        if(options.deferAccept)
+            set(IPPROTO_TCP, TCP_DEFER_ACCEPT, options.deferAccept);
+        if(options.fastOpen)
+            set(IPPROTO_TCP, TCP_FASTOPEN, options.fastOpen);
+    }
+
+    // Accepted sockets inherit these but they affect the handshake too
+    if(options.receiveBuffer)
+        set(SOL_SOCKET, SO_RCVBUF, options.receiveBuffer);
+    if(options.sendBuffer)
+        set(SOL_SOCKET, SO_SNDBUF, options.sendBuffer);
+
+    return true;
+}
+
+void Fastcgipp::SocketGroup::configureConnection(
+        socket_t socket,
+        const ListenOptions& options)
+{
+    const auto set = [socket] (int level, int option, int value)
+    {
+        if(setsockopt(socket, level, option, &value, sizeof(value)) != 0)
+        {
+            DIAG_LOG("Unable to set socket option " << option \
+                    << " on connection " << socket << ": " \
+                    << std::strerror(errno))
+        }
+    };
+
+    // TCP_NODELAY fails harmlessly on unix sockets
+    if(options.noDelay)
+        set(IPPROTO_TCP, TCP_NODELAY, 1);
+    if(options.receiveBuffer)
+        set(SOL_SOCKET, SO_RCVBUF, options.receiveBuffer);
+    if(options.sendBuffer)
+        set(SOL_SOCKET, SO_SNDBUF, options.sendBuffer);
+#ifdef SO_BUSY_POLL
+    if(options.busyPoll)
+        set(SOL_SOCKET, SO_BUSY_POLL, options.busyPoll);
+#endif
+}
+
+void Fastcgipp::SocketGroup::incomingCpu(unsigned cpu)
+{
+#ifdef SO_INCOMING_CPU
+    const int value = cpu;
+    for(const auto listener: m_listeners)
+        if(setsockopt(
+                    listener,
+                    SOL_SOCKET,
+                    SO_INCOMING_CPU,
+                    &value,
+                    sizeof(value)) != 0)
+            WARNING_LOG("Unable to set SO_INCOMING_CPU on listener " \
+                    << listener << ": " << std::strerror(errno))
+#endif
+}
+
+bool Fastcgipp::SocketGroup::adopt(socket_t listener)
+{
+    if(m_listeners.find(listener) != m_listeners.end())
+    {
+        ERROR_LOG("Socket " << listener << " already being listened to")
+        return false;
+    }
+
+    int value;
+    socklen_t size = sizeof(value);
+    if(getsockopt(listener, SOL_SOCKET, SO_TYPE, &value, &size) < 0
+            || value != SOCK_STREAM)
+    {
+        ERROR_LOG("Socket " << listener << " isn't a stream socket")
+        return false;
+    }
+
+    size = sizeof(value);
+    if(getsockopt(listener, SOL_SOCKET, SO_ACCEPTCONN, &value, &size) < 0
+            || value == 0)
+    {
+        ERROR_LOG("Socket " << listener << " isn't listening")
+        return false;
+    }
+
+    sockaddr_storage address;
+    size = sizeof(address);
+    if(getsockname(listener, (sockaddr*)&address, &size) < 0
+            || (address.ss_family != AF_UNIX
+                && address.ss_family != AF_INET
+                && address.ss_family != AF_INET6))
+    {
+        ERROR_LOG("Socket " << listener << " has an unsupported address family")
+        return false;
+    }
+
+    if(fcntl(listener, F_SETFL, fcntl(listener, F_GETFL)|O_NONBLOCK) < 0)
+    {
+        ERROR_LOG("Unable to set NONBLOCK on listener " << listener \
+                << " with fcntl(): " << std::strerror(errno))
+        return false;
+    }
+
+    m_listeners.insert(listener);
+    m_adopted.insert(listener);
     m_refreshListeners = true;
     return true;
 }
 
+bool Fastcgipp::SocketGroup::listenActivated(const char* name)
+{
+    // The first socket systemd passes
+    const int first = 3;
+
+    const char* const pid = std::getenv("LISTEN_PID");
+    const char* const fds = std::getenv("LISTEN_FDS");
+    if(pid == nullptr || fds == nullptr)
+    {
+        ERROR_LOG("No sockets were passed by systemd")
+        return false;
+    }
+
+    if(std::strtol(pid, nullptr, 10) != getpid())
+    {
+        ERROR_LOG("Sockets passed by systemd are for process " << pid)
+        return false;
+    }
+
+    const long count = std::strtol(fds, nullptr, 10);
+    if(count <= 0)
+    {
+        ERROR_LOG("Invalid socket count passed by systemd: " << fds)
+        return false;
+    }
+
+    // The names are separated by colons
+    std::vector<std::string> names;
+    const char* const fdNames = std::getenv("LISTEN_FDNAMES");
+    if(fdNames != nullptr)
+    {
+        const char* start = fdNames;
+        while(true)
+        {
+            const char* const end = std::strchr(start, ':');
+            if(end == nullptr)
+            {
+                names.emplace_back(start);
+                break;
+            }
+            names.emplace_back(start, end);
+            start = end+1;
+        }
+    }
+
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+
+    unsigned adopted = 0;
+    for(long i=0; i<count; ++i)
+    {
+        const socket_t listener = first+i;
+        if(name != nullptr && (size_t(i) >= names.size() || names[i] != name))
+            continue;
+
+        fcntl(listener, F_SETFD, fcntl(listener, F_GETFD)|FD_CLOEXEC);
+        if(adopt(listener))
+            ++adopted;
+    }
+
+    if(adopted == 0)
+    {
+        if(name != nullptr)
+            ERROR_LOG("No sockets named " << name << " were passed by systemd")
+        return false;
+    }
+    return true;
+}
+
 Fastcgipp::Socket Fastcgipp::SocketGroup::connect(const char* name)
 {
     const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -376,9 +673,7 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::connect(const char* name)
     ++m_outgoingConnectionCount;
 #endif
 
-    return m_sockets.emplace(
-            fd,
-            std::move(Socket(fd, *this))).first->second;
+    return insert(fd);
 }
 
 Fastcgipp::Socket Fastcgipp::SocketGroup::connect(
@@ -417,7 +712,7 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::connect(
     }
 
     int fd=-1;
-    for(auto i=result; i!=nullptr; i=result->ai_next)
+    for(auto i=result; i!=nullptr; i=i->ai_next)
     {
         fd = socket(i->ai_family, i->ai_socktype, i->ai_protocol);
         if(fd == -1)
@@ -439,9 +734,7 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::connect(
     ++m_outgoingConnectionCount;
 #endif
 
-    return m_sockets.emplace(
-            fd,
-            std::move(Socket(fd, *this))).first->second;
+    return insert(fd);
 }
 
 Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
@@ -461,30 +754,72 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
     const auto& pollRdHup = POLLRDHUP;
 #endif
 
-    while(m_listeners.size()+m_sockets.size() > 0)
+    while(m_listeners.size()+m_socketCount > 0)
     {
-        if(m_refreshListeners)
+        // Only we touch the set of shared listeners
+        if(m_share.exchange(false))
+        {
+            m_adopted.insert(m_listeners.cbegin(), m_listeners.cend());
+            m_refreshListeners = true;
+        }
+
+        // Should our listeners be in the poll?
+        const bool paused = m_acceptResume != Clock::time_point()
+            && Clock::now() < m_acceptResume;
+        const bool listening = m_accept
+            && !paused
+            && (m_maxConnections == 0 || m_socketCount < m_maxConnections);
+
+        if(m_refreshListeners || listening != m_listening)
         {
             for(auto& listener: m_listeners)
             {
                 pollDel(listener);
-                if(m_accept && !pollAdd(listener))
+                if(listening && !pollAdd(listener, true))
                     FAIL_LOG("Unable to add listen socket " << listener \
                             << " to the poll list: " << std::strerror(errno))
             }
+            m_listening = listening;
             m_refreshListeners=false;
         }
+
+        int timeout = block?-1:0;
+        if(block && paused && m_accept)
+        {
+            const auto wait = std::chrono::duration_cast<
+                std::chrono::milliseconds>(
+                        m_acceptResume
+                        - Clock::now()
+                        + std::chrono::milliseconds(1)).count();
+            timeout = std::max(0, int(wait));
+        }
+        if(block && !m_timeouts.empty())
+        {
+            // Round up so we don't wake up just before the timeout
+            const auto wait = std::chrono::duration_cast<
+                std::chrono::milliseconds>(
+                        m_timeouts.next()
+                        - Clock::now()
+                        + std::chrono::milliseconds(1)).count();
+            const int timeoutWait = std::max(0, int(std::min<decltype(wait)>(
+                            wait,
+                            std::numeric_limits<int>::max())));
+
+            // Don't oversleep the end of an accept pause
+            timeout = timeout<0 ? timeoutWait:std::min(timeout, timeoutWait);
+        }
+
 #ifdef FASTCGIPP_LINUX
         pollResult = epoll_wait(
                 m_poll,
                 &epollEvent,
                 1,
-                block?-1:0);
+                timeout);
 #elif defined FASTCGIPP_UNIX
         pollResult = ::poll(
                 m_poll.data(),
                 m_poll.size(),
-                block?-1:0);
+                timeout);
 #endif
 
         if(pollResult<0)
@@ -496,7 +831,8 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
         else if(pollResult>0)
         {
 #ifdef FASTCGIPP_LINUX
-            const auto& socketId = epollEvent.data.fd;
+            const socket_t socketId = socket_t(uint32_t(epollEvent.data.u64));
+            const uint32_t generation = uint32_t(epollEvent.data.u64>>32);
             const auto& events = epollEvent.events;
 #elif defined FASTCGIPP_UNIX
             const auto fd = std::find_if(
@@ -510,6 +846,8 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
                 FAIL_LOG("poll() gave a result >0 but no revents are non-zero")
             const auto& socketId = fd->fd;
             const auto& events = fd->revents;
+            const uint32_t generation = size_t(socketId) < m_sockets.size()
+                ? m_sockets[socketId].generation : 0;
 #endif
 
             if(m_listeners.find(socketId) != m_listeners.end())
@@ -527,15 +865,26 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
                     FAIL_LOG("Got a weird event 0x" << std::hex << events\
                             << " on listen poll." )
             }
+#ifdef FASTCGIPP_LINUX
+            else if(socketId == m_wakeEvent)
+#else
             else if(socketId == m_wakeSockets[1])
+#endif
             {
                 if(events == pollIn)
                 {
-                    std::lock_guard<std::mutex> lock(m_wakingMutex);
+#ifdef FASTCGIPP_LINUX
+                    eventfd_t x;
+                    if(eventfd_read(m_wakeEvent, &x) != 0 && errno != EAGAIN)
+#else
                     char x[256];
                     if(read(m_wakeSockets[1], x, 256)<1)
+#endif
                         FAIL_LOG("Unable to read out of wakeup socket: " << \
                                 std::strerror(errno))
+
+                    // Any wake() from here on must write again. One that
+                    // slipped in before this is covered by not blocking.
                     m_waking=false;
                     block=false;
                     continue;
@@ -547,9 +896,14 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
             }
             else
             {
-                const auto socket = m_sockets.find(socketId);
-                if(socket == m_sockets.end())
+                Socket* const socket = find(socketId, generation);
+                if(socket == nullptr)
                 {
+                    // The event is left over from a previous connection
+                    if(size_t(socketId) < m_sockets.size()
+                            && m_sockets[socketId].socket.valid())
+                        continue;
+
                     ERROR_LOG("Poll gave fd " << socketId \
                             << " which isn't in m_sockets.")
                     pollDel(socketId);
@@ -558,21 +912,21 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
                 }
 
                 if(events & pollRdHup)
-                    socket->second.m_data->m_closing=true;
+                    socket->m_data->m_closing=true;
                 else if(events & pollHup)
                 {
                     WARNING_LOG("Socket " << socketId << " hung up")
-                    socket->second.m_data->m_closing=true;
+                    socket->m_data->m_closing=true;
                 }
                 else if(events & pollErr)
                 {
                     ERROR_LOG("Error in socket " << socketId)
-                    socket->second.m_data->m_closing=true;
+                    socket->m_data->m_closing=true;
                 }
                 else if((events & pollIn) == 0)
                     FAIL_LOG("Got a weird event 0x" << std::hex << events\
                             << " on socket poll." )
-                return socket->second;
+                return *socket;
             }
         }
         break;
@@ -580,14 +934,54 @@ Fastcgipp::Socket Fastcgipp::SocketGroup::poll(bool block)
     return Socket();
 }
 
+void Fastcgipp::SocketGroup::setTimeout(
+        const Socket& socket,
+        Clock::duration timeout)
+{
+    if(!socket.valid())
+        return;
+
+    m_timeouts.cancel(socket.m_data->m_timeout);
+    if(timeout == Clock::duration::zero())
+        socket.m_data->m_timeout = TimingWheel<uint64_t>::invalid;
+    else
+        socket.m_data->m_timeout = m_timeouts.insert(
+                Clock::now()+timeout,
+                identify(socket.m_data->m_socket, socket.m_data->m_generation));
+}
+
+Fastcgipp::Socket Fastcgipp::SocketGroup::expired()
+{
+    if(m_expired.empty() && !m_timeouts.empty())
+        m_timeouts.advance(Clock::now(), m_expired);
+
+    while(!m_expired.empty())
+    {
+        Socket* const socket = find(
+                socket_t(uint32_t(m_expired.back())),
+                uint32_t(m_expired.back()>>32));
+        m_expired.pop_back();
+        if(socket != nullptr)
+        {
+            socket->m_data->m_timeout = TimingWheel<uint64_t>::invalid;
+            return *socket;
+        }
+    }
+
+    return Socket();
+}
+
 void Fastcgipp::SocketGroup::wake()
 {
-    std::lock_guard<std::mutex> lock(m_wakingMutex);
-    if(!m_waking)
+    // Cheap check first so concurrent wakes don't fight over the cache line
+    if(!m_waking.load(std::memory_order_relaxed) && !m_waking.exchange(true))
     {
-        m_waking=true;
+#ifdef FASTCGIPP_LINUX
+        if(eventfd_write(m_wakeEvent, 1) != 0)
+#else
         char x=0;
         if(write(m_wakeSockets[0], &x, 1) != 1)
+#endif
             FAIL_LOG("Unable to write to wakeup socket: " \
                     << std::strerror(errno))
     }
@@ -595,52 +989,179 @@ void Fastcgipp::SocketGroup::wake()
 
 void Fastcgipp::SocketGroup::createSocket(const socket_t listener)
 {
-    sockaddr_un addr;
-    socklen_t addrlen=sizeof(sockaddr_un);
-    const socket_t socket=::accept(
-            listener,
-            (sockaddr*)&addr,
-            &addrlen);
-    if(socket<0)
-        FAIL_LOG("Unable to accept() with fd " \
-                << listener << ": " \
-                << std::strerror(errno))
-    if(fcntl(
-            socket,
-            F_SETFL,
-            (fcntl(socket, F_GETFL)|O_NONBLOCK)^O_NONBLOCK)
-            < 0)
-    {
-        ERROR_LOG("Unable to set NONBLOCK on fd " << socket \
-                << " with fcntl(): " << std::strerror(errno))
-        close(socket);
-        return;
-    }
+    const auto options = m_options.find(listener);
 
-    if(m_accept)
+    for(unsigned i=0; i<m_acceptBatch; ++i)
     {
-        m_sockets.emplace(
-                socket,
-                std::move(Socket(socket, *this)));
+        if(m_maxConnections != 0 && m_socketCount >= m_maxConnections)
+            return;
+
+        if(m_acceptRate != 0)
+        {
+            const auto now = Clock::now();
+            m_acceptTokens = std::min(
+                    double(m_acceptRate),
+                    m_acceptTokens + m_acceptRate
+                        * std::chrono::duration<double>(
+                            now-m_acceptRefilled).count());
+            m_acceptRefilled = now;
+            if(m_acceptTokens < 1)
+            {
+                pauseAccepting(std::chrono::duration_cast<Clock::duration>(
+                            std::chrono::duration<double>(
+                                (1-m_acceptTokens)/m_acceptRate)));
+                return;
+            }
+        }
+
+        const socket_t socket = ::accept4(
+                listener,
+                nullptr,
+                nullptr,
+                SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if(socket<0)
+        {
+            switch(errno)
+            {
+                // The queue is drained or another process beat us to it
+                case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+                case EWOULDBLOCK:
+#endif
+                    return;
+
+                // Connections that died in the queue
+                case EINTR:
+                case ECONNABORTED:
+                case EPROTO:
+                    continue;
+
+                case EMFILE:
+                case ENFILE:
+                {
+                    WARNING_LOG("Out of file descriptors accepting on fd " \
+                            << listener << ". Backing off.")
+
+                    // Shed the connection at the head of the queue
+                    if(m_reserve != -1)
+                    {
+                        close(m_reserve);
+                        const socket_t shed = ::accept4(
+                                listener,
+                                nullptr,
+                                nullptr,
+                                SOCK_CLOEXEC);
+                        if(shed >= 0)
+                            close(shed);
+                        m_reserve = open("/dev/null", O_RDONLY|O_CLOEXEC);
+                    }
+                    pauseAccepting(std::chrono::milliseconds(100));
+                    return;
+                }
+
+                default:
+                {
+                    ERROR_LOG("Unable to accept() with fd " \
+                            << listener << ": " \
+                            << std::strerror(errno))
+                    pauseAccepting(std::chrono::milliseconds(100));
+                    return;
+                }
+            }
+        }
+
+        if(m_acceptRate != 0)
+            m_acceptTokens -= 1;
+
+        if(!m_accept)
+        {
+            close(socket);
+            continue;
+        }
+
+        if(options != m_options.end())
+            configureConnection(socket, options->second);
+
+        const Socket inserted = insert(socket);
+        if(m_acceptTimeout != Clock::duration::zero())
+            setTimeout(inserted, m_acceptTimeout);
 #if FASTCGIPP_LOG_LEVEL > 3
         ++m_incomingConnectionCount;
 #endif
     }
-    else
-        close(socket);
+}
+
+void Fastcgipp::SocketGroup::pauseAccepting(Clock::duration duration)
+{
+    m_acceptResume = Clock::now()+duration;
+}
+
+void Fastcgipp::SocketGroup::setAcceptLimits(
+        unsigned batch,
+        unsigned rate,
+        size_t connections)
+{
+    m_acceptBatch = std::max(1u, batch);
+    m_acceptRate = rate;
+    m_acceptTokens = rate;
+    m_acceptRefilled = Clock::now();
+    m_maxConnections = connections;
+}
+
+Fastcgipp::Socket Fastcgipp::SocketGroup::insert(const socket_t socket)
+{
+    if(size_t(socket) >= m_sockets.size())
+        m_sockets.resize(socket+1);
+
+    Slot& slot = m_sockets[socket];
+    Socket created(socket, *this, ++slot.generation);
+    if(!pollAdd(socket, false, slot.generation))
+    {
+        ERROR_LOG("Unable to add socket " << socket << " to poll list: " \
+                << std::strerror(errno))
+        ::shutdown(socket, SHUT_RDWR);
+        ::close(socket);
+        created.m_data->m_valid = false;
+        return Socket();
+    }
+
+    ++m_socketCount;
+    slot.socket = std::move(created);
+    return slot.socket;
+}
+
+void Fastcgipp::SocketGroup::remove(const socket_t socket)
+{
+    if(size_t(socket) >= m_sockets.size())
+        return;
+
+    Slot& slot = m_sockets[socket];
+    if(slot.socket.m_data != nullptr)
+    {
+        slot.socket = Socket();
+        --m_socketCount;
+    }
 }
 
 Fastcgipp::Socket::Socket():
-    m_data(new Data(-1, false, *(SocketGroup*)(nullptr))),
+    m_data(nullptr),
     m_original(false)
 {}
 
-bool Fastcgipp::SocketGroup::pollAdd(const socket_t socket)
+bool Fastcgipp::SocketGroup::pollAdd(
+        const socket_t socket,
+        bool listener,
+        uint32_t generation)
 {
 #ifdef FASTCGIPP_LINUX
     epoll_event event;
-    event.data.fd = socket;
+    event.data.u64 = identify(socket, generation);
     event.events = EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP;
+#ifdef EPOLLEXCLUSIVE
+    // Only wake one of the processes sharing a listener
+    if(listener && m_adopted.find(socket) != m_adopted.end())
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+#endif
     return epoll_ctl(m_poll, EPOLL_CTL_ADD, socket, &event) != -1;
 #elif defined FASTCGIPP_UNIX
     const auto fd = std::find_if(
@@ -0,0 +1,126 @@
+/*!
+ * @file       timer.cpp
+ * @brief      Defines the Timer class
+ * @author     Eddie Carle &lt;eddie@isatec.ca&gt;
+ * @date       October 17, 2026
+ * @copyright  Copyright &copy; 2016 Eddie Carle. This project is released under
+ *             the GNU Lesser General Public License Version 3.
+ */
+
+/*******************************************************************************
+* Copyright (C) 2016 Eddie Carle [eddie@isatec.ca]                             *
+*                                                                              *
+* This file is part of fastcgi++.                                              *
+*                                                                              *
+* fastcgi++ is free software: you can redistribute it and/or modify it under   *
+* the terms of the GNU Lesser General Public License as  published by the Free *
+* Software Foundation, either version 3 of the License, or (at your option)    *
+* any later version.                                                           *
+*                                                                              *
+* fastcgi++ is distributed in the hope that it will be useful, but WITHOUT ANY *
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS    *
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for     *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with fastcgi++.  If not, see <http://www.gnu.org/licenses/>.           *
+*******************************************************************************/
+
+#include "fastcgi++/timer.hpp"
+#include "fastcgi++/log.hpp"
+
+const Fastcgipp::Timer::Handle Fastcgipp::Timer::invalid;
+
+Fastcgipp::Timer::Timer(Clock::duration resolution):
+    m_wheel(resolution),
+    m_wakeup(Clock::time_point::max()),
+    m_kill(false)
+{
+    DIAG_LOG("Timer::Timer(): Initialized")
+}
+
+Fastcgipp::Timer::~Timer()
+{
+    stop();
+    DIAG_LOG("Timer::~Timer(): Remaining timeouts = " << m_wheel.size())
+}
+
+Fastcgipp::Timer::Handle Fastcgipp::Timer::push(
+        const std::function<void(Message)>& callback,
+        Message&& message,
+        Clock::time_point wakeup)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Handle handle = m_wheel.insert(
+            wakeup,
+            Item{callback, std::move(message)});
+
+    // Only bother the timer thread if it's going to sleep past this one
+    if(wakeup < m_wakeup)
+    {
+        m_wakeup = wakeup;
+        m_wake.notify_one();
+    }
+    return handle;
+}
+
+bool Fastcgipp::Timer::cancel(Handle handle)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_wheel.cancel(handle);
+}
+
+size_t Fastcgipp::Timer::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_wheel.size();
+}
+
+void Fastcgipp::Timer::handler()
+{
+    std::vector<Item> expired;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(!m_kill)
+    {
+        m_wheel.advance(Clock::now(), expired);
+        if(!expired.empty())
+        {
+            lock.unlock();
+            for(auto& item: expired)
+                item.callback(std::move(item.message));
+            expired.clear();
+            lock.lock();
+            continue;
+        }
+
+        m_wakeup = m_wheel.next();
+        if(m_wakeup == Clock::time_point::max())
+            m_wake.wait(lock);
+        else
+            m_wake.wait_until(lock, m_wakeup);
+    }
+    m_wakeup = Clock::time_point::max();
+}
+
+void Fastcgipp::Timer::start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_thread.joinable())
+    {
+        m_kill = false;
+        std::thread thread(&Fastcgipp::Timer::handler, this);
+        m_thread.swap(thread);
+    }
+}
+
+void Fastcgipp::Timer::stop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(m_thread.joinable())
+    {
+        m_kill = true;
+        m_wake.notify_one();
+        lock.unlock();
+        m_thread.join();
+    }
+}
@@ -31,45 +31,152 @@
 #include "fastcgi++/log.hpp"
 bool Fastcgipp::Transceiver::transmit()
 {
-    std::unique_ptr<Record> record;
+    std::deque<std::unique_ptr<Record>> records;
+    {
+        std::lock_guard<std::mutex> lock(m_sendBufferMutex);
+        records.swap(m_sendBuffer);
+    }
 
-    while(!m_sendBuffer.empty())
+    for(auto& record: records)
     {
+        const auto connection = m_connections.find(record->socket);
+        if(connection == m_connections.end())
+            continue;
+
+        const Protocol::FcgiId id =
+            record->data.size() >= sizeof(Protocol::Header)?
+            Protocol::FcgiId(
+                    ((const Protocol::Header*)record->data.data())->fcgiId):
+            Protocol::FcgiId(0);
+
+        if(
+                connection->second.turns.empty()
+                && connection->second.sent == connection->second.batch.size())
+            m_writing.push_back(connection->first);
+        auto& queue = connection->second.output[id];
+        if(queue.empty())
+            connection->second.turns.push_back(id);
+        queue.push_back(std::move(record));
+    }
+
+    bool flushed = true;
+    for(size_t count = m_writing.size(); count > 0; --count)
+    {
+        const Socket socket = m_writing.front();
+        m_writing.pop_front();
+
+        const auto connection = m_connections.find(socket);
+        if(connection == m_connections.end())
+            continue;
+
+        if(!transmit(socket, connection->second))
         {
-            std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-            record = std::move(m_sendBuffer.front());
-            m_sendBuffer.pop_front();
+            flushed = false;
+            m_writing.push_back(socket);
         }
+    }
 
-        const ssize_t sent = record->socket.write(
-                &*record->read,
-                record->data.cend()-record->read);
-        if(sent>=0)
+    return flushed;
+}
+
+bool Fastcgipp::Transceiver::transmit(
+        const Socket& socket,
+        Connection& connection)
+{
+    // Stop gathering once a batch is this big
+    const size_t batchSize = 0x10000;
+
+    while(true)
+    {
+        if(connection.sent == connection.batch.size())
         {
-            record->read += sent;
-            if(record->read != record->data.cend())
+            connection.batch.clear();
+            connection.sent = 0;
+
+            while(
+                    !connection.turns.empty()
+                    && !connection.kill
+                    && connection.batch.size() < batchSize)
             {
+                const Protocol::FcgiId id = connection.turns.front();
+                connection.turns.pop_front();
+                auto& queue = connection.output[id];
+                Record& record = *queue.front();
+
+                // Take a single FastCGI record
+                const size_t left = record.data.cend()-record.read;
+                size_t size = left;
+                if(left >= sizeof(Protocol::Header))
                 {
-                    std::lock_guard<std::mutex> lock(m_sendBufferMutex);
-                    m_sendBuffer.push_front(std::move(record));
+                    const Protocol::Header& header =
+                        *(const Protocol::Header*)&*record.read;
+                    size = std::min(
+                            left,
+                            sizeof(Protocol::Header)
+                                + header.contentLength
+                                + header.paddingLength);
+
+                    if(
+                            header.type == Protocol::RecordType::END_REQUEST
+                            && connection.requests > 0)
+                    {
+                        --connection.requests;
+                        updateTimeout(socket, connection);
+                    }
                 }
-                return false;
-            }
+                connection.batch.insert(
+                        connection.batch.end(),
+                        record.read,
+                        record.read+size);
+                record.read += size;
+
+                if(record.read == record.data.cend())
+                {
 #if FASTCGIPP_LOG_LEVEL > 3
-            ++m_recordsSent;
+                    ++m_recordsSent;
 #endif
-            if(record->kill)
-            {
-                record->socket.close();
-                m_receiveBuffers.erase(record->socket);
+                    connection.kill = record.kill;
+                    queue.pop_front();
+                }
+
+                if(queue.empty())
+                    connection.output.erase(id);
+                else
+                    connection.turns.push_back(id);
+            }
+
+            if(connection.batch.empty())
+                return true;
+        }
+
+        const ssize_t sent = socket.write(
+                connection.batch.data()+connection.sent,
+                connection.batch.size()-connection.sent);
+        if(sent<0)
+        {
+            // The receive side will clean the connection up
+            connection.output.clear();
+            connection.turns.clear();
+            connection.batch.clear();
+            connection.sent = 0;
+            return true;
+        }
+        connection.sent += sent;
+        if(connection.sent != connection.batch.size())
+            return false;
+
+        if(connection.kill)
+        {
+            if(m_capture.active() && connection.capture)
+                m_capture.closed(connection.capture);
+            socket.close();
+            m_connections.erase(socket);
 #if FASTCGIPP_LOG_LEVEL > 3
-                ++m_connectionKillCount;
+            ++m_connectionKillCount;
 #endif
-            }
+            return true;
         }
     }
-
-    return true;
 }
 
 void Fastcgipp::Transceiver::handler()
@@ -77,31 +184,36 @@ void Fastcgipp::Transceiver::handler()
     bool flushed=false;
     Socket socket;
 
-    while(!m_terminate && !(m_stop && m_sockets.size()==0))
+    pinThread(m_cpus);
+    if(m_incomingCpu && !m_cpus.empty())
+        m_sockets.incomingCpu(m_cpus.front());
+
+    while(!m_terminate && !(m_stop && m_transport->size()==0))
     {
-        socket = m_sockets.poll(flushed);
+        socket = m_transport->poll(flushed);
         receive(socket);
         flushed = transmit();
+        expire();
     }
 }
 
 void Fastcgipp::Transceiver::stop()
 {
     m_stop=true;
-    m_sockets.accept(false);
+    m_transport->accept(false);
 }
 
 void Fastcgipp::Transceiver::terminate()
 {
     m_terminate=true;
-    m_sockets.wake();
+    m_transport->wake();
 }
 
 void Fastcgipp::Transceiver::start()
 {
     m_stop=false;
     m_terminate=false;
-    m_sockets.accept(true);
+    m_transport->accept(true);
     if(!m_thread.joinable())
     {
         std::thread thread(&Fastcgipp::Transceiver::handler, this);
@@ -119,13 +231,21 @@ void Fastcgipp::Transceiver::join()
 
 Fastcgipp::Transceiver::Transceiver(
         const std::function<void(Protocol::RequestId, Message&&)> sendMessage):
-    m_sendMessage(sendMessage)
+    m_idleTimeout(SocketGroup::Clock::duration::zero()),
+    m_headerTimeout(SocketGroup::Clock::duration::zero()),
+    m_bodyTimeout(SocketGroup::Clock::duration::zero()),
+    m_incomingCpu(false),
+    m_sendMessage(sendMessage),
+    m_transport(&m_sockets)
 #if FASTCGIPP_LOG_LEVEL > 3
     ,m_connectionKillCount(0),
     m_connectionRDHupCount(0),
     m_recordsSent(0),
     m_recordsQueued(0),
-    m_recordsReceived(0)
+    m_recordsReceived(0),
+    m_idleTimeoutCount(0),
+    m_headerTimeoutCount(0),
+    m_bodyTimeoutCount(0)
 #endif
 {
     DIAG_LOG("Transceiver::Transciever(): Initialized")
@@ -135,7 +255,10 @@ void Fastcgipp::Transceiver::receive(Socket& socket)
 {
     if(socket.valid())
     {
-        std::vector<char>& buffer=m_receiveBuffers[socket];
+        Connection& connection = m_connections[socket];
+        if(m_capture.active() && connection.capture == 0)
+            connection.capture = m_capture.connect();
+        std::vector<char>& buffer=connection.buffer;
         size_t received = buffer.size();
 
         // Are we receiving a header?
@@ -149,12 +272,16 @@ void Fastcgipp::Transceiver::receive(Socket& socket)
             if(read<0)
             {
                 cleanupSocket(socket);
+#if FASTCGIPP_LOG_LEVEL > 3
+                ++m_connectionRDHupCount;
+#endif
                 return;
             }
             received += read;
             if(received < sizeof(Protocol::Header))
             {
                 buffer.resize(received);
+                updateTimeout(socket, connection);
                 return;
             }
         }
@@ -173,17 +300,28 @@ void Fastcgipp::Transceiver::receive(Socket& socket)
         if(read<0)
         {
             cleanupSocket(socket);
+#if FASTCGIPP_LOG_LEVEL > 3
+            ++m_connectionRDHupCount;
+#endif
             return;
         }
         received += read;
         if(received < recordSize)
         {
             buffer.resize(received);
+            updateTimeout(socket, connection);
             return;
         }
 
+        if(header.type == Protocol::RecordType::BEGIN_REQUEST)
+            ++connection.requests;
+
+        if(m_capture.active())
+            m_capture.record(connection.capture, buffer.data(), recordSize);
+
         Message message;
         message.data.swap(buffer);
+        updateTimeout(socket, connection);
 
         m_sendMessage(
                 Protocol::RequestId(header.fcgiId, socket),
@@ -196,14 +334,95 @@ void Fastcgipp::Transceiver::receive(Socket& socket)
 
 void Fastcgipp::Transceiver::cleanupSocket(const Socket& socket)
 {
-    m_receiveBuffers.erase(socket);
+    if(m_capture.active())
+    {
+        const auto connection = m_connections.find(socket);
+        if(connection != m_connections.end() && connection->second.capture)
+            m_capture.closed(connection->second.capture);
+    }
+    m_connections.erase(socket);
     m_sendMessage(
             Fastcgipp::Protocol::RequestId(Protocol::badFcgiId, socket),
             Message());
     socket.close();
+}
+
+void Fastcgipp::Transceiver::updateTimeout(
+        const Socket& socket,
+        Connection& connection)
+{
+    Waiting waiting;
+    if(connection.buffer.empty())
+        waiting = connection.requests>0 ? Waiting::NOTHING : Waiting::IDLE;
+    else if(connection.buffer.size() < sizeof(Protocol::Header))
+        waiting = Waiting::HEADER;
+    else
+        waiting = Waiting::BODY;
+
+    if(waiting == connection.waiting)
+        return;
+    connection.waiting = waiting;
+
+    switch(waiting)
+    {
+        case Waiting::NOTHING:
+            m_transport->setTimeout(socket, Transport::Clock::duration::zero());
+            break;
+        case Waiting::IDLE:
+            m_transport->setTimeout(socket, m_idleTimeout);
+            break;
+        case Waiting::HEADER:
+            m_transport->setTimeout(socket, m_headerTimeout);
+            break;
+        case Waiting::BODY:
+            m_transport->setTimeout(socket, m_bodyTimeout);
+            break;
+    }
+}
+
+void Fastcgipp::Transceiver::expire()
+{
+    while(true)
+    {
+        const Socket socket = m_transport->expired();
+        if(!socket.valid())
+            break;
+
+        // Freshly accepted sockets don't have a connection yet
+        const auto connection = m_connections.find(socket);
+        switch(connection==m_connections.end()?
+                Waiting::IDLE:connection->second.waiting)
+        {
+            case Waiting::IDLE:
+            {
+                DIAG_LOG("Closing idle connection")
+#if FASTCGIPP_LOG_LEVEL > 3
+                ++m_idleTimeoutCount;
+#endif
+                break;
+            }
+            case Waiting::HEADER:
+            {
+                WARNING_LOG("Connection timed out receiving a record header")
+#if FASTCGIPP_LOG_LEVEL > 3
+                ++m_headerTimeoutCount;
+#endif
+                break;
+            }
+            case Waiting::BODY:
+            {
+                WARNING_LOG("Connection timed out receiving record content")
 #if FASTCGIPP_LOG_LEVEL > 3
-    ++m_connectionRDHupCount;
+                ++m_bodyTimeoutCount;
 #endif
+                break;
+            }
+            case Waiting::NOTHING:
+                break;
+        }
+
+        cleanupSocket(socket);
+    }
 }
 
 void Fastcgipp::Transceiver::send(
@@ -219,7 +438,7 @@ void Fastcgipp::Transceiver::send(
         std::lock_guard<std::mutex> lock(m_sendBufferMutex);
         m_sendBuffer.push_back(std::move(record));
     }
-    m_sockets.wake();
+    m_transport->wake();
 #if FASTCGIPP_LOG_LEVEL > 3
     ++m_recordsQueued;
 #endif
@@ -232,12 +451,18 @@ Fastcgipp::Transceiver::~Transceiver()
             << m_connectionKillCount)
     DIAG_LOG("Transceiver::~Transceiver(): Remotely closed sockets === " \
             << m_connectionRDHupCount)
-    DIAG_LOG("Transceiver::~Transceiver(): Remaining receive buffers = " \
-            << m_receiveBuffers.size())
+    DIAG_LOG("Transceiver::~Transceiver(): Remaining connections ===== " \
+            << m_connections.size())
     DIAG_LOG("Transceiver::~Transceiver(): Records queued === " \
             << m_recordsQueued)
     DIAG_LOG("Transceiver::~Transceiver(): Records sent ===== " \
             << m_recordsSent)
     DIAG_LOG("Transceiver::~Transceiver(): Records received = " \
             << m_recordsReceived)
+    DIAG_LOG("Transceiver::~Transceiver(): Idle timeouts ====== " \
+            << m_idleTimeoutCount)
+    DIAG_LOG("Transceiver::~Transceiver(): Header timeouts ==== " \
+            << m_headerTimeoutCount)
+    DIAG_LOG("Transceiver::~Transceiver(): Content timeouts === " \
+            << m_bodyTimeoutCount)
 }
@@ -0,0 +1,95 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/arena.hpp"
+
+#include <random>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstring>
+
+int main()
+{
+    std::mt19937 engine(2016);
+
+    // Testing Fastcgipp::Arena allocations
+    {
+        Fastcgipp::Arena arena;
+        std::uniform_int_distribution<size_t> sizeDist(0, 300);
+        std::uniform_int_distribution<unsigned> alignDist(0, 6);
+        std::vector<std::pair<char*, size_t>> blocks;
+
+        for(unsigned i=0; i<20000; ++i)
+        {
+            const size_t size = i%1000 == 0 ? 100000 : sizeDist(engine);
+            const size_t alignment = size_t(1) << alignDist(engine);
+            char* const block = static_cast<char*>(
+                    arena.allocate(size, alignment));
+            if(size_t(block) % alignment != 0)
+                FAIL_LOG("Fastcgipp::Arena returned a misaligned block")
+            std::memset(block, i&0xff, size);
+            blocks.push_back(std::make_pair(block, size));
+        }
+
+        // Make sure nothing overlapped
+        for(unsigned i=0; i<blocks.size(); ++i)
+            for(size_t j=0; j<blocks[i].second; ++j)
+                if(blocks[i].first[j] != char(i&0xff))
+                    FAIL_LOG("Fastcgipp::Arena returned overlapping blocks")
+
+        const size_t capacity = arena.capacity();
+        if(capacity < 20000*150)
+            FAIL_LOG("Fastcgipp::Arena capacity is too small")
+        arena.release();
+        if(arena.capacity() != 0)
+            FAIL_LOG("Fastcgipp::Arena didn't release everything")
+    }
+
+    // Testing chunk reuse between arenas
+    {
+        void* first;
+        {
+            Fastcgipp::Arena arena;
+            first = arena.allocate(16);
+        }
+        Fastcgipp::Arena arena;
+        if(arena.allocate(16) != first)
+            FAIL_LOG("Fastcgipp::Arena didn't reuse a released chunk")
+    }
+
+    // Testing Fastcgipp::ArenaAllocator with containers
+    {
+        Fastcgipp::Arena arena;
+        typedef std::basic_string<
+            char,
+            std::char_traits<char>,
+            Fastcgipp::ArenaAllocator<char>> String;
+        typedef std::map<
+            int,
+            String,
+            std::less<int>,
+            Fastcgipp::ArenaAllocator<std::pair<const int, String>>> Map;
+
+        Map map{Fastcgipp::ArenaAllocator<std::pair<const int, String>>(arena)};
+        for(int i=0; i<1000; ++i)
+            map.emplace(
+                    i,
+                    String(
+                        std::to_string(i*i).append(40, 'x').c_str(),
+                        Fastcgipp::ArenaAllocator<char>(arena)));
+
+        for(int i=0; i<1000; ++i)
+        {
+            const auto it = map.find(i);
+            if(it == map.end()
+                    || it->second != String(
+                        std::to_string(i*i).append(40, 'x').c_str(),
+                        Fastcgipp::ArenaAllocator<char>(arena)))
+                FAIL_LOG("Fastcgipp::ArenaAllocator corrupted a container")
+        }
+
+        if(arena.capacity() == 0)
+            FAIL_LOG("Fastcgipp::ArenaAllocator didn't use the arena")
+    }
+
+    return 0;
+}
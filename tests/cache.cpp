@@ -0,0 +1,462 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/loopback.hpp"
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/request.hpp"
+#include "fastcgi++/cache.hpp"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <set>
+#include <algorithm>
+
+//! How many times each URI has been generated
+std::map<std::string, unsigned> generated;
+std::mutex generatedMutex;
+
+//! Requests busy in response() waiting on a gate
+std::atomic_uint blocked(0);
+std::atomic_bool gate(false);
+std::atomic_bool laterGate(false);
+
+//! True while the first /aborted request waits to be aborted
+std::atomic_bool spinning(false);
+
+unsigned generations(const std::string& uri)
+{
+    std::lock_guard<std::mutex> lock(generatedMutex);
+    return generated[uri];
+}
+
+/*!
+ * Responds with it's URI and how many times it has been generated. Requests
+ * for /slow and /cookie wait for the gate to open first, or the later gate
+ * if they aren't the first generation of their URI. The first request
+ * for /aborted sends some output and then waits to be aborted. Others send
+ * headers that make them uncacheable.
+ */
+class Generator: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        const std::string& uri = environment().requestUri;
+        unsigned generation;
+        {
+            std::lock_guard<std::mutex> lock(generatedMutex);
+            generation = ++generated[uri];
+        }
+
+        if(uri == "/slow" || uri == "/cookie")
+        {
+            const std::atomic_bool& opened = generation==1 ? gate:laterGate;
+            ++blocked;
+            while(!opened)
+                std::this_thread::yield();
+            --blocked;
+        }
+
+        if(uri == "/status")
+            out << "Status: 404 Not Found\n";
+        out << "Content-Type: text/plain\r\n";
+        if(uri == "/cookie")
+            out << "Set-Cookie: session=1\r\n";
+        else if(uri == "/nostore")
+            out << "Cache-Control: no-store\r\n";
+        else if(uri == "/private")
+            out << "cache-control: max-age=60, Private\r\n";
+        out << "\r\n" << uri << ' ' << generation;
+
+        if(uri.compare(0, 5, "/big/") == 0)
+            out << std::string(1000, 'x');
+        else if(uri == "/aborted" && generation == 1)
+        {
+            out.flush();
+            spinning = true;
+            while(cancelled() == Fastcgipp::Cancellation::NONE)
+                std::this_thread::yield();
+            spinning = false;
+        }
+
+        return true;
+    }
+};
+
+void record(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::RecordType type,
+        Fastcgipp::Protocol::FcgiId id,
+        const char* content,
+        size_t size)
+{
+    Fastcgipp::Protocol::Header header;
+    header.version = Fastcgipp::Protocol::version;
+    header.type = type;
+    header.fcgiId = id;
+    header.contentLength = uint16_t(size);
+    header.paddingLength = 0;
+    header.reserved = 0;
+
+    const char* const start = (const char*)&header;
+    records.insert(records.end(), start, start+sizeof(header));
+    records.insert(records.end(), content, content+size);
+}
+
+void parameter(
+        std::string& params,
+        const std::string& name,
+        const std::string& value)
+{
+    params += char(name.size());
+    params += char(value.size());
+    params += name;
+    params += value;
+}
+
+void send(Fastcgipp::Loopback::Client& client, const std::vector<char>& data)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    size_t sent = 0;
+    while(sent < data.size())
+    {
+        sent += client.write(data.data()+sent, data.size()-sent);
+        if(std::chrono::steady_clock::now() > timeout)
+            FAIL_LOG("Fastcgipp::ResponseCache timed out sending")
+        std::this_thread::yield();
+    }
+}
+
+//! Send a GET request
+void get(
+        Fastcgipp::Loopback::Client& client,
+        Fastcgipp::Protocol::FcgiId id,
+        const std::string& uri)
+{
+    std::vector<char> records;
+
+    Fastcgipp::Protocol::BeginRequest begin;
+    std::fill(begin.reserved, begin.reserved+sizeof(begin.reserved), 0);
+    begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+    begin.flags = Fastcgipp::Protocol::BeginRequest::keepConnBit;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+            id,
+            (const char*)&begin,
+            sizeof(begin));
+
+    std::string params;
+    parameter(params, "REQUEST_METHOD", "GET");
+    parameter(params, "REQUEST_URI", uri);
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            params.data(),
+            params.size());
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            nullptr,
+            0);
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::IN,
+            id,
+            nullptr,
+            0);
+
+    send(client, records);
+}
+
+//! Receive some responses and return their bodies indexed by request ID
+std::map<Fastcgipp::Protocol::FcgiId, std::string> receive(
+        Fastcgipp::Loopback::Client& client,
+        size_t count)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    std::vector<char> buffer;
+    std::map<Fastcgipp::Protocol::FcgiId, std::string> outputs;
+    std::map<Fastcgipp::Protocol::FcgiId, std::string> bodies;
+
+    while(bodies.size() < count)
+    {
+        char chunk[4096];
+        const size_t size = client.read(chunk, sizeof(chunk));
+        buffer.insert(buffer.end(), chunk, chunk+size);
+
+        while(buffer.size() >= sizeof(Fastcgipp::Protocol::Header))
+        {
+            const Fastcgipp::Protocol::Header& header =
+                *(const Fastcgipp::Protocol::Header*)buffer.data();
+            const size_t recordSize = sizeof(header)
+                +header.contentLength
+                +header.paddingLength;
+            if(buffer.size() < recordSize)
+                break;
+
+            if(header.type == Fastcgipp::Protocol::RecordType::OUT)
+                outputs[header.fcgiId].append(
+                        buffer.data()+sizeof(header),
+                        header.contentLength);
+            else if(header.type
+                    == Fastcgipp::Protocol::RecordType::END_REQUEST)
+            {
+                const std::string& output = outputs[header.fcgiId];
+                const size_t body = output.find("\r\n\r\n");
+                if(body == std::string::npos)
+                    FAIL_LOG("Fastcgipp::ResponseCache got a response "\
+                            "without headers")
+                bodies[header.fcgiId] = output.substr(body+4);
+            }
+            buffer.erase(buffer.begin(), buffer.begin()+recordSize);
+        }
+
+        if(size == 0)
+        {
+            if(client.closed())
+                FAIL_LOG("Fastcgipp::ResponseCache connection closed early")
+            if(std::chrono::steady_clock::now() > timeout)
+                FAIL_LOG("Fastcgipp::ResponseCache timed out receiving")
+            std::this_thread::yield();
+        }
+    }
+
+    return bodies;
+}
+
+//! Send a GET request and return the body of the response
+std::string fetch(
+        Fastcgipp::Loopback::Client& client,
+        const std::string& uri)
+{
+    get(client, 1, uri);
+    return receive(client, 1)[1];
+}
+
+//! Wait for something to become true
+template<class Predicate> void wait(Predicate predicate, const char* what)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    while(!predicate())
+    {
+        if(std::chrono::steady_clock::now() > timeout)
+            FAIL_LOG("Fastcgipp::ResponseCache timed out waiting for " << what)
+        std::this_thread::yield();
+    }
+}
+
+//! Give any requests that are going to start generating the time to do so
+void settle()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+}
+
+void reset()
+{
+    generated.clear();
+    gate = false;
+    laterGate = false;
+}
+
+int main()
+{
+    // Testing that a stampede of misses is collapsed onto one generation
+    {
+        reset();
+        Fastcgipp::ResponseCache cache(1<<20, std::chrono::seconds(60));
+        Fastcgipp::Loopback loopback;
+        Fastcgipp::Manager<Generator> manager(2);
+        manager.setTransport(loopback);
+        manager.setCache(cache);
+        manager.start();
+
+        Fastcgipp::Loopback::Client client = loopback.connect();
+        for(Fastcgipp::Protocol::FcgiId id=1; id<=5; ++id)
+            get(client, id, "/slow");
+        wait([] () { return blocked == 1; }, "the generation");
+        settle();
+        if(generations("/slow") != 1)
+            FAIL_LOG("Fastcgipp::ResponseCache didn't collapse the misses")
+
+        gate = true;
+        for(const auto& body: receive(client, 5))
+            if(body.second != "/slow 1")
+                FAIL_LOG("Fastcgipp::ResponseCache sent request " \
+                        << body.first << " the wrong response: " \
+                        << body.second.c_str())
+
+        if(fetch(client, "/slow") != "/slow 1" || generations("/slow") != 1)
+            FAIL_LOG("Fastcgipp::ResponseCache missed a cached response")
+
+        client.close();
+        manager.stop();
+        manager.join();
+    }
+
+    // Testing that uncacheable responses are generated in parallel
+    {
+        reset();
+        Fastcgipp::ResponseCache cache(1<<20, std::chrono::seconds(60));
+        Fastcgipp::Loopback loopback;
+        Fastcgipp::Manager<Generator> manager(2);
+        manager.setTransport(loopback);
+        manager.setCache(cache);
+        manager.start();
+
+        Fastcgipp::Loopback::Client client = loopback.connect();
+        for(Fastcgipp::Protocol::FcgiId id=1; id<=3; ++id)
+            get(client, id, "/cookie");
+        wait([] () { return blocked == 1; }, "the generation");
+        settle();
+        if(generations("/cookie") != 1)
+            FAIL_LOG("Fastcgipp::ResponseCache didn't collapse the misses")
+
+        // The waiters should both take over at once
+        gate = true;
+        wait([] () { return blocked == 2; }, "the waiters to generate");
+        laterGate = true;
+        std::set<std::string> bodies;
+        for(const auto& body: receive(client, 3))
+            bodies.insert(body.second);
+        if(bodies != std::set<std::string>{
+                    "/cookie 1",
+                    "/cookie 2",
+                    "/cookie 3"})
+            FAIL_LOG("Fastcgipp::ResponseCache didn't hand generation over")
+
+        // While the key passes misses aren't collapsed
+        laterGate = false;
+        for(Fastcgipp::Protocol::FcgiId id=1; id<=2; ++id)
+            get(client, id, "/cookie");
+        wait([] () { return blocked == 2; }, "the passed misses");
+        laterGate = true;
+        bodies.clear();
+        for(const auto& body: receive(client, 2))
+            bodies.insert(body.second);
+        if(bodies != std::set<std::string>{"/cookie 4", "/cookie 5"})
+            FAIL_LOG("Fastcgipp::ResponseCache didn't pass the misses")
+
+        // Once the pass is over they are collapsed again
+        std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+        laterGate = false;
+        for(Fastcgipp::Protocol::FcgiId id=1; id<=2; ++id)
+            get(client, id, "/cookie");
+        wait([] () { return blocked == 1; }, "the generation");
+        settle();
+        if(generations("/cookie") != 6)
+            FAIL_LOG("Fastcgipp::ResponseCache didn't collapse the misses "\
+                    "after the pass")
+        laterGate = true;
+        receive(client, 2);
+
+        client.close();
+        manager.stop();
+        manager.join();
+    }
+
+    // Testing which responses get cached
+    {
+        reset();
+        Fastcgipp::ResponseCache cache(1<<20, std::chrono::seconds(60));
+        Fastcgipp::Loopback loopback;
+        Fastcgipp::Manager<Generator> manager(2);
+        manager.setTransport(loopback);
+        manager.setCache(cache);
+        manager.start();
+        gate = true;
+        laterGate = true;
+
+        Fastcgipp::Loopback::Client client = loopback.connect();
+        fetch(client, "/plain");
+        if(fetch(client, "/plain") != "/plain 1")
+            FAIL_LOG("Fastcgipp::ResponseCache didn't cache a response")
+
+        for(const char* uri: {"/cookie", "/nostore", "/private", "/status"})
+        {
+            fetch(client, uri);
+            if(fetch(client, uri) != std::string(uri)+" 2")
+                FAIL_LOG("Fastcgipp::ResponseCache cached " << uri)
+        }
+
+        // An aborted response is truncated
+        get(client, 1, "/aborted");
+        wait([] () { return spinning.load(); }, "the spin");
+        std::vector<char> records;
+        record(
+                records,
+                Fastcgipp::Protocol::RecordType::ABORT_REQUEST,
+                1,
+                nullptr,
+                0);
+        send(client, records);
+        receive(client, 1);
+        if(fetch(client, "/aborted") != "/aborted 2")
+            FAIL_LOG("Fastcgipp::ResponseCache cached an aborted response")
+
+        client.close();
+        manager.stop();
+        manager.join();
+    }
+
+    // Testing expiry
+    {
+        reset();
+        Fastcgipp::ResponseCache cache(1<<20, std::chrono::milliseconds(100));
+        Fastcgipp::Loopback loopback;
+        Fastcgipp::Manager<Generator> manager(2);
+        manager.setTransport(loopback);
+        manager.setCache(cache);
+        manager.start();
+
+        Fastcgipp::Loopback::Client client = loopback.connect();
+        fetch(client, "/ttl");
+        if(fetch(client, "/ttl") != "/ttl 1")
+            FAIL_LOG("Fastcgipp::ResponseCache didn't cache a response")
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        if(fetch(client, "/ttl") != "/ttl 2")
+            FAIL_LOG("Fastcgipp::ResponseCache served an expired response")
+
+        client.close();
+        manager.stop();
+        manager.join();
+    }
+
+    // Testing eviction of the least recently used response
+    {
+        reset();
+        Fastcgipp::ResponseCache cache(2500, std::chrono::seconds(60), 2500);
+        Fastcgipp::Loopback loopback;
+        Fastcgipp::Manager<Generator> manager(2);
+        manager.setTransport(loopback);
+        manager.setCache(cache);
+        manager.start();
+
+        Fastcgipp::Loopback::Client client = loopback.connect();
+        fetch(client, "/big/a");
+        fetch(client, "/big/b");
+        fetch(client, "/big/a");
+        fetch(client, "/big/c");
+        if(generations("/big/a") != 1)
+            FAIL_LOG("Fastcgipp::ResponseCache evicted a recently used "\
+                    "response")
+
+        fetch(client, "/big/b");
+        if(generations("/big/b") != 2)
+            FAIL_LOG("Fastcgipp::ResponseCache didn't evict the least "\
+                    "recently used response")
+
+        client.close();
+        manager.stop();
+        manager.join();
+    }
+
+    return 0;
+}
@@ -0,0 +1,320 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/loopback.hpp"
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/request.hpp"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+
+std::atomic_bool spinning(false);
+std::atomic<Fastcgipp::Cancellation> observed(Fastcgipp::Cancellation::NONE);
+std::atomic_uint constructed(0);
+
+class Slow: public Fastcgipp::Request<char>
+{
+public:
+    Slow()
+    {
+        ++constructed;
+    }
+
+private:
+    bool response()
+    {
+        if(environment().requestUri == "/deadline")
+        {
+            // Wait for a message that never comes
+            setDeadline(std::chrono::milliseconds(50));
+            return false;
+        }
+        else if(environment().requestUri == "/wait")
+            return false;
+        else if(environment().requestUri == "/busy")
+        {
+            // Stay busy past the deadline and leave the response to handler()
+            setDeadline(std::chrono::milliseconds(50));
+            while(cancelled() == Fastcgipp::Cancellation::NONE)
+                std::this_thread::yield();
+            observed = cancelled();
+            return true;
+        }
+        else if(environment().requestUri == "/spin")
+        {
+            spinning = true;
+            while(cancelled() == Fastcgipp::Cancellation::NONE)
+                std::this_thread::yield();
+            observed = cancelled();
+            spinning = false;
+        }
+
+        out << "Content-Type: text/plain\r\n\r\ndone";
+        return true;
+    }
+};
+
+void record(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::RecordType type,
+        Fastcgipp::Protocol::FcgiId id,
+        const char* content,
+        size_t size)
+{
+    Fastcgipp::Protocol::Header header;
+    header.version = Fastcgipp::Protocol::version;
+    header.type = type;
+    header.fcgiId = id;
+    header.contentLength = uint16_t(size);
+    header.paddingLength = 0;
+    header.reserved = 0;
+
+    const char* const start = (const char*)&header;
+    records.insert(records.end(), start, start+sizeof(header));
+    records.insert(records.end(), content, content+size);
+}
+
+//! Build the records of a request optionally leaving out the parameter end
+void request(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::FcgiId id,
+        const std::string& uri,
+        bool complete=true)
+{
+    Fastcgipp::Protocol::BeginRequest begin;
+    std::fill(begin.reserved, begin.reserved+sizeof(begin.reserved), 0);
+    begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+    begin.flags = Fastcgipp::Protocol::BeginRequest::keepConnBit;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+            id,
+            (const char*)&begin,
+            sizeof(begin));
+
+    std::string params;
+    params += char(11);
+    params += char(uri.size());
+    params += "REQUEST_URI";
+    params += uri;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            params.data(),
+            params.size());
+    if(!complete)
+        return;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            nullptr,
+            0);
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::IN,
+            id,
+            nullptr,
+            0);
+}
+
+void send(Fastcgipp::Loopback::Client& client, const std::vector<char>& data)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    size_t sent = 0;
+    while(sent < data.size())
+    {
+        sent += client.write(data.data()+sent, data.size()-sent);
+        if(std::chrono::steady_clock::now() > timeout)
+            FAIL_LOG("Fastcgipp::Cancellation timed out sending")
+        std::this_thread::yield();
+    }
+}
+
+//! Receive a response and return it's output
+std::string receive(
+        Fastcgipp::Loopback::Client& client,
+        Fastcgipp::Protocol::FcgiId id)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    std::vector<char> buffer;
+    std::string output;
+
+    while(true)
+    {
+        char chunk[4096];
+        const size_t count = client.read(chunk, sizeof(chunk));
+        buffer.insert(buffer.end(), chunk, chunk+count);
+
+        while(buffer.size() >= sizeof(Fastcgipp::Protocol::Header))
+        {
+            const Fastcgipp::Protocol::Header& header =
+                *(const Fastcgipp::Protocol::Header*)buffer.data();
+            const size_t size = sizeof(header)
+                +header.contentLength
+                +header.paddingLength;
+            if(buffer.size() < size)
+                break;
+
+            if(header.fcgiId != id)
+                FAIL_LOG("Fastcgipp::Cancellation got a record for request " \
+                        << header.fcgiId << " instead of " << id)
+
+            if(header.type == Fastcgipp::Protocol::RecordType::OUT)
+                output.append(
+                        buffer.data()+sizeof(header),
+                        header.contentLength);
+            else if(header.type
+                    == Fastcgipp::Protocol::RecordType::END_REQUEST)
+                return output;
+            buffer.erase(buffer.begin(), buffer.begin()+size);
+        }
+
+        if(count == 0)
+        {
+            if(client.closed())
+                FAIL_LOG("Fastcgipp::Cancellation connection closed early")
+            if(std::chrono::steady_clock::now() > timeout)
+                FAIL_LOG("Fastcgipp::Cancellation timed out receiving")
+            std::this_thread::yield();
+        }
+    }
+}
+
+//! Wait for something to become true
+template<class Predicate> void wait(Predicate predicate, const char* what)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    while(!predicate())
+    {
+        if(std::chrono::steady_clock::now() > timeout)
+            FAIL_LOG("Fastcgipp::Cancellation timed out waiting for " << what)
+        std::this_thread::yield();
+    }
+}
+
+bool timedOut(const std::string& output)
+{
+    return output.compare(0, 28, "Status: 504 Gateway Timeout\n") == 0;
+}
+
+int main()
+{
+    // Testing deadlines set by requests and cancellation of busy requests
+    {
+        Fastcgipp::Loopback loopback;
+        Fastcgipp::Manager<Slow> manager(2);
+        manager.setTransport(loopback);
+        manager.start();
+
+        Fastcgipp::Loopback::Client client = loopback.connect();
+
+        // A request's own deadline gets it a 504
+        {
+            std::vector<char> records;
+            request(records, 1, "/deadline");
+            const auto start = std::chrono::steady_clock::now();
+            send(client, records);
+            if(!timedOut(receive(client, 1)))
+                FAIL_LOG("Fastcgipp::Cancellation missed the deadline")
+            if(std::chrono::steady_clock::now()-start
+                    < std::chrono::milliseconds(50))
+                FAIL_LOG("Fastcgipp::Cancellation timed out too early")
+        }
+
+        // So does a busy request that returns once past it's deadline
+        {
+            std::vector<char> records;
+            request(records, 4, "/busy");
+            send(client, records);
+            if(!timedOut(receive(client, 4)))
+                FAIL_LOG("Fastcgipp::Cancellation didn't time out a busy "\
+                        "request")
+            if(observed != Fastcgipp::Cancellation::DEADLINE)
+                FAIL_LOG("Fastcgipp::Cancellation didn't see the deadline")
+        }
+
+        // An ABORT_REQUEST sets the token of a busy request
+        {
+            std::vector<char> records;
+            request(records, 2, "/spin");
+            send(client, records);
+            wait([] () { return spinning.load(); }, "the spin");
+
+            records.clear();
+            record(
+                    records,
+                    Fastcgipp::Protocol::RecordType::ABORT_REQUEST,
+                    2,
+                    nullptr,
+                    0);
+            send(client, records);
+            receive(client, 2);
+            if(observed != Fastcgipp::Cancellation::ABORTED)
+                FAIL_LOG("Fastcgipp::Cancellation didn't see the abort")
+        }
+
+        // Losing the connection cancels a busy request
+        {
+            std::vector<char> records;
+            request(records, 3, "/spin");
+            send(client, records);
+            wait([] () { return spinning.load(); }, "the spin");
+
+            observed = Fastcgipp::Cancellation::NONE;
+            client.close();
+            wait([] () { return !spinning; }, "the disconnect");
+            if(observed != Fastcgipp::Cancellation::DISCONNECTED)
+                FAIL_LOG("Fastcgipp::Cancellation didn't see the disconnect")
+        }
+
+        manager.stop();
+        manager.join();
+    }
+
+    // Testing the Manager's default deadline
+    {
+        Fastcgipp::Loopback loopback;
+        Fastcgipp::Manager<Slow> manager(2);
+        manager.setTransport(loopback);
+        manager.setDeadline(std::chrono::milliseconds(50));
+        manager.start();
+
+        Fastcgipp::Loopback::Client client = loopback.connect();
+
+        // Expiring once constructed
+        {
+            std::vector<char> records;
+            request(records, 1, "/wait");
+            send(client, records);
+            if(!timedOut(receive(client, 1)))
+                FAIL_LOG("Fastcgipp::Cancellation missed the default deadline")
+        }
+
+        // Expiring while still waiting on parameters
+        {
+            std::vector<char> records;
+            const unsigned before = constructed;
+            request(records, 2, "/wait", false);
+            send(client, records);
+            if(!timedOut(receive(client, 2)))
+                FAIL_LOG("Fastcgipp::Cancellation missed the deadline of a "\
+                        "pending request")
+            if(constructed != before)
+                FAIL_LOG("Fastcgipp::Cancellation constructed a pending "\
+                        "request just to time it out")
+        }
+
+        client.close();
+        manager.stop();
+        manager.join();
+    }
+
+    return 0;
+}
@@ -0,0 +1,265 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/capture.hpp"
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/request.hpp"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+
+class Echo: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        out << "Content-Type: text/plain\r\n\r\n" \
+            << environment().requestUri;
+        return true;
+    }
+};
+
+void record(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::RecordType type,
+        Fastcgipp::Protocol::FcgiId id,
+        const char* content,
+        size_t size)
+{
+    Fastcgipp::Protocol::Header header;
+    header.version = Fastcgipp::Protocol::version;
+    header.type = type;
+    header.fcgiId = id;
+    header.contentLength = uint16_t(size);
+    header.paddingLength = 0;
+    header.reserved = 0;
+
+    const char* const start = (const char*)&header;
+    records.insert(records.end(), start, start+sizeof(header));
+    records.insert(records.end(), content, content+size);
+}
+
+//! Build a request returning the number of records in it
+unsigned request(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::FcgiId id,
+        const std::string& uri)
+{
+    Fastcgipp::Protocol::BeginRequest begin;
+    std::fill(begin.reserved, begin.reserved+sizeof(begin.reserved), 0);
+    begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+    begin.flags = Fastcgipp::Protocol::BeginRequest::keepConnBit;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+            id,
+            (const char*)&begin,
+            sizeof(begin));
+
+    std::string params;
+    params += char(11);
+    params += char(uri.size());
+    params += "REQUEST_URI";
+    params += uri;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            params.data(),
+            params.size());
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            nullptr,
+            0);
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::IN,
+            id,
+            nullptr,
+            0);
+    return 4;
+}
+
+void send(Fastcgipp::Loopback::Client& client, const std::vector<char>& data)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    size_t sent = 0;
+    while(sent < data.size())
+    {
+        sent += client.write(data.data()+sent, data.size()-sent);
+        if(std::chrono::steady_clock::now() > timeout)
+            FAIL_LOG("Fastcgipp::Capture timed out sending")
+        std::this_thread::yield();
+    }
+}
+
+//! Read responses until the given number of requests have ended
+void wait(Fastcgipp::Loopback::Client& client, unsigned requests)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    std::vector<char> buffer;
+
+    while(requests)
+    {
+        char chunk[4096];
+        const size_t count = client.read(chunk, sizeof(chunk));
+        buffer.insert(buffer.end(), chunk, chunk+count);
+
+        while(buffer.size() >= sizeof(Fastcgipp::Protocol::Header))
+        {
+            const Fastcgipp::Protocol::Header& header =
+                *(const Fastcgipp::Protocol::Header*)buffer.data();
+            const size_t size = sizeof(header)
+                +header.contentLength
+                +header.paddingLength;
+            if(buffer.size() < size)
+                break;
+            if(header.type == Fastcgipp::Protocol::RecordType::END_REQUEST)
+                --requests;
+            buffer.erase(buffer.begin(), buffer.begin()+size);
+        }
+
+        if(count == 0)
+        {
+            if(std::chrono::steady_clock::now() > timeout)
+                FAIL_LOG("Fastcgipp::Capture timed out receiving")
+            std::this_thread::yield();
+        }
+    }
+}
+
+int main()
+{
+    // Testing Fastcgipp::Capture and Fastcgipp::Replay
+    {
+        const char path[] = "capture_test.cap";
+        const unsigned clients = 3;
+        const unsigned requests = 40;
+        const auto gap = std::chrono::milliseconds(50);
+
+        unsigned records = 0;
+        size_t bytes = 0;
+
+        // Capture some traffic with a pause in the middle
+        {
+            Fastcgipp::Loopback loopback;
+            Fastcgipp::Manager<Echo> manager(2);
+            manager.setTransport(loopback);
+            if(!manager.capture(path))
+                FAIL_LOG("Fastcgipp::Capture couldn't open " << path)
+            manager.start();
+
+            std::vector<Fastcgipp::Loopback::Client> connections;
+            for(unsigned i=0; i<clients; ++i)
+                connections.push_back(loopback.connect());
+
+            for(unsigned half=0; half<2; ++half)
+            {
+                if(half)
+                    std::this_thread::sleep_for(gap);
+                for(unsigned i=0; i<clients; ++i)
+                {
+                    std::vector<char> data;
+                    for(unsigned j=0; j<requests/2; ++j)
+                        records += request(
+                                data,
+                                Fastcgipp::Protocol::FcgiId(1+j),
+                                "/" + std::to_string(i) \
+                                    + "/" + std::to_string(j));
+                    bytes += data.size();
+                    send(connections[i], data);
+                    wait(connections[i], requests/2);
+                }
+            }
+
+            // Close one connection ourselves and leave the rest open
+            connections.front().close();
+            const auto timeout = std::chrono::steady_clock::now()
+                + std::chrono::seconds(10);
+            while(loopback.size() != clients-1)
+            {
+                if(std::chrono::steady_clock::now() > timeout)
+                    FAIL_LOG("Fastcgipp::Capture connection wasn't closed")
+                std::this_thread::yield();
+            }
+
+            manager.terminate();
+            manager.join();
+        }
+
+        Fastcgipp::Replay replay;
+        if(!replay.load(path))
+            FAIL_LOG("Fastcgipp::Replay couldn't load " << path)
+        if(replay.size() != records+1)
+            FAIL_LOG("Fastcgipp::Replay loaded " << replay.size() \
+                    << " events instead of " << records+1)
+
+        Fastcgipp::Loopback loopback(1000);
+        Fastcgipp::Manager<Echo> manager(2);
+        manager.setTransport(loopback);
+        manager.start();
+
+        size_t received = 0;
+        for(const double speed: {0.0, 1.0, 4.0})
+        {
+            const Fastcgipp::Replay::Statistics stats =
+                replay.play(loopback, speed);
+
+            if(stats.connections != clients)
+                FAIL_LOG("Fastcgipp::Replay opened " << stats.connections \
+                        << " connections instead of " << clients)
+            if(stats.requests != clients*requests
+                    || stats.completed != stats.requests)
+                FAIL_LOG("Fastcgipp::Replay completed " << stats.completed \
+                        << " of " << stats.requests << " requests")
+            if(stats.sent != bytes)
+                FAIL_LOG("Fastcgipp::Replay sent " << stats.sent \
+                        << " bytes instead of " << bytes)
+            if(received == 0)
+                received = stats.received;
+            else if(stats.received != received)
+                FAIL_LOG("Fastcgipp::Replay got different responses at " \
+                        "different speeds")
+            if(speed == 1 && stats.elapsed < gap)
+                FAIL_LOG("Fastcgipp::Replay didn't keep the original timing")
+
+            const auto timeout = std::chrono::steady_clock::now()
+                + std::chrono::seconds(10);
+            while(loopback.size() != 0)
+            {
+                if(std::chrono::steady_clock::now() > timeout)
+                    FAIL_LOG("Fastcgipp::Replay left connections open")
+                std::this_thread::yield();
+            }
+        }
+
+        manager.stop();
+        manager.join();
+
+        // A truncated file keeps all the complete events
+        {
+            std::ifstream in(path, std::ios::binary);
+            std::vector<char> data(
+                    (std::istreambuf_iterator<char>(in)),
+                    std::istreambuf_iterator<char>());
+            in.close();
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(data.data(), data.size()-3);
+        }
+        if(!replay.load(path) || replay.size() != records)
+            FAIL_LOG("Fastcgipp::Replay mishandled a truncated file")
+
+        std::remove(path);
+
+        if(replay.load(path))
+            FAIL_LOG("Fastcgipp::Replay loaded a missing file")
+    }
+
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/client.hpp"
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/request.hpp"
+
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <atomic>
+
+class Echo: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        out << "Content-Type: text/plain\r\n\r\n" \
+            << environment().requestUri;
+        if(environment().requestUri == "/error")
+            err << "error";
+        if(environment().requestUri.compare(0, 5, "/big/") == 0)
+            for(unsigned i=0; i<5000; ++i)
+                out << environment().requestUri;
+        return true;
+    }
+};
+
+std::string uri(unsigned i)
+{
+    return "/" + std::to_string(i);
+}
+
+std::string output(const Fastcgipp::Client::Response& response)
+{
+    return std::string(response.out.begin(), response.out.end());
+}
+
+int main()
+{
+    std::random_device trueRand;
+    std::uniform_int_distribution<> portDist(2048, 65534);
+    const std::string port = std::to_string(portDist(trueRand));
+
+    // Without TCP_NODELAY each response would wait on a delayed ACK
+    Fastcgipp::ListenOptions options;
+    options.noDelay = true;
+
+    Fastcgipp::Manager<Echo> manager(4);
+    if(!manager.listen("127.0.0.1", port.c_str(), options))
+        FAIL_LOG("Unable to listen on 127.0.0.1:" << port.c_str())
+    manager.start();
+
+    // Testing Fastcgipp::Client
+    {
+        const unsigned requests = 2000;
+
+        // Few enough connections and FcgiIds that requests must queue up
+        Fastcgipp::Client client(2, 8);
+        client.server("127.0.0.1", port.c_str());
+        client.start();
+
+        std::atomic_uint completed(0);
+        std::atomic_uint wrong(0);
+        for(unsigned i=0; i<requests; ++i)
+        {
+            const std::string expected =
+                "Content-Type: text/plain\r\n\r\n" + uri(i);
+            client.request(
+                    {{"REQUEST_URI", uri(i)}},
+                    nullptr,
+                    0,
+                    [&completed, &wrong, expected]
+                    (Fastcgipp::Client::Response&& response)
+                    {
+                        if(
+                                !response.complete
+                                || response.protocolStatus
+                                    != Fastcgipp::Protocol::ProtocolStatus
+                                        ::REQUEST_COMPLETE
+                                || output(response) != expected)
+                            ++wrong;
+                        ++completed;
+                    });
+        }
+
+        // Enough parameter data to span many records
+        const std::string big(60000, 'x');
+        Fastcgipp::Client::Parameters parameters;
+        for(unsigned i=0; i<10; ++i)
+            parameters.emplace_back(
+                    "HTTP_PADDING_"+std::to_string(i),
+                    std::string(30000, 'y'));
+        parameters.emplace_back("REQUEST_URI", big);
+        auto bigResponse = client.request(parameters);
+
+        auto errorResponse = client.request({{"REQUEST_URI", "/error"}});
+
+        if(output(bigResponse.get()) != "Content-Type: text/plain\r\n\r\n"+big)
+            FAIL_LOG("Fastcgipp::Client got the wrong response to a large " \
+                    "request")
+
+        const Fastcgipp::Client::Response error = errorResponse.get();
+        if(std::string(error.err.begin(), error.err.end()) != "error")
+            FAIL_LOG("Fastcgipp::Client got the wrong error stream")
+
+        client.stop();
+        client.join();
+
+        if(completed != requests)
+            FAIL_LOG("Fastcgipp::Client only completed " \
+                    << completed << " of " << requests << " requests")
+        if(wrong != 0)
+            FAIL_LOG("Fastcgipp::Client got " << wrong << " wrong responses")
+    }
+
+    // Many big responses interleaved over a single connection
+    {
+        const unsigned requests = 256;
+
+        Fastcgipp::Client client(1, requests);
+        client.server("127.0.0.1", port.c_str());
+        client.start();
+
+        std::vector<std::future<Fastcgipp::Client::Response>> responses;
+        for(unsigned i=0; i<requests; ++i)
+            responses.push_back(client.request(
+                        {{"REQUEST_URI", "/big" + uri(i)}}));
+
+        for(unsigned i=0; i<requests; ++i)
+        {
+            std::string expected = "Content-Type: text/plain\r\n\r\n";
+            for(unsigned j=0; j<5001; ++j)
+                expected += "/big" + uri(i);
+            if(output(responses[i].get()) != expected)
+                FAIL_LOG("Fastcgipp::Client got the wrong multiplexed " \
+                        "response for " << i)
+        }
+
+        client.stop();
+        client.join();
+    }
+
+    // Requests that can't connect should fail
+    {
+        const std::string service = std::to_string(
+                portDist(trueRand)%2 ? std::stoi(port)+1 : std::stoi(port)-1);
+        Fastcgipp::Client client;
+        client.server("127.0.0.1", service.c_str());
+        client.start();
+
+        if(client.request({{"REQUEST_URI", "/"}}).get().complete)
+            FAIL_LOG("Fastcgipp::Client completed a request to nothing")
+
+        client.stop();
+        client.join();
+    }
+
+    manager.stop();
+    manager.join();
+
+    return 0;
+}
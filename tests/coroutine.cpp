@@ -0,0 +1,296 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/coroutine.hpp"
+#include "fastcgi++/loopback.hpp"
+#include "fastcgi++/manager.hpp"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+
+Fastcgipp::Timer timer;
+std::atomic_bool started(false);
+std::atomic_bool finished(false);
+std::atomic_uint destroyed(0);
+
+//! Counts how many coroutine frames have been destroyed
+struct Guard
+{
+    ~Guard()
+    {
+        ++destroyed;
+    }
+};
+
+class Coroutine: public Fastcgipp::CoRequest<char>
+{
+    //! Have another thread send us a message after a delay
+    void later(int type, const std::string& data, unsigned milliseconds)
+    {
+        std::thread([=, callback=callback()] ()
+        {
+            std::this_thread::sleep_for(
+                    std::chrono::milliseconds(milliseconds));
+            Fastcgipp::Message message(type);
+            message.data.assign(data.cbegin(), data.cend());
+            callback(std::move(message));
+        }).detach();
+    }
+
+    Fastcgipp::Task<std::string> fetch(const std::string& data)
+    {
+        later(1, data, 10);
+        const Fastcgipp::Message message = co_await receive();
+        co_return std::string(message.data.cbegin(), message.data.cend());
+    }
+
+    Fastcgipp::Task<> coResponse()
+    {
+        out << "Content-Type: text/plain\r\n\r\n";
+
+        if(environment().requestUri == "/receive")
+        {
+            // Suspend twice through a nested task
+            out << co_await fetch("one");
+            out << co_await fetch("two");
+        }
+        else if(environment().requestUri == "/sleep")
+        {
+            // A message sent while sleeping doesn't wake us but is still
+            // there to be received afterwards
+            later(2, "", 20);
+            const auto start = std::chrono::steady_clock::now();
+            co_await sleep(timer, std::chrono::milliseconds(200));
+            out << (std::chrono::steady_clock::now()-start
+                    < std::chrono::milliseconds(150) ? "early" : "slept");
+            const Fastcgipp::Message message = co_await receive();
+            out << ' ' << message.type;
+
+            // Nothing is left over from the timer
+            out << ' ' << co_await fetch("after");
+        }
+        else if(environment().requestUri == "/checkpoint")
+        {
+            Guard guard;
+            out << "started";
+            out.flush();
+            started = true;
+            while(true)
+            {
+                co_await checkpoint();
+                std::this_thread::yield();
+            }
+            finished = true;
+        }
+    }
+};
+
+void record(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::RecordType type,
+        Fastcgipp::Protocol::FcgiId id,
+        const char* content,
+        size_t size)
+{
+    Fastcgipp::Protocol::Header header;
+    header.version = Fastcgipp::Protocol::version;
+    header.type = type;
+    header.fcgiId = id;
+    header.contentLength = uint16_t(size);
+    header.paddingLength = 0;
+    header.reserved = 0;
+
+    const char* const start = (const char*)&header;
+    records.insert(records.end(), start, start+sizeof(header));
+    records.insert(records.end(), content, content+size);
+}
+
+void request(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::FcgiId id,
+        const std::string& uri)
+{
+    Fastcgipp::Protocol::BeginRequest begin;
+    std::fill(begin.reserved, begin.reserved+sizeof(begin.reserved), 0);
+    begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+    begin.flags = Fastcgipp::Protocol::BeginRequest::keepConnBit;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+            id,
+            (const char*)&begin,
+            sizeof(begin));
+
+    std::string params;
+    params += char(11);
+    params += char(uri.size());
+    params += "REQUEST_URI";
+    params += uri;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            params.data(),
+            params.size());
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            nullptr,
+            0);
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::IN,
+            id,
+            nullptr,
+            0);
+}
+
+void send(Fastcgipp::Loopback::Client& client, const std::vector<char>& data)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    size_t sent = 0;
+    while(sent < data.size())
+    {
+        sent += client.write(data.data()+sent, data.size()-sent);
+        if(std::chrono::steady_clock::now() > timeout)
+            FAIL_LOG("Fastcgipp::CoRequest timed out sending")
+        std::this_thread::yield();
+    }
+}
+
+//! Receive a response and return it's output without the header
+std::string receive(
+        Fastcgipp::Loopback::Client& client,
+        Fastcgipp::Protocol::ProtocolStatus& status)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    std::vector<char> buffer;
+    std::string output;
+
+    while(true)
+    {
+        char chunk[4096];
+        const size_t count = client.read(chunk, sizeof(chunk));
+        buffer.insert(buffer.end(), chunk, chunk+count);
+
+        while(buffer.size() >= sizeof(Fastcgipp::Protocol::Header))
+        {
+            const Fastcgipp::Protocol::Header& header =
+                *(const Fastcgipp::Protocol::Header*)buffer.data();
+            const size_t size = sizeof(header)
+                +header.contentLength
+                +header.paddingLength;
+            if(buffer.size() < size)
+                break;
+
+            if(header.type == Fastcgipp::Protocol::RecordType::OUT)
+                output.append(
+                        buffer.data()+sizeof(header),
+                        header.contentLength);
+            else if(header.type
+                    == Fastcgipp::Protocol::RecordType::END_REQUEST)
+            {
+                status = ((const Fastcgipp::Protocol::EndRequest*)(
+                            buffer.data()+sizeof(header)))->protocolStatus;
+                const std::string head("Content-Type: text/plain\r\n\r\n");
+                if(output.compare(0, head.size(), head) != 0)
+                    FAIL_LOG("Fastcgipp::CoRequest got no header")
+                return output.substr(head.size());
+            }
+            buffer.erase(buffer.begin(), buffer.begin()+size);
+        }
+
+        if(count == 0)
+        {
+            if(client.closed())
+                FAIL_LOG("Fastcgipp::CoRequest connection closed early")
+            if(std::chrono::steady_clock::now() > timeout)
+                FAIL_LOG("Fastcgipp::CoRequest timed out receiving")
+            std::this_thread::yield();
+        }
+    }
+}
+
+int main()
+{
+    // Testing Fastcgipp::CoRequest
+    {
+        timer.start();
+
+        Fastcgipp::Loopback loopback;
+        Fastcgipp::Manager<Coroutine> manager(2);
+        manager.setTransport(loopback);
+        manager.start();
+
+        Fastcgipp::Loopback::Client client = loopback.connect();
+        Fastcgipp::Protocol::ProtocolStatus status;
+        const auto complete =
+            Fastcgipp::Protocol::ProtocolStatus::REQUEST_COMPLETE;
+
+        // Resuming from receive() through a nested task
+        {
+            std::vector<char> records;
+            request(records, 1, "/receive");
+            send(client, records);
+            if(receive(client, status) != "onetwo" || status != complete)
+                FAIL_LOG("Fastcgipp::CoRequest wasn't resumed by receive()")
+        }
+
+        // Sleeping with a message arriving part way through
+        {
+            std::vector<char> records;
+            request(records, 1, "/sleep");
+            send(client, records);
+            if(receive(client, status) != "slept 2 after")
+                FAIL_LOG("Fastcgipp::CoRequest sleep() was interrupted")
+        }
+
+        // Aborting a request spinning on checkpoint()
+        {
+            std::vector<char> records;
+            request(records, 1, "/checkpoint");
+            send(client, records);
+
+            const auto timeout = std::chrono::steady_clock::now()
+                + std::chrono::seconds(10);
+            while(!started)
+            {
+                if(std::chrono::steady_clock::now() > timeout)
+                    FAIL_LOG("Fastcgipp::CoRequest never started")
+                std::this_thread::yield();
+            }
+
+            records.clear();
+            record(
+                    records,
+                    Fastcgipp::Protocol::RecordType::ABORT_REQUEST,
+                    1,
+                    nullptr,
+                    0);
+            send(client, records);
+            if(receive(client, status) != "started" || status != complete)
+                FAIL_LOG("Fastcgipp::CoRequest wasn't completed when aborted")
+
+            while(destroyed == 0)
+            {
+                if(std::chrono::steady_clock::now() > timeout)
+                    FAIL_LOG("Fastcgipp::CoRequest frame wasn't destroyed")
+                std::this_thread::yield();
+            }
+            if(finished)
+                FAIL_LOG("Fastcgipp::CoRequest ran past checkpoint()")
+        }
+
+        client.close();
+        manager.stop();
+        manager.join();
+        timer.stop();
+    }
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/client.hpp"
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/request.hpp"
+#include "fastcgi++/handoff.hpp"
+
+#include <string>
+#include <memory>
+#include <random>
+
+#include <unistd.h>
+
+//! Responds with the name of the process it belongs to
+template<const char* name> class Named: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        out << "Content-Type: text/plain\r\n\r\n" << name;
+        return true;
+    }
+};
+
+const char oldName[] = "old";
+const char newName[] = "new";
+
+//! Make a single request to the listener and return the body
+std::string fetch(const std::string& port)
+{
+    Fastcgipp::Client client;
+    client.server("127.0.0.1", port.c_str());
+    client.start();
+    const Fastcgipp::Client::Response response =
+        client.request({{"REQUEST_URI", "/"}}).get();
+    client.stop();
+    client.join();
+
+    if(!response.complete)
+        return std::string();
+    const std::string output(response.out.begin(), response.out.end());
+    const size_t body = output.find("\r\n\r\n");
+    if(body == std::string::npos)
+        return std::string();
+    return output.substr(body+4);
+}
+
+int main()
+{
+    std::random_device trueRand;
+    std::uniform_int_distribution<> portDist(2048, 65535);
+    const std::string port = std::to_string(portDist(trueRand));
+    const std::string control = "/tmp/fastcgipp-handoff-test-"
+        + std::to_string(getpid());
+
+    // Testing that nothing is taken when nothing is offered
+    {
+        Fastcgipp::Manager<Named<newName>> manager(1);
+        if(Fastcgipp::Handoff::take(manager, control.c_str()))
+            FAIL_LOG("Fastcgipp::Handoff took listeners from nobody")
+    }
+
+    // Testing a handoff between two managers
+    {
+        std::unique_ptr<Fastcgipp::Manager<Named<oldName>>> old(
+                new Fastcgipp::Manager<Named<oldName>>(1));
+        if(!old->listen("127.0.0.1", port.c_str()))
+            FAIL_LOG("Unable to listen on 127.0.0.1:" << port.c_str())
+        old->start();
+        if(fetch(port) != "old")
+            FAIL_LOG("Fastcgipp::Handoff got no response before the handoff")
+
+        std::unique_ptr<Fastcgipp::Handoff> handoff(
+                new Fastcgipp::Handoff(*old));
+        if(!handoff->offer(control.c_str()))
+            FAIL_LOG("Fastcgipp::Handoff couldn't offer the listeners")
+
+        Fastcgipp::Manager<Named<newName>> replacement(1);
+        if(!Fastcgipp::Handoff::take(replacement, control.c_str()))
+            FAIL_LOG("Fastcgipp::Handoff couldn't take the listeners")
+        replacement.start();
+
+        // The old manager stops by itself once they're handed over
+        old->join();
+        handoff.reset();
+        old.reset();
+
+        // Destroying the old manager mustn't shut the listener down
+        for(unsigned i=0; i<3; ++i)
+            if(fetch(port) != "new")
+                FAIL_LOG("Fastcgipp::Handoff didn't hand the listener over")
+
+        replacement.stop();
+        replacement.join();
+    }
+
+    ::unlink(control.c_str());
+    return 0;
+}
@@ -0,0 +1,268 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/loopback.hpp"
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/request.hpp"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+class Echo: public Fastcgipp::Request<char>
+{
+    bool response()
+    {
+        out << "Content-Type: text/plain\r\n\r\n" \
+            << environment().requestUri;
+        return true;
+    }
+};
+
+void record(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::RecordType type,
+        Fastcgipp::Protocol::FcgiId id,
+        const char* content,
+        size_t size)
+{
+    Fastcgipp::Protocol::Header header;
+    header.version = Fastcgipp::Protocol::version;
+    header.type = type;
+    header.fcgiId = id;
+    header.contentLength = uint16_t(size);
+    header.paddingLength = 0;
+    header.reserved = 0;
+
+    const char* const start = (const char*)&header;
+    records.insert(records.end(), start, start+sizeof(header));
+    records.insert(records.end(), content, content+size);
+}
+
+void request(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::FcgiId id,
+        const std::string& uri,
+        bool keep)
+{
+    Fastcgipp::Protocol::BeginRequest begin;
+    std::fill(begin.reserved, begin.reserved+sizeof(begin.reserved), 0);
+    begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+    begin.flags = keep?Fastcgipp::Protocol::BeginRequest::keepConnBit:0;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+            id,
+            (const char*)&begin,
+            sizeof(begin));
+
+    std::string params;
+    params += char(11);
+    params += char(uri.size());
+    params += "REQUEST_URI";
+    params += uri;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            params.data(),
+            params.size());
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            nullptr,
+            0);
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::IN,
+            id,
+            nullptr,
+            0);
+}
+
+void send(Fastcgipp::Loopback::Client& client, const std::vector<char>& data)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    size_t sent = 0;
+    while(sent < data.size())
+    {
+        sent += client.write(data.data()+sent, data.size()-sent);
+        if(std::chrono::steady_clock::now() > timeout)
+            FAIL_LOG("Fastcgipp::Loopback timed out sending")
+        std::this_thread::yield();
+    }
+}
+
+//! Receive a response and return it's output
+std::string receive(
+        Fastcgipp::Loopback::Client& client,
+        Fastcgipp::Protocol::FcgiId id)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    std::vector<char> buffer;
+    std::string output;
+
+    while(true)
+    {
+        char chunk[4096];
+        const size_t count = client.read(chunk, sizeof(chunk));
+        buffer.insert(buffer.end(), chunk, chunk+count);
+
+        while(buffer.size() >= sizeof(Fastcgipp::Protocol::Header))
+        {
+            const Fastcgipp::Protocol::Header& header =
+                *(const Fastcgipp::Protocol::Header*)buffer.data();
+            const size_t size = sizeof(header)
+                +header.contentLength
+                +header.paddingLength;
+            if(buffer.size() < size)
+                break;
+
+            if(header.fcgiId != id)
+                FAIL_LOG("Fastcgipp::Loopback got a record for request " \
+                        << header.fcgiId << " instead of " << id)
+
+            if(header.type == Fastcgipp::Protocol::RecordType::OUT)
+                output.append(
+                        buffer.data()+sizeof(header),
+                        header.contentLength);
+            else if(header.type
+                    == Fastcgipp::Protocol::RecordType::END_REQUEST)
+            {
+                if(buffer.size() != size)
+                    FAIL_LOG("Fastcgipp::Loopback got data after the end")
+                return output;
+            }
+            buffer.erase(buffer.begin(), buffer.begin()+size);
+        }
+
+        if(count == 0)
+        {
+            if(client.closed())
+                FAIL_LOG("Fastcgipp::Loopback connection closed early")
+            if(std::chrono::steady_clock::now() > timeout)
+                FAIL_LOG("Fastcgipp::Loopback timed out receiving")
+            std::this_thread::yield();
+        }
+    }
+}
+
+int main()
+{
+    // Testing Fastcgipp::Loopback
+    {
+        const unsigned clients = 4;
+        const unsigned requests = 500;
+
+        // Small rings so that records wrap and writes fill them up
+        Fastcgipp::Loopback loopback(1000);
+        Fastcgipp::Manager<Echo> manager(2);
+        manager.setTransport(loopback);
+        manager.start();
+
+        std::vector<std::thread> threads;
+        for(unsigned i=0; i<clients; ++i)
+            threads.emplace_back([&loopback, i] ()
+            {
+                Fastcgipp::Loopback::Client client = loopback.connect();
+                for(unsigned j=0; j<requests; ++j)
+                {
+                    const Fastcgipp::Protocol::FcgiId id = 1+j%3;
+                    const std::string uri = "/" + std::to_string(i) \
+                            + "/" + std::to_string(j);
+                    std::vector<char> records;
+                    request(records, id, uri, true);
+                    send(client, records);
+
+                    const std::string output = receive(client, id);
+                    const std::string expected =
+                        "Content-Type: text/plain\r\n\r\n" + uri;
+                    if(output != expected)
+                        FAIL_LOG("Fastcgipp::Loopback got the wrong " \
+                                "response for " << uri.c_str())
+                }
+            });
+        for(auto& thread: threads)
+            thread.join();
+
+        // Without keep alive we should close the connection
+        {
+            Fastcgipp::Loopback::Client client = loopback.connect();
+            std::vector<char> records;
+            request(records, 1, "/close", false);
+            send(client, records);
+            if(receive(client, 1) != "Content-Type: text/plain\r\n\r\n/close")
+                FAIL_LOG("Fastcgipp::Loopback got the wrong response")
+
+            const auto timeout = std::chrono::steady_clock::now()
+                + std::chrono::seconds(10);
+            while(!client.closed())
+            {
+                if(std::chrono::steady_clock::now() > timeout)
+                    FAIL_LOG("Fastcgipp::Loopback connection wasn't closed")
+                std::this_thread::yield();
+            }
+        }
+
+        // Management queries get a reply for each name we know
+        {
+            Fastcgipp::Loopback::Client client = loopback.connect();
+            std::string names;
+            for(const std::string name: {
+                    "FCGI_MAX_CONNS",
+                    "FCGI_UNKNOWN",
+                    "FCGI_MPXS_CONNS"})
+            {
+                names += char(name.size());
+                names += char(0);
+                names += name;
+            }
+            std::vector<char> records;
+            record(
+                    records,
+                    Fastcgipp::Protocol::RecordType::GET_VALUES,
+                    0,
+                    names.data(),
+                    names.size());
+            send(client, records);
+
+            const auto timeout = std::chrono::steady_clock::now()
+                + std::chrono::seconds(10);
+            const size_t expected =
+                sizeof(Fastcgipp::Protocol::maxConnsReply)
+                +sizeof(Fastcgipp::Protocol::mpxsConnsReply);
+            std::vector<char> replies;
+            while(replies.size() < expected)
+            {
+                char chunk[4096];
+                const size_t count = client.read(chunk, sizeof(chunk));
+                replies.insert(replies.end(), chunk, chunk+count);
+                if(std::chrono::steady_clock::now() > timeout)
+                    FAIL_LOG("Fastcgipp::Loopback got no management reply")
+                std::this_thread::yield();
+            }
+            const char* const maxConns =
+                (const char*)&Fastcgipp::Protocol::maxConnsReply;
+            if(replies.size() != expected || !std::equal(
+                        maxConns,
+                        maxConns+sizeof(Fastcgipp::Protocol::maxConnsReply),
+                        replies.begin()))
+                FAIL_LOG("Fastcgipp::Loopback got the wrong management reply")
+        }
+
+        manager.stop();
+        manager.join();
+
+        if(loopback.size() != 0)
+            FAIL_LOG("Fastcgipp::Loopback has connections left open")
+
+        // Once stopped nothing more is accepted
+        if(!loopback.connect().closed())
+            FAIL_LOG("Fastcgipp::Loopback accepted a connection when stopped")
+    }
+
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include <memory>
 #include <cstdint>
 #include <vector>
+#include <algorithm>
 
 int main()
 {
@@ -184,5 +185,100 @@ int main()
                     "values and long names")
     }
 
+    // Testing Fastcgipp::Protocol::decodeParameters() with a mix of short and
+    // long names and values
+    for(int i=0; i<20; ++i)
+    {
+        std::uniform_int_distribution<size_t> randomSize(0, 300);
+        std::vector<char> body;
+        std::vector<Fastcgipp::Protocol::Parameter> expected;
+        std::vector<size_t> ends;
+
+        for(int j=0; j<50; ++j)
+        {
+            const size_t nameSize = randomSize(engine);
+            const size_t valueSize = randomSize(engine);
+            for(const size_t size: {nameSize, valueSize})
+            {
+                if(size > 127)
+                {
+                    const size_t position = body.size();
+                    body.resize(position+4);
+                    *(Fastcgipp::Protocol::BigEndian<int32_t>*)&body[position]
+                        = (uint32_t)size;
+                    body[position] |= 0x80;
+                }
+                else
+                    body.push_back((char)size);
+            }
+
+            Fastcgipp::Protocol::Parameter parameter;
+            parameter.name = body.size();
+            parameter.nameSize = nameSize;
+            parameter.value = body.size()+nameSize;
+            parameter.valueSize = valueSize;
+            expected.push_back(parameter);
+
+            for(size_t k=0; k<nameSize+valueSize; ++k)
+                body.push_back((char)engine());
+            ends.push_back(body.size());
+        }
+
+        // Cut the data off at every point near the start and the end
+        for(size_t size=0; size<=body.size(); ++size)
+        {
+            if(size > 8 && size < ends[ends.size()-3])
+                continue;
+            const size_t complete = std::upper_bound(
+                    ends.begin(),
+                    ends.end(),
+                    size) - ends.begin();
+
+            std::vector<Fastcgipp::Protocol::Parameter> parameters;
+            const size_t used = Fastcgipp::Protocol::decodeParameters(
+                    body.data(),
+                    size,
+                    parameters);
+
+            if(parameters.size() != complete
+                    || used != (complete ? ends[complete-1] : 0))
+                FAIL_LOG("Fastcgipp::Protocol::decodeParameters decoded " \
+                        "the wrong number of pairs")
+
+            for(size_t j=0; j<parameters.size(); ++j)
+                if(parameters[j].name != expected[j].name
+                        || parameters[j].nameSize != expected[j].nameSize
+                        || parameters[j].value != expected[j].value
+                        || parameters[j].valueSize != expected[j].valueSize)
+                    FAIL_LOG("Fastcgipp::Protocol::decodeParameters got " \
+                            "a pair wrong")
+        }
+
+        // It should agree with processParamHeader()
+        std::vector<Fastcgipp::Protocol::Parameter> parameters;
+        Fastcgipp::Protocol::decodeParameters(
+                body.data(),
+                body.size(),
+                parameters);
+        auto data = body.cbegin();
+        std::vector<char>::const_iterator name;
+        std::vector<char>::const_iterator value;
+        std::vector<char>::const_iterator end;
+        for(const auto& parameter: parameters)
+        {
+            if(!Fastcgipp::Protocol::processParamHeader(
+                        data,
+                        body.cend(),
+                        name,
+                        value,
+                        end)
+                    || size_t(name-body.cbegin()) != parameter.name
+                    || size_t(end-value) != parameter.valueSize)
+                FAIL_LOG("Fastcgipp::Protocol::decodeParameters disagrees " \
+                        "with processParamHeader()")
+            data = end;
+        }
+    }
+
     return 0;
 }
@@ -0,0 +1,119 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/router.hpp"
+
+#include <map>
+#include <string>
+
+int main()
+{
+    // Testing Fastcgipp::PathTrie
+    {
+        static const char* const patterns[] =
+        {
+            "/",
+            "/users",
+            "/users/",
+            "/users/:id",
+            "/users/:id/posts",
+            "/users/:id/posts/:post",
+            "/users/me",
+            "/user",
+            "/static/*file",
+            "/u/:name/*rest",
+            "/api/v1/:resource",
+            "/api/v2/:resource",
+            "/api/v1/status"
+        };
+        const unsigned patternCount = sizeof(patterns)/sizeof(const char*);
+
+        Fastcgipp::PathTrie trie;
+        for(unsigned i=0; i<patternCount; ++i)
+            if(!trie.insert(patterns[i], i))
+                FAIL_LOG("Fastcgipp::PathTrie rejected " << patterns[i])
+
+        // Conflicting and malformed patterns
+        if(trie.insert("/users/:name", 100))
+            FAIL_LOG("Fastcgipp::PathTrie accepted a conflicting segment name")
+        if(trie.insert("/users/me", 100))
+            FAIL_LOG("Fastcgipp::PathTrie accepted a duplicate pattern")
+        if(trie.insert("/static/*other", 100))
+            FAIL_LOG("Fastcgipp::PathTrie accepted a duplicate catch-all")
+        if(trie.insert("/files/*path/more", 100))
+            FAIL_LOG("Fastcgipp::PathTrie accepted a misplaced catch-all")
+        if(trie.insert("/x/:/y", 100))
+            FAIL_LOG("Fastcgipp::PathTrie accepted an unnamed segment")
+
+        struct Case
+        {
+            const char* path;
+            int pattern;
+            const char* name;
+            const char* value;
+        };
+
+        static const Case cases[] =
+        {
+            {"/", 0, nullptr, nullptr},
+            {"/users", 1, nullptr, nullptr},
+            {"/users/", 2, nullptr, nullptr},
+            {"/users/42", 3, "id", "42"},
+            {"/users/42/posts", 4, "id", "42"},
+            {"/users/42/posts/7", 5, "post", "7"},
+            {"/users/me", 6, nullptr, nullptr},
+            {"/users/meh", 3, "id", "meh"},
+            {"/users/me/posts", 4, "id", "me"},
+            {"/user", 7, nullptr, nullptr},
+            {"/static/css/site.css", 8, "file", "css/site.css"},
+            {"/static/", 8, "file", ""},
+            {"/u/bob/a/b/c", 9, "rest", "a/b/c"},
+            {"/u/bob/", 9, "name", "bob"},
+            {"/api/v1/things", 10, "resource", "things"},
+            {"/api/v2/things", 11, "resource", "things"},
+            {"/api/v1/status", 12, nullptr, nullptr},
+            {"/api/v1/statuses", 10, "resource", "statuses"},
+            {"/users/42/comments", -1, nullptr, nullptr},
+            {"/api/v3/things", -1, nullptr, nullptr},
+            {"/use", -1, nullptr, nullptr},
+            {"/u/bob", -1, nullptr, nullptr},
+            {"/static", -1, nullptr, nullptr},
+            {"", -1, nullptr, nullptr}
+        };
+
+        for(const auto& test: cases)
+        {
+            const std::string path(test.path);
+            unsigned value;
+            std::map<std::string, std::string> captures;
+            const bool matched = trie.match(
+                    path.data(),
+                    path.data()+path.size(),
+                    value,
+                    captures);
+
+            if(test.pattern < 0)
+            {
+                if(matched)
+                    FAIL_LOG("Fastcgipp::PathTrie matched " << test.path \
+                            << " to " << patterns[value])
+                continue;
+            }
+
+            if(!matched || value != unsigned(test.pattern))
+                FAIL_LOG("Fastcgipp::PathTrie failed to match " << test.path)
+
+            if(test.name)
+            {
+                const auto capture = captures.find(test.name);
+                if(capture == captures.end()
+                        || capture->second != test.value)
+                    FAIL_LOG("Fastcgipp::PathTrie captured the wrong " \
+                            << test.name << " from " << test.path)
+            }
+            else if(!captures.empty())
+                FAIL_LOG("Fastcgipp::PathTrie captured something from " \
+                        << test.path)
+        }
+    }
+
+    return 0;
+}
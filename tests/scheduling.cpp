@@ -0,0 +1,433 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/loopback.hpp"
+#include "fastcgi++/manager.hpp"
+#include "fastcgi++/request.hpp"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <algorithm>
+
+//! Requests that got as far as sending a response in the order they did
+std::vector<std::string> finished;
+std::mutex finishedMutex;
+
+//! Callbacks of the requests waiting on a message
+std::map<std::string, std::function<void(Fastcgipp::Message)>> callbacks;
+std::mutex callbacksMutex;
+
+//! Requests busy in response() waiting on the gate
+std::atomic_uint blocked(0);
+std::atomic_bool gate(false);
+
+/*!
+ * The request URI is /CLASS/BEHAVIOUR/NAME where BEHAVIOUR is one of
+ *  - block: Wait for the gate to open and finish
+ *  - wait: Wait for a message and finish
+ *  - flood: Wait for the gate to open and then finish on the 20th message
+ *  - heavy: Like flood but with a weight of 30
+ *  - quick: Just finish
+ */
+class Scheduled: public Fastcgipp::Request<char>
+{
+public:
+    Scheduled():
+        m_messages(0)
+    {}
+
+private:
+    unsigned m_messages;
+
+    std::string behaviour() const
+    {
+        const std::string& uri = environment().requestUri;
+        const size_t start = uri.find('/', 1)+1;
+        return uri.substr(start, uri.find('/', start)-start);
+    }
+
+    unsigned classify()
+    {
+        if(behaviour() == "heavy")
+            setWeight(30);
+        return environment().requestUri[1]-'0';
+    }
+
+    bool response()
+    {
+        const std::string& uri = environment().requestUri;
+        const std::string behaviour = this->behaviour();
+
+        if(m_messages++ == 0)
+        {
+            if(behaviour == "wait" || behaviour == "flood"
+                    || behaviour == "heavy")
+            {
+                std::lock_guard<std::mutex> lock(callbacksMutex);
+                callbacks[uri] = callback();
+            }
+
+            if(behaviour == "wait")
+                return false;
+
+            if(behaviour != "quick")
+            {
+                ++blocked;
+                while(!gate)
+                    std::this_thread::yield();
+                --blocked;
+                if(behaviour != "block")
+                    return false;
+            }
+        }
+        else if(behaviour != "wait" && m_messages <= 20)
+            return false;
+
+        out << "Content-Type: text/plain\r\n\r\n" << uri;
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        finished.push_back(uri);
+        return true;
+    }
+};
+
+void record(
+        std::vector<char>& records,
+        Fastcgipp::Protocol::RecordType type,
+        Fastcgipp::Protocol::FcgiId id,
+        const char* content,
+        size_t size)
+{
+    Fastcgipp::Protocol::Header header;
+    header.version = Fastcgipp::Protocol::version;
+    header.type = type;
+    header.fcgiId = id;
+    header.contentLength = uint16_t(size);
+    header.paddingLength = 0;
+    header.reserved = 0;
+
+    const char* const start = (const char*)&header;
+    records.insert(records.end(), start, start+sizeof(header));
+    records.insert(records.end(), content, content+size);
+}
+
+void request(
+        Fastcgipp::Loopback::Client& client,
+        Fastcgipp::Protocol::FcgiId id,
+        const std::string& uri)
+{
+    std::vector<char> records;
+
+    Fastcgipp::Protocol::BeginRequest begin;
+    std::fill(begin.reserved, begin.reserved+sizeof(begin.reserved), 0);
+    begin.role = Fastcgipp::Protocol::Role::RESPONDER;
+    begin.flags = Fastcgipp::Protocol::BeginRequest::keepConnBit;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::BEGIN_REQUEST,
+            id,
+            (const char*)&begin,
+            sizeof(begin));
+
+    std::string params;
+    params += char(11);
+    params += char(uri.size());
+    params += "REQUEST_URI";
+    params += uri;
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            params.data(),
+            params.size());
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::PARAMS,
+            id,
+            nullptr,
+            0);
+    record(
+            records,
+            Fastcgipp::Protocol::RecordType::IN,
+            id,
+            nullptr,
+            0);
+
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    size_t sent = 0;
+    while(sent < records.size())
+    {
+        sent += client.write(records.data()+sent, records.size()-sent);
+        if(std::chrono::steady_clock::now() > timeout)
+            FAIL_LOG("Fastcgipp::Scheduling timed out sending")
+        std::this_thread::yield();
+    }
+}
+
+//! Wait for something to become true while draining the responses
+template<class Predicate> void wait(
+        Fastcgipp::Loopback::Client& client,
+        Predicate predicate,
+        const char* what)
+{
+    const auto timeout = std::chrono::steady_clock::now()
+        + std::chrono::seconds(10);
+    while(true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            if(predicate())
+                return;
+        }
+        char chunk[4096];
+        while(client.read(chunk, sizeof(chunk)));
+        if(std::chrono::steady_clock::now() > timeout)
+            FAIL_LOG("Fastcgipp::Scheduling timed out waiting for " << what)
+        std::this_thread::yield();
+    }
+}
+
+//! Send a message to a request waiting for one
+void wake(const std::string& uri)
+{
+    std::lock_guard<std::mutex> lock(callbacksMutex);
+    callbacks[uri](Fastcgipp::Message(1));
+}
+
+void reset()
+{
+    finished.clear();
+    callbacks.clear();
+    gate = false;
+}
+
+//! Which of two requests finishes first when one is handed a backlog
+/*!
+ * With a single handler thread, the waiting request is woken and then the
+ * other one is given 20 messages while it's stuck in response(). Without
+ * time slicing it handles them all before the waiting request gets a look in.
+ */
+std::string first(
+        unsigned messages,
+        std::chrono::microseconds time,
+        const std::string& backlogged)
+{
+    reset();
+
+    Fastcgipp::Loopback loopback;
+    Fastcgipp::Manager<Scheduled> manager(1);
+    manager.setTransport(loopback);
+    manager.setSlice(messages, time);
+    manager.start();
+
+    Fastcgipp::Loopback::Client client = loopback.connect();
+    request(client, 1, "/0/wait/waiting");
+    wait(
+            client,
+            [] () { return callbacks.size() == 1; },
+            "the waiting request");
+    request(client, 2, backlogged);
+    wait(client, [] () { return blocked == 1; }, "the backlogged request");
+
+    wake("/0/wait/waiting");
+    for(unsigned i=0; i<20; ++i)
+        wake(backlogged);
+    gate = true;
+    wait(client, [] () { return finished.size() == 2; }, "both requests");
+
+    client.close();
+    manager.stop();
+    manager.join();
+
+    return finished.front();
+}
+
+//! How many class 2 requests are among the first 8 of 6 from each class
+unsigned interleaved(unsigned weight1, unsigned weight2)
+{
+    reset();
+
+    Fastcgipp::Loopback loopback;
+    Fastcgipp::Manager<Scheduled> manager(1);
+    manager.setTransport(loopback);
+    manager.setClass(1, weight1);
+    manager.setClass(2, weight2);
+    manager.start();
+
+    Fastcgipp::Loopback::Client client = loopback.connect();
+    Fastcgipp::Protocol::FcgiId id = 1;
+    for(unsigned i=0; i<6; ++i)
+    {
+        request(client, id++, "/1/wait/" + std::to_string(i));
+        request(client, id++, "/2/wait/" + std::to_string(i));
+    }
+    wait(
+            client,
+            [] () { return callbacks.size() == 12; },
+            "the waiting requests");
+    request(client, id++, "/0/block/gate");
+    wait(client, [] () { return blocked == 1; }, "the blocking request");
+
+    // Queue them all up behind the blocking request
+    for(unsigned i=0; i<6; ++i)
+    {
+        wake("/2/wait/" + std::to_string(i));
+        wake("/1/wait/" + std::to_string(i));
+    }
+    gate = true;
+    wait(client, [] () { return finished.size() == 13; }, "all requests");
+
+    client.close();
+    manager.stop();
+    manager.join();
+
+    finished.erase(
+            std::find(finished.begin(), finished.end(), "/0/block/gate"));
+    return std::count_if(
+            finished.begin(),
+            finished.begin()+8,
+            [] (const std::string& uri) { return uri[1] == '2'; });
+}
+
+int main()
+{
+    // Testing time slicing
+    {
+        if(first(
+                    0,
+                    std::chrono::microseconds::zero(),
+                    "/0/flood/backlogged")
+                != "/0/flood/backlogged")
+            FAIL_LOG("Fastcgipp::Scheduling yielded without a time slice")
+
+        if(first(
+                    1,
+                    std::chrono::microseconds::zero(),
+                    "/0/flood/backlogged")
+                != "/0/wait/waiting")
+            FAIL_LOG("Fastcgipp::Scheduling didn't yield after a message")
+
+        if(first(
+                    0,
+                    std::chrono::microseconds(1),
+                    "/0/flood/backlogged")
+                != "/0/wait/waiting")
+            FAIL_LOG("Fastcgipp::Scheduling didn't yield after it's time")
+
+        // A heavy request gets a slice big enough to get through it all
+        if(first(
+                    1,
+                    std::chrono::microseconds::zero(),
+                    "/0/heavy/backlogged")
+                != "/0/heavy/backlogged")
+            FAIL_LOG("Fastcgipp::Scheduling ignored the request's weight")
+    }
+
+    // Testing weighted classes
+    {
+        if(interleaved(1, 1) != 4)
+            FAIL_LOG("Fastcgipp::Scheduling didn't alternate equal classes")
+
+        if(interleaved(3, 1) != 2)
+            FAIL_LOG("Fastcgipp::Scheduling didn't weight the classes")
+    }
+
+    // Testing class caps along with requeueing as requests are classified
+    {
+        reset();
+
+        Fastcgipp::Loopback loopback;
+        Fastcgipp::Manager<Scheduled> manager(2);
+        manager.setTransport(loopback);
+        manager.setClass(1, 1, 1);
+        manager.start();
+
+        Fastcgipp::Loopback::Client client = loopback.connect();
+        request(client, 1, "/1/block/first");
+        wait(client, [] () { return blocked == 1; }, "the first request");
+
+        // The second request starts off in class 0 and must be requeued in
+        // class 1 once classified, where it waits on the cap. Class 0 isn't
+        // held up by it.
+        request(client, 2, "/1/block/second");
+        request(client, 3, "/0/quick/unclassed");
+        wait(
+                client,
+                [] () { return finished.size() == 1; },
+                "the unclassed request");
+        const auto settle = std::chrono::steady_clock::now()
+            + std::chrono::milliseconds(100);
+        while(std::chrono::steady_clock::now() < settle)
+        {
+            if(blocked != 1)
+                FAIL_LOG("Fastcgipp::Scheduling exceeded a class cap")
+            std::this_thread::yield();
+        }
+
+        gate = true;
+        wait(client, [] () { return finished.size() == 3; }, "all requests");
+        if(finished != std::vector<std::string>{
+                    "/0/quick/unclassed",
+                    "/1/block/first",
+                    "/1/block/second"})
+            FAIL_LOG("Fastcgipp::Scheduling finished capped requests out of "\
+                    "order")
+
+        client.close();
+        manager.stop();
+        manager.join();
+    }
+
+    // Testing that an elastic pool grows, shrinks and joins cleanly
+    for(unsigned round=0; round<3; ++round)
+    {
+        reset();
+
+        Fastcgipp::Loopback loopback;
+        Fastcgipp::Manager<Scheduled> manager(1);
+        manager.setTransport(loopback);
+        manager.setElastic(
+                1,
+                3,
+                std::chrono::milliseconds(1),
+                std::chrono::milliseconds(10));
+        manager.start();
+
+        Fastcgipp::Loopback::Client client = loopback.connect();
+        for(Fastcgipp::Protocol::FcgiId id=1; id<=3; ++id)
+            request(client, id, "/0/block/" + std::to_string(id));
+        wait(client, [] () { return blocked == 3; }, "the pool to grow");
+
+        gate = true;
+        wait(client, [] () { return finished.size() == 3; }, "all requests");
+        wait(
+                client,
+                [&manager] () { return manager.poolStats().threads == 1; },
+                "the pool to shrink");
+        if(manager.poolStats().shrunk != 2)
+            FAIL_LOG("Fastcgipp::Scheduling shrunk the pool the wrong amount")
+
+        // Grow once more so retired threads are joined by spawn() as well
+        if(round == 2)
+        {
+            gate = false;
+            for(Fastcgipp::Protocol::FcgiId id=1; id<=2; ++id)
+                request(client, id, "/0/block/" + std::to_string(id));
+            wait(client, [] () { return blocked == 2; }, "the pool to grow");
+            gate = true;
+            wait(
+                    client,
+                    [] () { return finished.size() == 5; },
+                    "all requests");
+        }
+
+        client.close();
+        manager.stop();
+        manager.join();
+    }
+
+    return 0;
+}
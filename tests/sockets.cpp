@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <map>
+#include <set>
 #include <random>
 #include <algorithm>
 #include <iterator>
@@ -24,6 +25,21 @@ std::mutex doneMutex;
 
 Fastcgipp::SocketGroup* serverGroup;
 
+//! Listen on a random port, moving on to another if it's taken
+std::string listenRandom(Fastcgipp::SocketGroup& group)
+{
+    std::random_device trueRand;
+    std::uniform_int_distribution<> portDist(2048, 65535);
+    for(unsigned attempt=0; attempt<16; ++attempt)
+    {
+        const std::string service = std::to_string(portDist(trueRand));
+        if(group.listen("127.0.0.1", service.c_str()))
+            return service;
+    }
+    FAIL_LOG("Unable to listen on any port")
+    return std::string();
+}
+
 void client()
 {
     Fastcgipp::SocketGroup group;
@@ -200,6 +216,7 @@ void client()
 
 std::condition_variable cv;
 std::mutex cvMutex;
+bool listening=false;
 
 void server()
 {
@@ -213,8 +230,8 @@ void server()
 
     Fastcgipp::SocketGroup group;
     serverGroup = &group;
-    if(!group.listen("127.0.0.1", port.c_str()))
-        FAIL_LOG("Unable to listen")
+    port = listenRandom(group);
+    listening=true;
     cv.notify_all();
     cvLock.unlock();
     std::map<Fastcgipp::Socket, Buffer> buffers;
@@ -231,10 +248,10 @@ void server()
 
         // Transmit data
         flushed = true;
-        for(auto& pair: buffers)
+        for(auto pair = buffers.begin(); pair != buffers.end();)
         {
-            const Fastcgipp::Socket& socket = pair.first;
-            Buffer& buffer = pair.second;
+            const Fastcgipp::Socket& socket = pair->first;
+            Buffer& buffer = pair->second;
 
             if(socket.valid() && buffer.sending)
             {
@@ -243,8 +260,8 @@ void server()
                         buffer.data.end()-buffer.position);
                 if(sent<=0)
                 {
+                    ++pair;
                     continue;
-                    lock.lock();
                 }
                 buffer.position += sent;
                 if(buffer.position  == buffer.data.end())
@@ -255,12 +272,14 @@ void server()
                     if(killSocket(rd))
                     {
                         socket.close();
-                        buffers.erase(socket);
+                        pair = buffers.erase(pair);
+                        continue;
                     }
                 }
                 else
                     flushed = false;
             }
+            ++pair;
         }
 
         // Any data waiting for us to receive?
@@ -311,6 +330,245 @@ void server()
         FAIL_LOG("Server has active sockets when it shouldn't")
 }
 
+void timeouts()
+{
+    typedef Fastcgipp::SocketGroup::Clock Clock;
+    const auto timeout = std::chrono::milliseconds(100);
+
+    Fastcgipp::SocketGroup server;
+    Fastcgipp::SocketGroup client;
+    server.setAcceptTimeout(timeout);
+    const std::string service = listenRandom(server);
+
+    const auto start = Clock::now();
+    if(
+            !client.connect("127.0.0.1", service.c_str()).valid()
+            || !client.connect("127.0.0.1", service.c_str()).valid())
+        FAIL_LOG("Unable to connect to port " << service.c_str())
+
+    unsigned expired = 0;
+    while(expired < 2)
+    {
+        if(Clock::now()-start > std::chrono::seconds(5))
+            FAIL_LOG("Sockets took too long to expire")
+        server.poll(true);
+        for(
+                Fastcgipp::Socket socket = server.expired();
+                socket.valid();
+                socket = server.expired())
+        {
+            if(Clock::now()-start < timeout)
+                FAIL_LOG("Socket expired early")
+            socket.close();
+            ++expired;
+        }
+    }
+
+    if(server.size() != 0)
+        FAIL_LOG("Expired sockets are still in the group")
+}
+
+void acceptPause()
+{
+    typedef Fastcgipp::SocketGroup::Clock Clock;
+
+    Fastcgipp::SocketGroup server;
+    Fastcgipp::SocketGroup client;
+    server.setAcceptLimits(1, 1, 0);
+    const std::string service = listenRandom(server);
+
+    // Accept one connection and give it a long timeout
+    const Fastcgipp::Socket first = client.connect(
+            "127.0.0.1",
+            service.c_str());
+    if(!first.valid() || first.write("x", 1) != 1)
+        FAIL_LOG("Unable to connect to port " << service.c_str())
+    const Fastcgipp::Socket idle = server.poll(true);
+    char x;
+    if(!idle.valid() || idle.read(&x, 1) != 1)
+        FAIL_LOG("Unable to accept the first connection")
+    server.setTimeout(idle, std::chrono::seconds(30));
+
+    // The next connection waits out the accept pause but not the timeout
+    const auto start = Clock::now();
+    const Fastcgipp::Socket second = client.connect(
+            "127.0.0.1",
+            service.c_str());
+    if(!second.valid() || second.write("x", 1) != 1)
+        FAIL_LOG("Unable to connect to port " << service.c_str())
+    Fastcgipp::Socket accepted;
+    while(!accepted.valid())
+    {
+        // This wakes up at the end of the pause
+        accepted = server.poll(true);
+        if(Clock::now()-start > std::chrono::seconds(5))
+            FAIL_LOG("Accepting didn't resume at the end of the pause")
+    }
+    if(accepted == idle)
+        FAIL_LOG("Didn't accept the second connection")
+    if(Clock::now()-start < std::chrono::milliseconds(500))
+        FAIL_LOG("Accepting didn't pause")
+}
+
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#ifdef FASTCGIPP_LINUX
+#include <linux/vm_sockets.h>
+#endif
+
+//! Make a TCP socket on the loopback interface, optionally listening on it
+int tcpSocket(bool listening)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd == -1)
+        FAIL_LOG("Unable to create a socket: " << std::strerror(errno))
+
+    if(listening)
+    {
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        if(bind(fd, (sockaddr*)&address, sizeof(address)) < 0
+                || ::listen(fd, 1) < 0)
+            FAIL_LOG("Unable to listen: " << std::strerror(errno))
+    }
+    return fd;
+}
+
+void adoption()
+{
+    Fastcgipp::SocketGroup group;
+
+    // Not a stream socket
+    const int datagram = socket(AF_INET, SOCK_DGRAM, 0);
+    if(group.adopt(datagram))
+        FAIL_LOG("Adopted a datagram socket")
+    close(datagram);
+
+    // Not listening
+    const int stream = tcpSocket(false);
+    if(group.adopt(stream))
+        FAIL_LOG("Adopted a socket that isn't listening")
+    close(stream);
+
+#ifdef FASTCGIPP_LINUX
+    // An unsupported address family. Only where the kernel has vsock.
+    const int vsock = socket(AF_VSOCK, SOCK_STREAM, 0);
+    if(vsock != -1)
+    {
+        sockaddr_vm address;
+        std::memset(&address, 0, sizeof(address));
+        address.svm_family = AF_VSOCK;
+        address.svm_cid = VMADDR_CID_ANY;
+        address.svm_port = VMADDR_PORT_ANY;
+        if(bind(vsock, (sockaddr*)&address, sizeof(address)) == 0
+                && ::listen(vsock, 1) == 0
+                && group.adopt(vsock))
+            FAIL_LOG("Adopted a socket with an unsupported address family")
+        close(vsock);
+    }
+#endif
+
+    if(!group.listeners().empty())
+        FAIL_LOG("Rejected sockets were added to the listeners")
+
+    // A listening TCP socket is fine but only once
+    const int listener = tcpSocket(true);
+    if(!group.adopt(listener))
+        FAIL_LOG("Unable to adopt a listening socket")
+    if(group.adopt(listener))
+        FAIL_LOG("Adopted the same socket twice")
+    if(group.listeners() != std::set<Fastcgipp::socket_t>{listener})
+        FAIL_LOG("The adopted socket isn't in the listeners")
+}
+
+//! Set the socket activation environment variables
+void activationEnvironment(long pid, const char* fds, const char* names)
+{
+    setenv("LISTEN_PID", std::to_string(pid).c_str(), 1);
+    setenv("LISTEN_FDS", fds, 1);
+    if(names == nullptr)
+        unsetenv("LISTEN_FDNAMES");
+    else
+        setenv("LISTEN_FDNAMES", names, 1);
+}
+
+void activation()
+{
+    // Sockets are passed starting at file descriptor 3. Whatever we may
+    // have inherited there is replaced.
+    for(int fd=3; fd<6; ++fd)
+    {
+        const int listener = tcpSocket(true);
+        if(listener == fd)
+            continue;
+        if(dup2(listener, fd) != fd)
+            FAIL_LOG("Unable to move a socket to file descriptor " << fd)
+        close(listener);
+    }
+
+    // Sockets for some other process
+    {
+        Fastcgipp::SocketGroup group;
+        activationEnvironment(getpid()+1, "3", nullptr);
+        if(group.listenActivated())
+            FAIL_LOG("Adopted sockets passed to another process")
+    }
+
+    // No sockets
+    {
+        Fastcgipp::SocketGroup group;
+        activationEnvironment(getpid(), "0", nullptr);
+        if(group.listenActivated())
+            FAIL_LOG("Adopted sockets when none were passed")
+    }
+
+    // Picking a socket by name
+    Fastcgipp::SocketGroup second;
+    activationEnvironment(getpid(), "3", "first:second:third");
+    if(!second.listenActivated("second"))
+        FAIL_LOG("Unable to adopt the socket named second")
+    if(second.listeners() != std::set<Fastcgipp::socket_t>{4})
+        FAIL_LOG("Adopted the wrong sockets by name")
+    if(std::getenv("LISTEN_PID") != nullptr
+            || std::getenv("LISTEN_FDS") != nullptr
+            || std::getenv("LISTEN_FDNAMES") != nullptr)
+        FAIL_LOG("The socket activation environment was left behind")
+    if(second.listenActivated())
+        FAIL_LOG("Adopted sockets without the environment")
+
+    // Empty names still count their socket
+    Fastcgipp::SocketGroup third;
+    activationEnvironment(getpid(), "3", "::third");
+    if(!third.listenActivated("third"))
+        FAIL_LOG("Unable to adopt the socket named third")
+    if(third.listeners() != std::set<Fastcgipp::socket_t>{5})
+        FAIL_LOG("Miscounted the empty socket names")
+
+    // Names asked for but none passed
+    {
+        Fastcgipp::SocketGroup group;
+        activationEnvironment(getpid(), "3", nullptr);
+        if(group.listenActivated("first"))
+            FAIL_LOG("Adopted a socket by name without any names")
+    }
+
+    // All of them without a name
+    Fastcgipp::SocketGroup first;
+    activationEnvironment(getpid(), "1", "first");
+    if(!first.listenActivated())
+        FAIL_LOG("Unable to adopt all the sockets")
+    if(first.listeners() != std::set<Fastcgipp::socket_t>{3})
+        FAIL_LOG("Adopted the wrong sockets")
+}
+
 #include "fastcgi++/config.hpp"
 #if defined FASTCGIPP_UNIX || defined FASTCGIPP_LINUX
 #include <sys/types.h>
@@ -341,21 +599,24 @@ unsigned int openfds()
 
 int main()
 {
-    const auto initialFds = openfds();
+    // The passed sockets replace the first file descriptors
+    activation();
 
-    std::random_device trueRand;
-    std::uniform_int_distribution<> portDist(2048, 65534);
-    port = std::to_string(portDist(trueRand));
+    const auto initialFds = openfds();
 
     done=false;
     std::thread serverThread(server);
     {
         std::unique_lock<std::mutex> cvLock(cvMutex);
-        cv.wait(cvLock);
+        cv.wait(cvLock, [] { return listening; });
     }
     client();
     serverThread.join();
 
+    timeouts();
+    acceptPause();
+    adoption();
+
     if(openfds() != initialFds)
         FAIL_LOG("There are leftover file descriptors after they should all "\
                 "have been closed");
@@ -0,0 +1,179 @@
+#include "fastcgi++/log.hpp"
+#include "fastcgi++/timer.hpp"
+
+#include <random>
+#include <map>
+#include <set>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+int main()
+{
+    typedef std::chrono::steady_clock Clock;
+    std::mt19937_64 engine(2006);
+
+    // Testing Fastcgipp::TimingWheel against a simple sorted container
+    {
+        const auto resolution = std::chrono::milliseconds(1);
+        Fastcgipp::TimingWheel<unsigned> wheel(resolution);
+        const Clock::time_point start = Clock::now();
+        Clock::time_point now = start;
+
+        struct Pending
+        {
+            Clock::time_point expiry;
+            Fastcgipp::TimingWheel<unsigned>::Handle handle;
+        };
+        std::map<unsigned, Pending> pending;
+        std::vector<unsigned> expired;
+        unsigned id=0;
+
+        // Delays spanning every level of the wheel and beyond
+        std::uniform_int_distribution<int> levelDist(0, 4);
+        std::uniform_int_distribution<unsigned> stepDist(0, 3);
+        std::bernoulli_distribution cancelDist(0.1);
+
+        for(unsigned round=0; round<2000; ++round)
+        {
+            // Schedule some timeouts
+            for(unsigned i=0; i<64; ++i)
+            {
+                const int level = levelDist(engine);
+                std::uniform_int_distribution<uint64_t> delayDist(
+                        0,
+                        (uint64_t(1)<<(8*level+8))+1000);
+                const Clock::time_point expiry = now
+                    + std::chrono::milliseconds(delayDist(engine));
+                pending[id] = Pending{expiry, wheel.insert(expiry, unsigned(id))};
+                ++id;
+            }
+
+            // Cancel a few
+            for(auto it=pending.begin(); it!=pending.end();)
+            {
+                if(cancelDist(engine))
+                {
+                    if(!wheel.cancel(it->second.handle))
+                        FAIL_LOG("Fastcgipp::TimingWheel failed to cancel a "\
+                                "pending timeout")
+                    if(wheel.cancel(it->second.handle))
+                        FAIL_LOG("Fastcgipp::TimingWheel cancelled a timeout "\
+                                "twice")
+                    it = pending.erase(it);
+                }
+                else
+                    ++it;
+            }
+
+            if(wheel.size() != pending.size())
+                FAIL_LOG("Fastcgipp::TimingWheel has the wrong size")
+
+            // Move time forward by anything from a tick to a few days
+            const unsigned step = stepDist(engine);
+            std::uniform_int_distribution<uint64_t> advanceDist(
+                    0,
+                    uint64_t(1)<<(8*step+6));
+            now += std::chrono::milliseconds(advanceDist(engine));
+
+            if(wheel.next() < start)
+                FAIL_LOG("Fastcgipp::TimingWheel::next() is in the past")
+
+            expired.clear();
+            wheel.advance(now, expired);
+
+            for(const auto& x: expired)
+            {
+                const auto it = pending.find(x);
+                if(it == pending.end())
+                    FAIL_LOG("Fastcgipp::TimingWheel expired a timeout that "\
+                            "wasn't pending")
+                if(it->second.expiry > now)
+                    FAIL_LOG("Fastcgipp::TimingWheel expired a timeout early")
+                if(wheel.cancel(it->second.handle))
+                    FAIL_LOG("Fastcgipp::TimingWheel cancelled an expired "\
+                            "timeout")
+                pending.erase(it);
+            }
+
+            for(const auto& x: pending)
+                if(x.second.expiry+resolution <= now)
+                    FAIL_LOG("Fastcgipp::TimingWheel missed a timeout")
+
+            if(!wheel.empty() && wheel.next()+resolution <= now)
+                FAIL_LOG("Fastcgipp::TimingWheel::next() is behind")
+        }
+
+        now += std::chrono::hours(24*366*40);
+        expired.clear();
+        wheel.advance(now, expired);
+        if(!wheel.empty() || expired.size() != pending.size())
+            FAIL_LOG("Fastcgipp::TimingWheel didn't expire everything")
+    }
+
+    // Testing Fastcgipp::Timer
+    {
+        const unsigned count = 2000;
+        const auto resolution = std::chrono::milliseconds(1);
+        Fastcgipp::Timer timer(resolution);
+        timer.start();
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<Clock::time_point> wakeups(count);
+        std::vector<bool> cancelled(count, false);
+        unsigned received = 0;
+        unsigned expected = count;
+
+        const auto callback = [&] (Fastcgipp::Message message)
+        {
+            const auto now = Clock::now();
+            std::lock_guard<std::mutex> lock(mutex);
+            const unsigned index = message.type-1;
+            if(cancelled[index])
+                FAIL_LOG("Fastcgipp::Timer delivered a cancelled message")
+            if(now < wakeups[index])
+                FAIL_LOG("Fastcgipp::Timer delivered a message early")
+            if(++received == expected)
+                cv.notify_one();
+        };
+
+        std::uniform_int_distribution<unsigned> delayDist(0, 250);
+        std::bernoulli_distribution cancelDist(0.25);
+        std::vector<Fastcgipp::Timer::Handle> handles(count);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(unsigned i=0; i<count; ++i)
+            {
+                wakeups[i] = Clock::now()
+                    + std::chrono::milliseconds(50+delayDist(engine));
+                handles[i] = timer.push(
+                        callback,
+                        Fastcgipp::Message(i+1),
+                        wakeups[i]);
+            }
+
+            for(unsigned i=0; i<count; ++i)
+                if(cancelDist(engine) && timer.cancel(handles[i]))
+                {
+                    cancelled[i] = true;
+                    --expected;
+                }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if(!cv.wait_for(
+                    lock,
+                    std::chrono::seconds(10),
+                    [&] { return received == expected; }))
+            FAIL_LOG("Fastcgipp::Timer didn't deliver all the messages")
+        lock.unlock();
+
+        if(timer.size() != 0)
+            FAIL_LOG("Fastcgipp::Timer has leftover timeouts")
+        timer.stop();
+    }
+
+    return 0;
+}